@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ADS1115_H
+#define ADS1115_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "i2cbus.h"
+
+/**
+ * The ADS1115 on the Onion ADC expansion, read through the I2C scheduler.
+ * Samples are taken in bursts: the converter is put in continuous mode on
+ * one input and its conversion register is read once per conversion, two
+ * bytes and no register write each, then it is powered down again. Reading
+ * a sample at a time in single shot mode costs a config write, a poll and
+ * a register read per sample instead.
+ */
+class Ads1115
+{
+public:
+    static constexpr int Channels = 4;
+    static constexpr int SampleRate = 860;          // conversions per second
+
+    explicit Ads1115(I2cScheduler &i2c, uint8_t address = 0x48);
+
+    int burst(int channel, int16_t *samples, size_t count);
+
+    static float volts(float counts) { return counts * 4.096f / 32768.0f; }
+    uint64_t transactions() const { return m_transactions; }
+
+private:
+    static constexpr uint8_t CONVERSION = 0x00;
+    static constexpr uint8_t CONFIG = 0x01;
+
+    static uint16_t config(int channel, bool continuous);
+
+    I2cScheduler &m_i2c;
+    uint8_t m_address;
+    uint64_t m_transactions;
+};
+
+#endif // ADS1115_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "benchmark.h"
+#include "common_dht_read.h"
+
+/**
+ * Delays the length of the DHT start signal. Per-op real time shows how late
+ * each method returns, cpu ns/op how much of the delay it spent spinning.
+ */
+static void runDelay(BenchState &state, void (*delay)(uint32_t), uint32_t micros)
+{
+    double late = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t start = benchNowNs();
+        delay(micros);
+        uint64_t elapsed = benchNowNs() - start;
+        state.sample(elapsed);
+        late += static_cast<double>(elapsed) - micros * 1000.0;
+    }
+    state.counter("mean_late_ns", late / state.iterations());
+}
+
+static void busyMilliseconds(uint32_t micros)
+{
+    busy_wait_milliseconds(micros / 1000);
+}
+
+static void delayBusy20ms(BenchState &state)
+{
+    runDelay(state, busyMilliseconds, 20000);
+}
+
+static void delayHybrid20ms(BenchState &state)
+{
+    runDelay(state, delay_microseconds, 20000);
+    state.counter("spin_ns", delay_spin_ns());
+}
+
+static void delayHybrid50us(BenchState &state)
+{
+    runDelay(state, delay_microseconds, 50);
+    state.counter("clock_read_ns", delay_clock_ns());
+}
+
+BENCHMARK("delay/busy_20ms", delayBusy20ms, 25);
+BENCHMARK("delay/hybrid_20ms", delayHybrid20ms, 25);
+BENCHMARK("delay/hybrid_50us", delayHybrid50us);
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <random>
+#include <thread>
+
+#include "benchmark.h"
+#include "dht_chardev.h"
+#include "dht_read.h"
+#include "dhtemulator.h"
+#include "dhtsensor.h"
+#include "simregisterfile.h"
+
+#define BENCH_DHT_PIN 19
+
+/**
+ * Builds pulse widths for a known DHT22 frame the way the capture loop sees
+ * them, nominal timings with a few microseconds of noise.
+ */
+static void syntheticPulses(uint32_t pulseNs[DHT_PULSES*2])
+{
+    const uint8_t data[5] = { 0x01, 0xC5, 0x00, 0xD7, 0x9D };  // 45.3% 21.5C
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> noise(-3000, 3000);
+
+    pulseNs[0] = 80000 + noise(rng);
+    pulseNs[1] = 80000 + noise(rng);
+    for (int bit = 0; bit < 40; bit++) {
+        int one = (data[bit / 8] >> (7 - (bit % 8))) & 0x1;
+        pulseNs[2 + bit * 2] = 50000 + noise(rng);
+        pulseNs[3 + bit * 2] = (one ? 70000 : 28000) + noise(rng);
+    }
+}
+
+static void dhtDecode(BenchState &state)
+{
+    uint32_t pulseNs[DHT_PULSES*2];
+    float humidity = 0;
+    float temperature = 0;
+    int failures = 0;
+
+    syntheticPulses(pulseNs);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        if (dht_decode(DHT22, pulseNs, &humidity, &temperature) != DHT_SUCCESS)
+            failures++;
+        benchKeep(humidity);
+    }
+    state.counter("failures", failures);
+}
+
+/**
+ * Decoding frames the capture loop got slightly wrong: every iteration one bit
+ * lands near the 0/1 boundary on the wrong side, so the decoder has to find it
+ * by confidence and flip it to satisfy the checksum.
+ */
+static void dhtDecodeRepair(BenchState &state)
+{
+    uint32_t pulseNs[DHT_PULSES*2];
+    dht_reading reading;
+    double confidence = 0;
+    int repaired = 0;
+    int failures = 0;
+
+    syntheticPulses(pulseNs);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        // Walk the damaged bit through the frame, a 0 stretched or a 1 cut short
+        int bit = i % 40;
+        uint32_t saved = pulseNs[3 + bit * 2];
+
+        pulseNs[3 + bit * 2] = (saved > 49000) ? 46000 : 53000;
+        if (dht_decode(DHT22, pulseNs, &reading) != DHT_SUCCESS)
+            failures++;
+        else if (reading.repaired_bits)
+            repaired++;
+        confidence += reading.confidence;
+        pulseNs[3 + bit * 2] = saved;
+        benchKeep(reading);
+    }
+    state.counter("failures", failures);
+    state.counter("repair_rate", static_cast<double>(repaired) / state.iterations());
+    state.counter("mean_confidence", confidence / state.iterations());
+}
+
+/**
+ * A complete dht_read against the emulator, including the start sequence.
+ * Per-op time is dominated by the sleeps; cpu ns/op is the interesting number.
+ */
+static void dhtRead(BenchState &state)
+{
+    SimRegisterFile sim;
+    DhtEmulator sensor(DHT22);
+    dht_reading reading;
+    double confidence = 0;
+    uint32_t maxGap = 0;
+    int repaired = 0;
+    int success = 0;
+
+    if (state.options().hardware) {
+        state.skip("emulator only, use cycle/sample on hardware");
+        return;
+    }
+
+    sensor.SetJitter(2000);
+    sim.AttachDevice(BENCH_DHT_PIN, &sensor);
+    Module::SetRegisterBackend(&sim);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t start = benchNowNs();
+        if (dht_read(DHT22, BENCH_DHT_PIN, &reading) == DHT_SUCCESS) {
+            success++;
+            confidence += reading.confidence;
+            if (reading.repaired_bits)
+                repaired++;
+        }
+        if (reading.max_gap_ns > maxGap)
+            maxGap = reading.max_gap_ns;
+        state.sample(benchNowNs() - start);
+    }
+    Module::SetRegisterBackend(nullptr);
+
+    state.counter("success_rate", static_cast<double>(success) / state.iterations());
+    state.counter("repaired_rate", static_cast<double>(repaired) / state.iterations());
+    state.counter("mean_confidence", success ? confidence / success : 0);
+    state.counter("max_gap_ns", maxGap);
+    state.counter("watchdog_expired", rt_watchdog_expired());
+    state.counter("register_reads_per_op", static_cast<double>(sim.NumReads()) / state.iterations());
+}
+
+/**
+ * Reads through DhtSensor the way the sensor thread does, waiting out the
+ * conversion interval between them. Only the read itself is timed; once the
+ * line is known idle there is no preamble left, just the start signal and
+ * the frame.
+ */
+static void dhtSensorRead(BenchState &state)
+{
+    SimRegisterFile sim;
+    DhtEmulator emulator(DHT22);
+    DhtSensor sensor(DHT22, BENCH_DHT_PIN);
+    dht_reading reading;
+    int success = 0;
+
+    if (state.options().hardware) {
+        state.skip("emulator only");
+        return;
+    }
+
+    emulator.SetJitter(2000);
+    sim.AttachDevice(BENCH_DHT_PIN, &emulator);
+    Module::SetRegisterBackend(&sim);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        std::this_thread::sleep_until(sensor.nextConversion());
+        uint64_t start = benchNowNs();
+        if (sensor.read(&reading) == DHT_SUCCESS)
+            success++;
+        state.sample(benchNowNs() - start);
+    }
+    Module::SetRegisterBackend(nullptr);
+
+    state.counter("success_rate", static_cast<double>(success) / state.iterations());
+}
+
+/**
+ * dht_read_chardev, against the emulator or a real line given with
+ * --gpiochip. On a real chip the kernel timestamps the edges and cpu ns/op
+ * is the cost of the start signal and a few syscalls; the simulator has no
+ * interrupts, so there it polls like dht/read does.
+ */
+static void dhtReadChardev(BenchState &state)
+{
+    SimRegisterFile sim;
+    DhtEmulator emulator(DHT22);
+    dht_reading reading;
+    int pin = BENCH_DHT_PIN;
+    int success = 0;
+
+    if (state.options().gpioChip.empty()) {
+        if (state.options().hardware) {
+            state.skip("needs --gpiochip on hardware");
+            return;
+        }
+        emulator.SetJitter(2000);
+        sim.AttachDevice(BENCH_DHT_PIN, &emulator);
+        Module::SetRegisterBackend(&sim);
+    }
+    else {
+        pin = state.options().gpioLine;
+    }
+
+    {
+        FastGpioChardev gpio(state.options().gpioChip.empty() ? GPIO_CHARDEV_DEFAULT_CHIP : state.options().gpioChip.c_str());
+        if (!gpio.IsOpen()) {
+            Module::SetRegisterBackend(nullptr);
+            state.skip("unable to open " + state.options().gpioChip);
+            return;
+        }
+
+        for (uint64_t i = 0; i < state.iterations(); i++) {
+            uint64_t start = benchNowNs();
+            if (dht_read_chardev(DHT22, &gpio, pin, &reading) == DHT_SUCCESS)
+                success++;
+            state.sample(benchNowNs() - start);
+        }
+    }
+    Module::SetRegisterBackend(nullptr);
+
+    state.counter("success_rate", static_cast<double>(success) / state.iterations());
+}
+
+/**
+ * Four emulated sensors on one bank captured in a single window, compare
+ * against four times dht/read.
+ */
+static void dhtReadMany(BenchState &state)
+{
+    const int pins[] = { 16, 17, 18, 19 };
+    const int count = sizeof(pins) / sizeof(pins[0]);
+    SimRegisterFile sim;
+    DhtEmulator sensors[count];
+    float humidity[count];
+    float temperature[count];
+    int results[count];
+    int success = 0;
+
+    if (state.options().hardware) {
+        state.skip("emulator only");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sensors[i].SetJitter(2000);
+        sensors[i].SetSeed(i + 1);
+        sensors[i].SetReading(40.0f + i, 20.0f + i);
+        sim.AttachDevice(pins[i], &sensors[i]);
+    }
+    Module::SetRegisterBackend(&sim);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t start = benchNowNs();
+        dht_read_many(DHT22, pins, count, humidity, temperature, results);
+        state.sample(benchNowNs() - start);
+        for (int j = 0; j < count; j++) {
+            if (results[j] == DHT_SUCCESS)
+                success++;
+        }
+    }
+    Module::SetRegisterBackend(nullptr);
+
+    state.counter("sensors", count);
+    state.counter("success_rate", static_cast<double>(success) / (state.iterations() * count));
+}
+
+BENCHMARK("dht/decode", dhtDecode);
+BENCHMARK("dht/decode_repair", dhtDecodeRepair);
+BENCHMARK("dht/read", dhtRead, 5);
+BENCHMARK("dht/read_many", dhtReadMany, 5);
+BENCHMARK("dht/sensor_read", dhtSensorRead, 4);
+BENCHMARK("dht/read_chardev", dhtReadChardev, 5);
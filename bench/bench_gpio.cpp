@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "benchmark.h"
+#include "fastgpioomega2.h"
+#include "fastgpiopin.h"
+#include "registermap.h"
+#include "simregisterfile.h"
+
+#define BENCH_GPIO_PIN 19
+
+/**
+ * Installs the simulated register file for the lifetime of the object unless
+ * the run targets real hardware.
+ */
+class GpioTarget
+{
+public:
+    GpioTarget(const BenchOptions &options)
+    {
+        if (!options.hardware) {
+            m_sim.reset(new SimRegisterFile());
+            Module::SetRegisterBackend(m_sim.get());
+        }
+        m_gpio.reset(new FastGpioOmega2());
+    }
+    ~GpioTarget()
+    {
+        m_gpio.reset();
+        if (m_sim)
+            Module::SetRegisterBackend(nullptr);
+    }
+
+    FastGpioOmega2 &gpio() { return *m_gpio; }
+
+private:
+    std::unique_ptr<SimRegisterFile> m_sim;
+    std::unique_ptr<FastGpioOmega2> m_gpio;
+};
+
+static void gpioRead(BenchState &state)
+{
+    GpioTarget target(state.options());
+    int value = 0;
+
+    target.gpio().SetDirection(BENCH_GPIO_PIN, 0);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        target.gpio().Read(BENCH_GPIO_PIN, value);
+        benchKeep(value);
+    }
+}
+
+static void gpioSet(BenchState &state)
+{
+    GpioTarget target(state.options());
+
+    target.gpio().SetDirection(BENCH_GPIO_PIN, 1);
+    for (uint64_t i = 0; i < state.iterations(); i++)
+        target.gpio().Set(BENCH_GPIO_PIN, i & 0x1);
+}
+
+/**
+ * The accessors dht_read uses in its capture loop
+ */
+template <class Pin> static void pinRead(BenchState &state, const Pin &pin)
+{
+    pin.SetDirection(0);
+    for (uint64_t i = 0; i < state.iterations(); i++)
+        benchKeep(pin.Read());
+}
+
+static void gpioPinRead(BenchState &state)
+{
+    GpioTarget target(state.options());
+    FastGpioOmega2 &gpio = target.gpio();
+
+    if (gpio.GetBackend())
+        pinRead(state, FastGpioPin<BENCH_GPIO_PIN, GpioBackendAccess>(GpioBackendAccess(gpio.GetBackend())));
+    else
+        pinRead(state, FastGpioPin<BENCH_GPIO_PIN>(GpioMmioAccess(gpio.GetRegisterAddress())));
+}
+
+static void gpioRuntimePinRead(BenchState &state)
+{
+    GpioTarget target(state.options());
+    FastGpioOmega2 &gpio = target.gpio();
+
+    if (gpio.GetBackend())
+        pinRead(state, FastGpioRuntimePin<GpioBackendAccess>(BENCH_GPIO_PIN, GpioBackendAccess(gpio.GetBackend())));
+    else
+        pinRead(state, FastGpioRuntimePin<GpioMmioAccess>(BENCH_GPIO_PIN, GpioMmioAccess(gpio.GetRegisterAddress())));
+}
+
+static int countVmas()
+{
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    int count = 0;
+
+    while (std::getline(maps, line))
+        count++;
+    return count;
+}
+
+/**
+ * Soak for the shared register mapping. With one FastGpioOmega2 held for the
+ * whole run, like main() holds the mapping, millions of GPIO users come and
+ * go. Off hardware /dev/zero stands in for /dev/mem, the constructors and
+ * destructors are the same. Fails unless exactly the one mapping is alive
+ * during the run and the process ends with the VMAs it started with.
+ */
+static void gpioSoak(BenchState &state)
+{
+    const bool hardware = state.options().hardware;
+    const char *device = hardware ? "/dev/mem" : "/dev/zero";
+    const uint32_t base = hardware ? REG_BLOCK_ADDR : 0;
+    int vmaBefore = countVmas();
+    int vmaPeak = vmaBefore;
+    int mappings;
+
+    if (Module::GetRegisterBackend()) {
+        state.skip("a simulated register backend is installed");
+        return;
+    }
+
+    {
+        FastGpioOmega2 holder(device, base);
+        if (!holder.IsReady()) {
+            state.skip(std::string("unable to map ") + device);
+            return;
+        }
+
+        for (uint64_t i = 0; i < state.iterations(); i++) {
+            FastGpioOmega2 gpio(device, base);
+            int value = 0;
+            gpio.Read(BENCH_GPIO_PIN, value);
+            benchKeep(value);
+
+            if ((i & 0xFFFFF) == 0)
+                vmaPeak = std::max(vmaPeak, countVmas());
+        }
+        mappings = RegisterMap::NumMappings();
+    }
+
+    int vmaAfter = countVmas();
+    state.counter("vma_before", vmaBefore);
+    state.counter("vma_peak_growth", vmaPeak - vmaBefore);
+    state.counter("vma_growth", vmaAfter - vmaBefore);
+    state.counter("mappings_alive", mappings);
+
+    if (vmaAfter != vmaBefore)
+        state.fail("register mapping leaked " + std::to_string(vmaAfter - vmaBefore) + " VMAs");
+    else if (mappings != 1)
+        state.fail(std::to_string(mappings) + " register mappings alive during the run, expected 1");
+}
+
+BENCHMARK("gpio/read", gpioRead);
+BENCHMARK("gpio/pin_read", gpioPinRead);
+BENCHMARK("gpio/runtime_pin_read", gpioRuntimePinRead);
+BENCHMARK("gpio/set", gpioSet);
+BENCHMARK("gpio/soak", gpioSoak, 2000000);
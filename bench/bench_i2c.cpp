@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "benchmark.h"
+#include "i2cbus.h"
+#include "oleddisplay.h"
+#include "relayexpansion.h"
+#include "simi2cbus.h"
+
+/**
+ * A relay switch issued while a whole new OLED frame is queued, on a
+ * simulated 400kHz bus. Samples are how long the switch took; it should
+ * wait for at most the display chunk already on the wire, around 1ms,
+ * where the full frame takes about 30ms. The run fails if a relay write
+ * errors or more than one switch in twenty waits past two chunks; a
+ * scheduler that lets the frame go first waits thirty.
+ */
+static void i2cRelayBehindFrame(BenchState &state)
+{
+    const unsigned int bitRate = 400000;
+    // A chunk's columns plus its addressing commands, 9 bits a byte on the wire
+    const uint64_t chunkNs = (OledDisplay::ChunkColumns + 8) * 9 * 1000000000ull / bitRate;
+    SimI2cBus bus(bitRate);
+    SimI2cRegisters mcp23008;
+    SimI2cRegisters ssd1306;
+    bus.attach(0x27, &mcp23008);
+    bus.attach(0x3c, &ssd1306);
+
+    I2cScheduler i2c(bus);
+    RelayExpansion relays(i2c, 7);
+    OledDisplay oled(i2c);
+    uint8_t frame[OledDisplay::FrameSize];
+    uint64_t late = 0;
+
+    relays.init();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        memset(frame, (i & 1) ? 0xff : 0x00, sizeof(frame));
+        oled.draw(frame);
+
+        uint64_t start = benchNowNs();
+        relays.setChannel(1, i & 1);
+        uint64_t elapsed = benchNowNs() - start;
+        state.sample(elapsed);
+        if (elapsed > 2 * chunkNs)
+            late++;
+
+        while (i2c.pending())
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    I2cScheduler::DeviceStats relayStats = i2c.stats(0x27);
+    I2cScheduler::DeviceStats oledStats = i2c.stats(0x3c);
+    state.counter("relay_errors", relayStats.errors);
+    state.counter("oled_chunks", oledStats.transactions);
+    state.counter("late_switches", late);
+
+    if (relayStats.errors)
+        state.fail(std::to_string(relayStats.errors) + " relay writes failed");
+    else if (late * 20 > state.iterations())
+        state.fail(std::to_string(late) + " relay switches waited longer than two display chunks");
+}
+
+/**
+ * Eight writes to the same register queued behind a busy bus, as happens
+ * when a schedule and a command land together. Counts how many of them
+ * actually reach the device, and fails the run if a burst gets more than one
+ * through.
+ */
+static void i2cCoalesce(BenchState &state)
+{
+    SimI2cBus bus(400000);
+    SimI2cRegisters device;
+    SimI2cRegisters other;
+    bus.attach(0x20, &device);
+    bus.attach(0x21, &other);
+
+    I2cScheduler i2c(bus);
+    std::vector<uint8_t> block(256);
+    uint64_t uncoalesced = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t before = device.writes(0x09);
+
+        i2c.submit(0x21, { I2cMessage::send(block) }, I2cScheduler::Control);
+        for (uint8_t value = 0; value < 8; value++)
+            i2c.submit(0x20, { I2cMessage::send({ 0x09, value }) }, I2cScheduler::Control, nullptr, 0x09);
+        while (i2c.pending())
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (device.writes(0x09) - before > 1)
+            uncoalesced++;
+    }
+    state.counter("writes_per_burst", static_cast<double>(device.writes(0x09)) / state.iterations());
+
+    if (uncoalesced)
+        state.fail(std::to_string(uncoalesced) + " bursts wrote register 0x09 more than once");
+}
+
+BENCHMARK("i2c/relay_behind_frame", i2cRelayBehindFrame, 200);
+BENCHMARK("i2c/coalesce", i2cCoalesce, 200);
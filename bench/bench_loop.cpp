@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include "benchmark.h"
+#include "eventloop.h"
+
+/**
+ * Adding a timer and cancelling it again, with a few thousand others spread
+ * over every level of the wheel. Both are constant time, so this should not
+ * move with the number of timers.
+ */
+static void loopAddCancel(BenchState &state)
+{
+    EventLoop loop;
+    auto noop = []() {};
+
+    for (int i = 0; i < 4096; i++)
+        loop.after(std::chrono::milliseconds(i * 997 % 3600000), noop);
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        EventLoop::TimerId id = loop.after(std::chrono::milliseconds(i % 600000), noop);
+        loop.cancel(id);
+    }
+}
+
+/**
+ * A 10ms periodic task run for real. Each sample is how late the task
+ * started against its ideal schedule, cpu ns/op how much the loop itself
+ * spent per run, which should be close to nothing.
+ */
+static void loopLateness(BenchState &state)
+{
+    EventLoop loop;
+    uint64_t runs = 0;
+    uint64_t start = loop.now() + 10000000;
+    const uint64_t count = state.iterations();
+
+    loop.every(std::chrono::milliseconds(10), [&]() {
+        uint64_t ideal = start + runs * 10000000;
+        uint64_t now = loop.now();
+        state.sample(now > ideal ? now - ideal : 0);
+        if (++runs == count)
+            loop.stop();
+    }, std::chrono::milliseconds(10));
+    loop.run();
+    state.counter("overruns", loop.overruns());
+}
+
+BENCHMARK("loop/add_cancel", loopAddCancel);
+BENCHMARK("loop/lateness_10ms", loopLateness, 200);
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "benchmark.h"
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+        << "  --format=table|json|csv  Output format (default table)" << std::endl
+        << "  --out=FILE               Write results to FILE instead of stdout" << std::endl
+        << "  --filter=TEXT            Only run benchmarks whose name contains TEXT" << std::endl
+        << "  --min-time=SECONDS       Minimum run time per benchmark (default 0.5)" << std::endl
+        << "  --broker=HOST[:PORT]     MQTT broker for publish benchmarks (default localhost:1883)" << std::endl
+        << "  --hardware               Use the Omega2 registers instead of the simulator" << std::endl
+        << "  --gpiochip=PATH:LINE     GPIO character device line for the chardev benchmarks" << std::endl
+        << "                           (hardware or gpio-sim, default the simulator)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+
+    options.format = "table";
+    options.broker = "localhost";
+    options.port = 1883;
+    options.minTime = 0.5;
+    options.hardware = false;
+    options.gpioLine = -1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string value;
+        size_t eq = arg.find('=');
+
+        if (eq != std::string::npos) {
+            value = arg.substr(eq + 1);
+            arg = arg.substr(0, eq);
+        }
+
+        if (arg == "--format")
+            options.format = value;
+        else if (arg == "--out")
+            options.output = value;
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--min-time")
+            options.minTime = std::stod(value);
+        else if (arg == "--hardware")
+            options.hardware = true;
+        else if (arg == "--gpiochip") {
+            size_t colon = value.rfind(':');
+            options.gpioChip = value.substr(0, colon);
+            options.gpioLine = (colon != std::string::npos) ? std::stoi(value.substr(colon + 1)) : 0;
+        }
+        else if (arg == "--broker") {
+            size_t colon = value.find(':');
+            options.broker = value.substr(0, colon);
+            if (colon != std::string::npos)
+                options.port = std::stoi(value.substr(colon + 1));
+        }
+        else {
+            usage(argv[0]);
+            return (arg == "--help" || arg == "-h") ? 0 : 1;
+        }
+    }
+
+    if (options.format != "table" && options.format != "json" && options.format != "csv") {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return runBenchmarks(options);
+}
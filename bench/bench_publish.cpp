@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "benchmark.h"
+#include "dht_read.h"
+#include "dhtemulator.h"
+#include "environment.h"
+#include "mqttclient.h"
+#include "payloadcodec.h"
+#include "samplebatch.h"
+#include "simregisterfile.h"
+
+#define BENCH_DHT_PIN 19
+#define BENCH_TOPIC "planter/bench/environment"
+
+static EnvironmentReading sampleReading()
+{
+    EnvironmentReading reading;
+
+    reading.location = "familyroom";
+    reading.name = "omega-bench";
+    reading.uptime = 123456;
+    reading.light = 1;
+    reading.humidity = 45.3f;
+    reading.celsius = 21.5f;
+    reading.confidence = 0.9f;
+    return reading;
+}
+
+/**
+ * Connects to the broker named on the command line and waits a moment for
+ * the CONNACK. Returns nullptr when no broker answers.
+ */
+static std::unique_ptr<MQTTClient> connectBroker(const BenchOptions &options)
+{
+    std::string name = "planter-bench";
+    std::unique_ptr<MQTTClient> client(new MQTTClient(name, options.broker, options.port));
+
+    for (int i = 0; i < 40 && !client->isConnected(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    if (!client->isConnected())
+        client.reset();
+    return client;
+}
+
+/**
+ * Encoding one sample in each payload format, the buffer reused as
+ * publishEnvironment() does
+ */
+static void payloadEncode(BenchState &state, PayloadFormat format)
+{
+    EnvironmentReading reading = sampleReading();
+    PayloadEncoder encoder(format);
+    size_t bytes = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        reading.uptime++;
+        bytes = encoder.encode(reading).size();
+        benchKeep(encoder.buffer());
+    }
+    state.counter("payload_bytes", bytes);
+}
+
+static void payloadJson(BenchState &state)
+{
+    payloadEncode(state, PayloadFormat::JSON);
+}
+
+static void payloadCbor(BenchState &state)
+{
+    payloadEncode(state, PayloadFormat::CBOR);
+}
+
+static void payloadMsgpack(BenchState &state)
+{
+    payloadEncode(state, PayloadFormat::MSGPACK);
+}
+
+static void payloadPacked(BenchState &state)
+{
+    payloadEncode(state, PayloadFormat::PACKED);
+}
+
+/**
+ * Samples a minute apart collected into batches of 30 as PLANTER_BATCH=30
+ * does. Per-op time is one add plus a thirtieth of the encode.
+ */
+static void payloadBatch(BenchState &state)
+{
+    EnvironmentReading reading = sampleReading();
+    SampleBatch batch(30);
+    time_t now = 1700000000;
+    size_t bytes = 0;
+    uint64_t batches = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        reading.celsius = 21.5f + (i % 7) * 0.1f;
+        reading.humidity = 45.3f - (i % 5) * 0.2f;
+        now += 60;
+        if (batch.add(reading, now)) {
+            bytes += batch.encode().size();
+            batches++;
+        }
+    }
+    if (batches)
+        state.counter("bytes_per_sample", static_cast<double>(bytes) / (batches * batch.maxSamples()));
+}
+
+/**
+ * The i-th of a run of readings that swing both ways: celsius crossing zero,
+ * humidity and confidence falling as often as rising, light cycling through
+ * unknown, off and on, and every third reading without location or name.
+ */
+static EnvironmentReading variedReading(uint64_t i)
+{
+    EnvironmentReading reading = sampleReading();
+
+    reading.celsius = -20.0f + ((i * 37) % 6000) / 100.0f;
+    reading.humidity = ((i * 53) % 10000) / 100.0f;
+    reading.confidence = ((i * 71) % 10001) / 10000.0f;
+    reading.light = static_cast<int>(i % 3) - 1;
+    reading.uptime = 1000 + i;
+    if (i % 3 == 0) {
+        reading.location.clear();
+        reading.name.clear();
+    }
+    return reading;
+}
+
+/**
+ * Same value at the resolution the encodings carry
+ */
+static bool sameQuantized(float a, float b, float scale)
+{
+    return lroundf(a * scale) == lroundf(b * scale);
+}
+
+/**
+ * Fails the run unless every batch decodes back to what was added, and every
+ * truncated batch, or one with a byte too many, is rejected. Time steps back
+ * now and then, as it does when NTP corrects the clock.
+ */
+static void payloadBatchRoundTrip(BenchState &state)
+{
+    SampleBatch batch(8);
+    BatchHeader header;
+    std::vector<BatchSample> samples;
+    std::vector<EnvironmentReading> added;
+    std::vector<time_t> times;
+    time_t now = 1700000000;
+    uint64_t mismatches = 0;
+    uint64_t accepted = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        EnvironmentReading reading = variedReading(i);
+        now += (i % 11 == 10) ? -30 : 60;
+        added.push_back(reading);
+        times.push_back(now);
+        if (!batch.add(reading, now))
+            continue;
+
+        std::vector<uint8_t> payload = batch.encode();
+        if (!SampleBatch::decode(payload.data(), payload.size(), header, samples) ||
+            header.location != added[0].location || header.name != added[0].name ||
+            header.uptime != added[0].uptime || samples.size() != added.size()) {
+            mismatches++;
+        }
+        else {
+            for (size_t j = 0; j < samples.size(); j++) {
+                if (samples[j].time != times[j] || samples[j].light != added[j].light ||
+                    !sameQuantized(samples[j].celsius, added[j].celsius, 100) ||
+                    !sameQuantized(samples[j].humidity, added[j].humidity, 100) ||
+                    !sameQuantized(samples[j].confidence, added[j].confidence, 10000))
+                    mismatches++;
+            }
+        }
+
+        for (size_t length = 0; length < payload.size(); length++) {
+            if (SampleBatch::decode(payload.data(), length, header, samples))
+                accepted++;
+        }
+        payload.push_back(0);
+        if (SampleBatch::decode(payload.data(), payload.size(), header, samples))
+            accepted++;
+
+        added.clear();
+        times.clear();
+    }
+
+    state.counter("mismatches", mismatches);
+    state.counter("bad_accepted", accepted);
+    if (mismatches)
+        state.fail(std::to_string(mismatches) + " batch samples did not decode to what was added");
+    else if (accepted)
+        state.fail(std::to_string(accepted) + " truncated or overlong batches decoded");
+}
+
+/**
+ * The same for PACKED and PayloadEncoder::decodePacked()
+ */
+static void payloadPackedRoundTrip(BenchState &state)
+{
+    PayloadEncoder encoder(PayloadFormat::PACKED);
+    EnvironmentReading decoded;
+    uint64_t mismatches = 0;
+    uint64_t accepted = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        EnvironmentReading reading = variedReading(i);
+        const std::vector<uint8_t> &payload = encoder.encode(reading);
+
+        if (!PayloadEncoder::decodePacked(payload.data(), payload.size(), decoded) ||
+            decoded.location != reading.location || decoded.name != reading.name ||
+            decoded.uptime != reading.uptime || decoded.light != reading.light ||
+            !sameQuantized(decoded.celsius, reading.celsius, 100) ||
+            !sameQuantized(decoded.humidity, reading.humidity, 100) ||
+            !sameQuantized(decoded.confidence, reading.confidence, 10000))
+            mismatches++;
+
+        for (size_t length = 0; length < payload.size(); length++) {
+            if (PayloadEncoder::decodePacked(payload.data(), length, decoded))
+                accepted++;
+        }
+    }
+
+    state.counter("mismatches", mismatches);
+    state.counter("bad_accepted", accepted);
+    if (mismatches)
+        state.fail(std::to_string(mismatches) + " packed readings did not decode to what was encoded");
+    else if (accepted)
+        state.fail(std::to_string(accepted) + " truncated packed payloads decoded");
+}
+
+static void mqttPublish(BenchState &state)
+{
+    std::unique_ptr<MQTTClient> client = connectBroker(state.options());
+    nlohmann::json doc;
+
+    if (!client) {
+        state.skip("no broker at " + state.options().broker);
+        return;
+    }
+
+    environmentDocument(doc, sampleReading());
+    std::string data = doc.dump();
+    int errors = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t start = benchNowNs();
+        if (client->publish(nullptr, BENCH_TOPIC, data.size(), data.c_str(), 0, false) != MOSQ_ERR_SUCCESS)
+            errors++;
+        state.sample(benchNowNs() - start);
+    }
+    state.counter("errors", errors);
+}
+
+/**
+ * QoS 1 publishes kept inside the client's in-flight window. Publishes the
+ * window refuses are retried after a yield, as the offline queue would.
+ * The latency counters are publish to PUBACK, from the client's histogram.
+ */
+static void mqttPublishQos1(BenchState &state)
+{
+    std::unique_ptr<MQTTClient> client = connectBroker(state.options());
+    nlohmann::json doc;
+
+    if (!client) {
+        state.skip("no broker at " + state.options().broker);
+        return;
+    }
+
+    environmentDocument(doc, sampleReading());
+    std::string data = doc.dump();
+    int errors = 0;
+    client->latency(true);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        int rc;
+        while ((rc = client->publish(nullptr, BENCH_TOPIC, data.size(), data.c_str(), 1, false)) == MQTTClient::WINDOW_FULL)
+            std::this_thread::yield();
+        if (rc != MOSQ_ERR_SUCCESS)
+            errors++;
+    }
+    for (int i = 0; i < 100 && client->inflight(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    LatencyHistogram latency = client->latency();
+    state.counter("errors", errors);
+    state.counter("window_full", client->windowFull());
+    state.counter("ack_p50_ns", latency.percentile(0.5));
+    state.counter("ack_p99_ns", latency.percentile(0.99));
+    state.counter("ack_max_ns", latency.max());
+}
+
+/**
+ * One full sample cycle as main() runs it: read the sensor with the same
+ * retry policy as temperature(), build the document and publish it when a
+ * broker is available.
+ */
+static void sampleCycle(BenchState &state)
+{
+    std::unique_ptr<SimRegisterFile> sim;
+    DhtEmulator sensor(DHT22);
+    std::unique_ptr<MQTTClient> client = connectBroker(state.options());
+    PayloadEncoder encoder;
+    int published = 0;
+    int failures = 0;
+
+    if (!state.options().hardware) {
+        sim.reset(new SimRegisterFile());
+        sensor.SetJitter(2000);
+        sim->AttachDevice(BENCH_DHT_PIN, &sensor);
+        Module::SetRegisterBackend(sim.get());
+    }
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t start = benchNowNs();
+        dht_reading sample;
+        int result = 0;
+        int maxRetry = 3;
+
+        do {
+            result = dht_read(DHT22, BENCH_DHT_PIN, &sample);
+            maxRetry--;
+        } while (result != 0 && maxRetry > 0);
+
+        if (result == 0) {
+            EnvironmentReading reading = sampleReading();
+
+            reading.humidity = sample.humidity;
+            reading.celsius = sample.temperature;
+            reading.confidence = sample.confidence;
+            const std::vector<uint8_t> &data = encoder.encode(reading);
+            if (client && client->publish(nullptr, BENCH_TOPIC, data.size(), data.data(), 0, false) == MOSQ_ERR_SUCCESS)
+                published++;
+        }
+        else {
+            failures++;
+        }
+        state.sample(benchNowNs() - start);
+    }
+
+    if (sim)
+        Module::SetRegisterBackend(nullptr);
+
+    state.counter("failures", failures);
+    state.counter("published", published);
+}
+
+BENCHMARK("payload/json", payloadJson);
+BENCHMARK("payload/cbor", payloadCbor);
+BENCHMARK("payload/msgpack", payloadMsgpack);
+BENCHMARK("payload/packed", payloadPacked);
+BENCHMARK("payload/batch", payloadBatch);
+BENCHMARK("payload/batch_roundtrip", payloadBatchRoundTrip, 24000);
+BENCHMARK("payload/packed_roundtrip", payloadPackedRoundTrip, 3000);
+BENCHMARK("mqtt/publish", mqttPublish);
+BENCHMARK("mqtt/publish_qos1", mqttPublishQos1);
+BENCHMARK("cycle/sample", sampleCycle, 5);
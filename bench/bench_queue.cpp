@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "diskqueue.h"
+
+/**
+ * A fresh queue directory under TMPDIR, or /tmp. On the Omega2 that is RAM,
+ * point TMPDIR at the overlay to time the flash itself.
+ */
+static std::string queueDirectory()
+{
+    const char *tmp = getenv("TMPDIR");
+    std::string path = std::string(tmp ? tmp : "/tmp") + "/planter-bench-XXXXXX";
+    if (mkdtemp(&path[0]) == NULL)
+        return std::string();
+    return path;
+}
+
+static void removeQueue(const std::string &directory)
+{
+    std::string command = "rm -rf '" + directory + "'";
+    if (system(command.c_str()) != 0)
+        return;
+}
+
+/**
+ * Appends a reading sized payload, flushing to storage every syncInterval
+ * records. The sync counter shows how many msync calls that cost.
+ */
+static void queuePush(BenchState &state, int syncInterval)
+{
+    std::string directory = queueDirectory();
+    if (directory.empty()) {
+        state.skip("unable to create a queue directory");
+        return;
+    }
+
+    std::vector<uint8_t> payload(190, 'x');
+    uint64_t failed = 0;
+    {
+        DiskQueue queue(directory);
+        queue.setSyncInterval(syncInterval);
+        if (!queue.open()) {
+            state.skip("unable to open the queue");
+            removeQueue(directory);
+            return;
+        }
+        for (uint64_t i = 0; i < state.iterations(); i++) {
+            uint64_t start = benchNowNs();
+            if (!queue.push("planter/environment", payload.data(), payload.size()))
+                failed++;
+            state.sample(benchNowNs() - start);
+        }
+        state.counter("dropped", queue.dropped());
+    }
+    state.counter("failed", failed);
+    removeQueue(directory);
+}
+
+static void queuePushBatched(BenchState &state)
+{
+    queuePush(state, 8);
+}
+
+static void queuePushSync(BenchState &state)
+{
+    queuePush(state, 1);
+}
+
+/**
+ * Drains a full queue in batches of 32, the size the main loop uses, with a
+ * publisher that accepts everything
+ */
+static void queueDrain(BenchState &state)
+{
+    std::string directory = queueDirectory();
+    if (directory.empty()) {
+        state.skip("unable to create a queue directory");
+        return;
+    }
+
+    std::vector<uint8_t> payload(190, 'x');
+    DiskQueue queue(directory);
+    queue.setSyncInterval(1000);
+    if (!queue.open()) {
+        state.skip("unable to open the queue");
+        removeQueue(directory);
+        return;
+    }
+
+    uint64_t bytes = 0;
+    auto publish = [&bytes](const char *, const uint8_t *, size_t size) {
+        bytes += size;
+        return true;
+    };
+    uint64_t remaining = state.iterations();
+    while (remaining) {
+        for (uint64_t i = 0; i < 32 && i < remaining; i++)
+            queue.push("planter/environment", payload.data(), payload.size());
+        queue.sync();
+
+        uint64_t start = benchNowNs();
+        size_t count = queue.drain(publish, 32);
+        uint64_t elapsed = benchNowNs() - start;
+        for (size_t i = 0; i < count; i++)
+            state.sample(elapsed / count);
+        remaining -= count ? count : remaining;
+    }
+    benchKeep(bytes);
+    queue.close();
+    removeQueue(directory);
+}
+
+/**
+ * Flips a byte inside the first occurrence of text in the queue's segment
+ * files, so that record no longer passes its CRC
+ */
+static bool corruptRecord(const std::string &directory, const std::string &text)
+{
+    DIR *dir = opendir(directory.c_str());
+    struct dirent *entry;
+    bool corrupted = false;
+
+    if (dir == NULL)
+        return false;
+    while (!corrupted && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "segment-", 8) != 0)
+            continue;
+
+        std::string path = directory + "/" + entry->d_name;
+        FILE *file = fopen(path.c_str(), "r+b");
+        if (file == NULL)
+            continue;
+        std::vector<char> data(1 << 20);
+        size_t size = fread(data.data(), 1, data.size(), file);
+        std::string contents(data.data(), size);
+        size_t at = contents.find(text);
+        if (at != std::string::npos && fseek(file, at, SEEK_SET) == 0 && fputc(contents[at] ^ 0xff, file) != EOF)
+            corrupted = true;
+        fclose(file);
+    }
+    closedir(dir);
+    return corrupted;
+}
+
+/**
+ * The crash-safety promise of the queue. Five records are queued and the
+ * third is damaged on disk. Reopening has to keep the first two and count
+ * one discard, a push has to land after them, and a drain that stops early
+ * has to leave, across another reopen, everything it didn't get to. Any
+ * other outcome fails the run.
+ */
+static void queueRecover(BenchState &state)
+{
+    std::vector<std::string> drained;
+    auto collect = [&drained](const char *, const uint8_t *data, size_t size) {
+        drained.push_back(std::string(reinterpret_cast<const char*>(data), size));
+        return true;
+    };
+    auto collectOne = [&drained](const char *, const uint8_t *data, size_t size) {
+        if (!drained.empty())
+            return false;
+        drained.push_back(std::string(reinterpret_cast<const char*>(data), size));
+        return true;
+    };
+    std::string failure;
+
+    for (uint64_t i = 0; i < state.iterations() && failure.empty(); i++) {
+        std::string directory = queueDirectory();
+        if (directory.empty()) {
+            state.skip("unable to create a queue directory");
+            return;
+        }
+
+        {
+            DiskQueue queue(directory);
+            queue.setSyncInterval(1);
+            if (!queue.open()) {
+                state.skip("unable to open the queue");
+                removeQueue(directory);
+                return;
+            }
+            for (int record = 0; record < 5; record++) {
+                std::string payload = "record-" + std::to_string(record);
+                queue.push("planter/environment", reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+            }
+        }
+
+        if (!corruptRecord(directory, "record-2")) {
+            failure = "unable to find the third record on disk";
+        }
+        else {
+            DiskQueue queue(directory);
+            std::string payload = "record-new";
+
+            drained.clear();
+            if (!queue.open() || queue.size() != 2 || queue.discarded() != 1) {
+                failure = "reopened with " + std::to_string(queue.size()) + " records and " +
+                    std::to_string(queue.discarded()) + " discards, expected 2 and 1";
+            }
+            else if (!queue.push("planter/environment", reinterpret_cast<const uint8_t*>(payload.data()), payload.size()) ||
+                     queue.drain(collectOne, 32) != 1 || drained[0] != "record-0") {
+                failure = "the first record after recovery was not record-0";
+            }
+            else {
+                queue.close();
+                drained.clear();
+                // At least once: the rest may start over at record-0 but must not skip anything
+                size_t waiting = queue.open() ? queue.size() : 0;
+                if (waiting < 2 || queue.drain(collect, 32) != waiting ||
+                    drained[waiting - 2] != "record-1" || drained[waiting - 1] != "record-new") {
+                    failure = "a drain interrupted by a reopen lost records";
+                }
+                else {
+                    queue.close();
+                    if (!queue.open() || !queue.empty())
+                        failure = std::to_string(queue.size()) + " records left after draining everything";
+                }
+            }
+        }
+        removeQueue(directory);
+    }
+
+    if (!failure.empty())
+        state.fail(failure);
+}
+
+BENCHMARK("queue/push", queuePushBatched);
+BENCHMARK("queue/push_sync", queuePushSync, 2000);
+BENCHMARK("queue/drain", queueDrain);
+BENCHMARK("queue/recover", queueRecover, 20);
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <ctime>
+
+#include "benchmark.h"
+#include "relaycontroller.h"
+
+/**
+ * A week of the lamp schedule driven the way main() does it, jumping from
+ * one transition to the next against a fake relay board. Each op is a
+ * simulated week, the percentiles are single apply() calls and
+ * writes_per_day is what the board sees; the old loop wrote the relay
+ * every minute, 1440 times a day.
+ */
+static void relayScheduleWeek(BenchState &state)
+{
+    unsigned long writes = 0;
+    unsigned long days = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        RelayController relays;
+        RelaySchedule lamp;
+
+        lamp.addWindow(7 * 60, 20 * 60);
+        relays.setWriteFunction([](int, int, int) { return 0; });
+        relays.setSchedule(7, 1, lamp);
+
+        time_t now = 1767225600 + static_cast<time_t>(i % 365) * 86400;
+        time_t end = now + 7 * 86400;
+        while (now < end) {
+            uint64_t start = benchNowNs();
+            time_t next = relays.apply(now);
+            state.sample(benchNowNs() - start);
+            now = next > now ? next : now + 60;
+        }
+        writes += relays.writes();
+        days += 7;
+    }
+    state.counter("writes_per_day", static_cast<double>(writes) / days);
+}
+
+BENCHMARK("relay/schedule_week", relayScheduleWeek);
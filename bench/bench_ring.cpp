@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <thread>
+
+#include "benchmark.h"
+#include "sensorthread.h"
+#include "spscring.h"
+
+/**
+ * Samples pushed from one thread and popped on another, the handoff between
+ * the sensor thread and the main loop. A full or empty ring yields, the
+ * Omega2 has a single core.
+ */
+static void ringHandoff(BenchState &state)
+{
+    static SensorThread::SampleQueue queue;
+    const uint64_t count = state.iterations();
+    uint64_t fullSpins = 0;
+
+    std::thread producer([&] {
+        SensorSample sample = {};
+        for (uint64_t i = 0; i < count; i++) {
+            sample.timestamp = i;
+            while (!queue.push(sample)) {
+                fullSpins++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    SensorSample sample;
+    uint64_t errors = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        while (!queue.pop(sample))
+            std::this_thread::yield();
+        if (sample.timestamp != i)
+            errors++;
+    }
+    producer.join();
+
+    state.counter("out_of_order", errors);
+    state.counter("full_spins_per_op", static_cast<double>(fullSpins) / count);
+}
+
+BENCHMARK("ring/handoff", ringHandoff);
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "topicrouter.h"
+
+/**
+ * Dispatching one command topic with a fleet's worth of subscriptions in
+ * the router: per device a relay filter with a + level and a config topic,
+ * plus a broadcast filter with #. Going from 10 to 1000 devices should
+ * only add a few sibling comparisons per level. Exactly the relay filter
+ * matches, anything else fails the run.
+ */
+static void routerDispatch(BenchState &state, int devices)
+{
+    TopicRouter router;
+    uint64_t delivered = 0;
+    uint64_t bytes = 0;
+    MessageHandler handler = [&delivered, &bytes](std::string_view, const uint8_t *, size_t size) {
+        delivered++;
+        bytes += size;
+    };
+
+    for (int i = 0; i < devices; i++) {
+        std::string device = "planter/dev" + std::to_string(i);
+        router.add(device + "/relay/+", handler);
+        router.add(device + "/config", handler);
+    }
+    router.add("planter/+/broadcast/#", handler);
+
+    std::string topic = "planter/dev" + std::to_string(devices / 2) + "/relay/1";
+    const uint8_t payload[] = "on";
+    for (uint64_t i = 0; i < state.iterations(); i++)
+        router.dispatch(topic, payload, sizeof(payload) - 1);
+
+    benchKeep(bytes);
+    state.counter("handlers_per_message", static_cast<double>(delivered) / state.iterations());
+    if (delivered != state.iterations())
+        state.fail(std::to_string(delivered) + " deliveries for " + std::to_string(state.iterations()) + " messages, expected one each");
+}
+
+static void routerDispatch10(BenchState &state)
+{
+    routerDispatch(state, 10);
+}
+
+static void routerDispatch1000(BenchState &state)
+{
+    routerDispatch(state, 1000);
+}
+
+/**
+ * The wildcard rules of the MQTT spec, with the filters its examples use:
+ * # also matches its parent level, + matches an empty level, and topics
+ * starting with $ are hidden from filters that begin with a wildcard. Fails
+ * the run as soon as a topic reaches other than the expected handlers, by
+ * dispatch() or by handlers().
+ */
+static void routerWildcards(BenchState &state)
+{
+    static const char *filters[] = {
+        "sport/#", "sport/tennis/+", "sport/+/player1", "sport/tennis/player1/#",
+        "+/+", "+/monitor/Clients", "#", "$SYS/#",
+    };
+    struct Case {
+        const char *topic;
+        size_t matches;
+    };
+    static const Case cases[] = {
+        { "sport", 2 },                         // sport/#, #
+        { "sport/", 3 },                        // sport/#, +/+, #
+        { "sport//player1", 3 },                // sport/#, sport/+/player1, #
+        { "sport/tennis/player1", 5 },          // sport/#, sport/tennis/+, sport/+/player1, sport/tennis/player1/#, #
+        { "sport/tennis/player1/ranking", 3 },  // sport/#, sport/tennis/player1/#, #
+        { "/finance", 2 },                      // +/+, #
+        { "a/monitor/Clients", 2 },             // +/monitor/Clients, #
+        { "$SYS", 1 },                          // $SYS/#
+        { "$SYS/monitor/Clients", 1 },          // $SYS/#
+    };
+    TopicRouter router;
+    uint64_t delivered = 0;
+    uint64_t expected = 0;
+    std::vector<SharedHandler> matched;
+
+    for (const char *filter : filters)
+        router.add(filter, [&delivered](std::string_view, const uint8_t *, size_t) { delivered++; });
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        for (const Case &c : cases) {
+            uint64_t before = delivered;
+            size_t count = router.dispatch(c.topic, nullptr, 0);
+
+            matched.clear();
+            if (count != c.matches || delivered - before != c.matches || router.handlers(c.topic, matched) != c.matches) {
+                state.fail(std::string(c.topic) + " matched " + std::to_string(count) + " filters, expected " +
+                           std::to_string(c.matches));
+                return;
+            }
+            expected += c.matches;
+        }
+    }
+    state.counter("handlers_per_message", static_cast<double>(delivered) / (state.iterations() * (sizeof(cases) / sizeof(cases[0]))));
+    if (delivered != expected)
+        state.fail(std::to_string(delivered) + " deliveries, expected " + std::to_string(expected));
+}
+
+BENCHMARK("router/dispatch_10", routerDispatch10);
+BENCHMARK("router/dispatch_1000", routerDispatch1000);
+BENCHMARK("router/wildcards", routerWildcards);
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "ads1115.h"
+#include "benchmark.h"
+#include "i2cbus.h"
+#include "simi2cbus.h"
+#include "soilsensor.h"
+
+/**
+ * Just enough of an ADS1115 for the benchmarks: 16 bit registers behind a
+ * pointer, single shot conversions that take 1/860s, and a probe reading
+ * 12000 counts with 20 counts of noise and a spike now and then.
+ */
+class SimAds1115 : public SimI2cDevice
+{
+public:
+    SimAds1115() : m_pointer(0), m_config(0x8583), m_ready(0), m_noise(0, 20), m_spike(0, 99) {}
+
+    bool write(const uint8_t *data, size_t length) override
+    {
+        if (length >= 1)
+            m_pointer = data[0];
+        if (length >= 3 && m_pointer == 0x01) {
+            m_config = (data[1] << 8) | data[2];
+            // Single shot with OS set starts a conversion
+            if ((m_config & 0x8100) == 0x8100)
+                m_ready = benchNowNs() + 1000000000ull / Ads1115::SampleRate;
+        }
+        return true;
+    }
+
+    bool read(uint8_t *data, size_t length) override
+    {
+        uint16_t value;
+        if (m_pointer == 0x01)
+            value = (m_config & 0x7fff) | (benchNowNs() >= m_ready ? 0x8000 : 0);
+        else
+            value = static_cast<uint16_t>(sample());
+        for (size_t i = 0; i < length; i++)
+            data[i] = (i & 1) ? (value & 0xff) : (value >> 8);
+        return true;
+    }
+
+private:
+    int16_t sample()
+    {
+        if (m_spike(m_random) == 0)
+            return 32767;
+        return static_cast<int16_t>(lround(12000 + m_noise(m_random)));
+    }
+
+    uint8_t m_pointer;
+    uint16_t m_config;
+    uint64_t m_ready;
+    std::mt19937 m_random;
+    std::normal_distribution<double> m_noise;
+    std::uniform_int_distribution<int> m_spike;
+};
+
+/**
+ * Standard deviation of the values a benchmark produced, in counts
+ */
+static double spread(const std::vector<double> &values)
+{
+    double sum = 0, squares = 0;
+    for (double value : values)
+        sum += value;
+    double mean = sum / values.size();
+    for (double value : values)
+        squares += (value - mean) * (value - mean);
+    return std::sqrt(squares / values.size());
+}
+
+/**
+ * A soil probe read the way SoilSensor does it: a 32 conversion burst in
+ * continuous mode through the median and moving average filters
+ */
+static void soilReadBurst(BenchState &state)
+{
+    SimI2cBus bus(400000);
+    SimAds1115 adc;
+    bus.attach(0x48, &adc);
+    I2cScheduler i2c(bus);
+    Ads1115 ads(i2c);
+    SoilSensor probe(ads, 0, SoilCalibration{ 17000, 8000 });
+    std::vector<double> values;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        probe.read();
+        values.push_back(probe.raw());
+    }
+    state.counter("transactions_per_read", static_cast<double>(ads.transactions()) / state.iterations());
+    state.counter("stddev_counts", spread(values));
+}
+
+/**
+ * The naive alternative: one single shot conversion per read, started
+ * with a config write, polled for completion, then fetched
+ */
+static void soilReadSingle(BenchState &state)
+{
+    SimI2cBus bus(400000);
+    SimAds1115 adc;
+    bus.attach(0x48, &adc);
+    I2cScheduler i2c(bus);
+    std::vector<double> values;
+    uint64_t transactions = 0;
+
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        std::vector<I2cMessage> start = { I2cMessage::send({ 0x01, 0xc3, 0xe3 }) };
+        i2c.transfer(0x48, start);
+        transactions++;
+
+        uint8_t config[2] = { 0, 0 };
+        while (!(config[0] & 0x80)) {
+            std::vector<I2cMessage> poll = { I2cMessage::send({ 0x01 }), I2cMessage::receive(2) };
+            i2c.transfer(0x48, poll);
+            transactions++;
+            config[0] = poll[1].data[0];
+        }
+
+        std::vector<I2cMessage> fetch = { I2cMessage::send({ 0x00 }), I2cMessage::receive(2) };
+        i2c.transfer(0x48, fetch);
+        transactions++;
+        values.push_back(static_cast<int16_t>((fetch[1].data[0] << 8) | fetch[1].data[1]));
+    }
+    state.counter("transactions_per_read", static_cast<double>(transactions) / state.iterations());
+    state.counter("stddev_counts", spread(values));
+}
+
+/**
+ * The filter alone on a 64 sample burst
+ */
+static void soilFilter(BenchState &state)
+{
+    std::mt19937 random;
+    std::normal_distribution<double> noise(0, 20);
+    int16_t samples[SoilFilter::MaxBurst];
+    SoilFilter filter;
+
+    for (size_t i = 0; i < SoilFilter::MaxBurst; i++)
+        samples[i] = static_cast<int16_t>(lround(12000 + noise(random)));
+
+    for (uint64_t i = 0; i < state.iterations(); i++)
+        benchKeep(filter.update(samples, SoilFilter::MaxBurst));
+}
+
+BENCHMARK("soil/read_burst", soilReadBurst, 100);
+BENCHMARK("soil/read_single", soilReadSingle, 1000);
+BENCHMARK("soil/filter_64", soilFilter);
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "benchmark.h"
+
+namespace {
+
+struct BenchEntry {
+    std::string name;
+    BenchFunction fn;
+    uint64_t fixedIterations;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double realNsPerOp;
+    double cpuNsPerOp;
+    uint64_t minNs;
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint64_t maxNs;
+    std::vector<std::pair<std::string, double>> counters;
+    std::string skipped;
+    std::string failed;
+};
+
+std::vector<BenchEntry> &registry()
+{
+    static std::vector<BenchEntry> entries;
+    return entries;
+}
+
+uint64_t cpuNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t percentile(std::vector<uint64_t> &sorted, double pct)
+{
+    if (sorted.empty())
+        return 0;
+
+    size_t index = static_cast<size_t>(pct * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+BenchResult runOne(const BenchEntry &entry, const BenchOptions &options)
+{
+    BenchResult result;
+    uint64_t iterations = entry.fixedIterations ? entry.fixedIterations : 1;
+    uint64_t minNs = static_cast<uint64_t>(options.minTime * 1e9);
+
+    result.name = entry.name;
+    while (true) {
+        BenchState state(options, iterations);
+        uint64_t wallStart = benchNowNs();
+        uint64_t cpuStart = cpuNowNs();
+        entry.fn(state);
+        uint64_t wall = benchNowNs() - wallStart;
+        uint64_t cpu = cpuNowNs() - cpuStart;
+
+        if (!state.skipped().empty()) {
+            result.iterations = 0;
+            result.realNsPerOp = result.cpuNsPerOp = 0;
+            result.minNs = result.p50Ns = result.p99Ns = result.maxNs = 0;
+            result.skipped = state.skipped();
+            return result;
+        }
+
+        if (entry.fixedIterations || wall >= minNs || iterations >= (1ull << 34)) {
+            std::vector<uint64_t> samples = state.samples();
+            std::sort(samples.begin(), samples.end());
+
+            result.iterations = iterations;
+            result.realNsPerOp = static_cast<double>(wall) / iterations;
+            result.cpuNsPerOp = static_cast<double>(cpu) / iterations;
+            result.minNs = samples.empty() ? 0 : samples.front();
+            result.p50Ns = percentile(samples, 0.50);
+            result.p99Ns = percentile(samples, 0.99);
+            result.maxNs = samples.empty() ? 0 : samples.back();
+            result.counters = state.counters();
+            result.failed = state.failed();
+            return result;
+        }
+
+        // Aim a little past the minimum time, never grow more than 100x per round
+        double scale = wall ? (minNs * 1.4) / wall : 100.0;
+        scale = std::max(2.0, std::min(100.0, scale));
+        iterations = static_cast<uint64_t>(iterations * scale);
+    }
+}
+
+std::string jsonEscape(const std::string &value)
+{
+    std::string escaped;
+
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeTable(std::ostream &os, const std::vector<BenchResult> &results)
+{
+    os << std::left << std::setw(32) << "benchmark" << std::right
+       << std::setw(12) << "iterations" << std::setw(16) << "real ns/op"
+       << std::setw(16) << "cpu ns/op" << std::setw(12) << "p50 ns"
+       << std::setw(12) << "p99 ns" << std::setw(12) << "max ns" << std::endl;
+
+    for (const auto &r : results) {
+        os << std::left << std::setw(32) << r.name << std::right;
+        if (!r.skipped.empty()) {
+            os << "  skipped: " << r.skipped << std::endl;
+            continue;
+        }
+        os << std::setw(12) << r.iterations << std::fixed << std::setprecision(1)
+           << std::setw(16) << r.realNsPerOp << std::setw(16) << r.cpuNsPerOp
+           << std::setw(12) << r.p50Ns << std::setw(12) << r.p99Ns
+           << std::setw(12) << r.maxNs;
+        for (const auto &c : r.counters)
+            os << "  " << c.first << "=" << c.second;
+        if (!r.failed.empty())
+            os << "  FAILED: " << r.failed;
+        os << std::endl;
+    }
+}
+
+void writeCsv(std::ostream &os, const std::vector<BenchResult> &results)
+{
+    os << "name,iterations,real_ns_per_op,cpu_ns_per_op,min_ns,p50_ns,p99_ns,max_ns,counters,skipped,failed" << std::endl;
+    for (const auto &r : results) {
+        os << r.name << "," << r.iterations << "," << std::fixed << std::setprecision(3)
+           << r.realNsPerOp << "," << r.cpuNsPerOp << "," << r.minNs << ","
+           << r.p50Ns << "," << r.p99Ns << "," << r.maxNs << ",";
+        for (size_t i = 0; i < r.counters.size(); i++)
+            os << (i ? ";" : "") << r.counters[i].first << "=" << r.counters[i].second;
+        os << "," << r.skipped << "," << r.failed << std::endl;
+    }
+}
+
+void writeJson(std::ostream &os, const std::vector<BenchResult> &results)
+{
+    char host[64] = "unknown";
+    char date[32] = "";
+    time_t now = time(nullptr);
+
+    gethostname(host, sizeof(host) - 1);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    os << "{" << std::endl;
+    os << "  \"context\": {" << std::endl;
+    os << "    \"date\": \"" << date << "\"," << std::endl;
+    os << "    \"host\": \"" << jsonEscape(host) << "\"," << std::endl;
+    os << "    \"compiler\": \"" << jsonEscape(__VERSION__) << "\"," << std::endl;
+    os << "    \"built\": \"" << __DATE__ << " " << __TIME__ << "\"" << std::endl;
+    os << "  }," << std::endl;
+    os << "  \"benchmarks\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+
+        os << "    {\"name\": \"" << jsonEscape(r.name) << "\"";
+        if (!r.skipped.empty()) {
+            os << ", \"skipped\": \"" << jsonEscape(r.skipped) << "\"}";
+        }
+        else {
+            os << ", \"iterations\": " << r.iterations << std::fixed << std::setprecision(3)
+               << ", \"real_ns_per_op\": " << r.realNsPerOp
+               << ", \"cpu_ns_per_op\": " << r.cpuNsPerOp
+               << ", \"min_ns\": " << r.minNs << ", \"p50_ns\": " << r.p50Ns
+               << ", \"p99_ns\": " << r.p99Ns << ", \"max_ns\": " << r.maxNs;
+            for (const auto &c : r.counters)
+                os << ", \"" << jsonEscape(c.first) << "\": " << c.second;
+            if (!r.failed.empty())
+                os << ", \"failed\": \"" << jsonEscape(r.failed) << "\"";
+            os << "}";
+        }
+        os << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    os << "  ]" << std::endl;
+    os << "}" << std::endl;
+}
+
+} // namespace
+
+BenchState::BenchState(const BenchOptions &options, uint64_t iterations) :
+    m_options(options), m_iterations(iterations)
+{
+}
+
+void BenchState::counter(const std::string &name, double value)
+{
+    for (auto &c : m_counters) {
+        if (c.first == name) {
+            c.second = value;
+            return;
+        }
+    }
+    m_counters.emplace_back(name, value);
+}
+
+BenchRegistration::BenchRegistration(const char *name, BenchFunction fn, uint64_t fixedIterations)
+{
+    registry().push_back({name, fn, fixedIterations});
+}
+
+uint64_t benchNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * \func int runBenchmarks(const BenchOptions &options)
+ * \param options Parsed command line
+ * 
+ * Runs every registered benchmark whose name contains options.filter and writes
+ * the results as a table, CSV or JSON to stdout or options.output.
+ * \return 1 if the output couldn't be written or a benchmark failed
+ */
+int runBenchmarks(const BenchOptions &options)
+{
+    std::vector<BenchResult> results;
+    std::vector<BenchEntry> entries = registry();
+    int failed = 0;
+
+    std::sort(entries.begin(), entries.end(), [](const BenchEntry &a, const BenchEntry &b) { return a.name < b.name; });
+    for (const auto &entry : entries) {
+        if (!options.filter.empty() && entry.name.find(options.filter) == std::string::npos)
+            continue;
+
+        std::cerr << "Running " << entry.name << std::endl;
+        results.push_back(runOne(entry, options));
+        if (!results.back().failed.empty()) {
+            std::cerr << entry.name << " FAILED: " << results.back().failed << std::endl;
+            failed++;
+        }
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << __FUNCTION__ << ": Unable to open " << options.output << " for writing" << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &os = options.output.empty() ? std::cout : file;
+
+    if (options.format == "json")
+        writeJson(os, results);
+    else if (options.format == "csv")
+        writeCsv(os, results);
+    else
+        writeTable(os, results);
+
+    return failed ? 1 : 0;
+}
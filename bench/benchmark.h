@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Options shared by every benchmark, filled in from the command line
+ */
+struct BenchOptions {
+    std::string filter;
+    std::string format;
+    std::string output;
+    std::string broker;
+    int port;
+    std::string gpioChip;
+    int gpioLine;
+    double minTime;
+    bool hardware;
+};
+
+/**
+ * Handed to a benchmark body. The body must run its operation iterations()
+ * times, the runner takes care of wall and CPU time around the call. Bodies
+ * that care about the latency distribution call sample() once per operation.
+ * A body that checks an invariant calls fail(), which makes the whole run
+ * exit non-zero.
+ */
+class BenchState
+{
+public:
+    BenchState(const BenchOptions &options, uint64_t iterations);
+
+    uint64_t iterations() const { return m_iterations; }
+    const BenchOptions &options() const { return m_options; }
+
+    void sample(uint64_t ns) { m_samples.push_back(ns); }
+    void counter(const std::string &name, double value);
+    void skip(const std::string &reason) { m_skipped = reason; }
+    void fail(const std::string &reason) { m_failed = reason; }
+
+    const std::vector<uint64_t> &samples() const { return m_samples; }
+    const std::vector<std::pair<std::string, double>> &counters() const { return m_counters; }
+    const std::string &skipped() const { return m_skipped; }
+    const std::string &failed() const { return m_failed; }
+
+private:
+    const BenchOptions &m_options;
+    uint64_t m_iterations;
+    std::vector<uint64_t> m_samples;
+    std::vector<std::pair<std::string, double>> m_counters;
+    std::string m_skipped;
+    std::string m_failed;
+};
+
+typedef std::function<void(BenchState&)> BenchFunction;
+
+/**
+ * Static registration, one per benchmark. fixedIterations of 0 lets the
+ * runner grow the count until the run takes at least --min-time.
+ */
+struct BenchRegistration {
+    BenchRegistration(const char *name, BenchFunction fn, uint64_t fixedIterations = 0);
+};
+
+#define BENCHMARK_CONCAT2(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+#define BENCHMARK(name, fn, ...) \
+    static BenchRegistration BENCHMARK_CONCAT(s_bench_, __LINE__)(name, fn, ##__VA_ARGS__)
+
+int runBenchmarks(const BenchOptions &options);
+
+uint64_t benchNowNs();
+
+/**
+ * Keep the compiler from discarding a value computed only for timing
+ */
+template <typename T> inline void benchKeep(T const &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif // BENCHMARK_H
@@ -18,30 +18,108 @@
 // LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
+#include <alloca.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sched.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <time.h>
 
 #include "common_dht_read.h"
 
 void busy_wait_milliseconds(uint32_t millis) {
-  // Set delay time period.
-  struct timeval deltatime;
-  deltatime.tv_sec = millis / 1000;
-  deltatime.tv_usec = (millis % 1000) * 1000;
-  struct timeval walltime;
-  // Get current time and add delay to find end time.
-  gettimeofday(&walltime, NULL);
-  struct timeval endtime;
-  timeradd(&walltime, &deltatime, &endtime);
-  // Tight loop to waste time (and CPU) until enough time as elapsed.
-  while (timercmp(&walltime, &endtime, <)) {
-    gettimeofday(&walltime, NULL);
+  // Tight loop to waste time (and CPU) until enough time as elapsed.  The monotonic clock does
+  // not jump when the wall clock is set.
+  uint64_t endtime = monotonic_ns() + millis * 1000000ull;
+  while (monotonic_ns() < endtime) {
   }
 }
 
+// Short absolute sleeps timed to find the timer slack, and the bounds on the resulting slice.
+#define DELAY_CALIBRATION_ROUNDS 16
+#define DELAY_CALIBRATION_SLEEP_NS 200000
+#define DELAY_MIN_SPIN_NS 20000
+#define DELAY_MAX_SPIN_NS 2000000
+
+// Set once by delay_calibrate(), read by every delay.
+static uint64_t spin_slice_ns = 0;
+static uint64_t clock_read_ns = 0;
+
+static void sleep_until_ns(uint64_t deadline_ns) {
+  struct timespec deadline;
+  deadline.tv_sec = deadline_ns / 1000000000ull;
+  deadline.tv_nsec = deadline_ns % 1000000000ull;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+static int compare_uint64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+void delay_calibrate(void) {
+  // Ask for the least timer slack the kernel gives a normal thread.  Threads created after this
+  // inherit it; at real-time priority there is no slack at all.
+  prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+  // Cost of reading the clock, the resolution the spin can hit its deadline with.
+  uint64_t start = monotonic_ns();
+  int i = 0;
+  for (i; i < 64; ++i) {
+    monotonic_ns();
+  }
+  clock_read_ns = (monotonic_ns() - start) / 65;
+
+  // How late short absolute sleeps wake up.  Take a high percentile rather than the worst, one
+  // preemption during calibration should not make every delay spin for milliseconds.
+  uint64_t late[DELAY_CALIBRATION_ROUNDS];
+  for (i = 0; i < DELAY_CALIBRATION_ROUNDS; ++i) {
+    uint64_t target = monotonic_ns() + DELAY_CALIBRATION_SLEEP_NS;
+    sleep_until_ns(target);
+    late[i] = monotonic_ns() - target;
+  }
+  qsort(late, DELAY_CALIBRATION_ROUNDS, sizeof(late[0]), compare_uint64);
+  uint64_t slice = late[DELAY_CALIBRATION_ROUNDS - 2];
+  slice += slice / 4 + clock_read_ns;
+  if (slice < DELAY_MIN_SPIN_NS) {
+    slice = DELAY_MIN_SPIN_NS;
+  }
+  if (slice > DELAY_MAX_SPIN_NS) {
+    slice = DELAY_MAX_SPIN_NS;
+  }
+  spin_slice_ns = slice;
+}
+
+uint64_t delay_spin_ns(void) {
+  return spin_slice_ns;
+}
+
+uint64_t delay_clock_ns(void) {
+  return clock_read_ns;
+}
+
+void delay_until_ns(uint64_t deadline_ns) {
+  if (spin_slice_ns == 0) {
+    delay_calibrate();
+  }
+  // Sleep through the bulk of the interval, waking a spin slice early.
+  uint64_t now = monotonic_ns();
+  if (deadline_ns > now + spin_slice_ns) {
+    sleep_until_ns(deadline_ns - spin_slice_ns);
+  }
+  // Spin the rest.  Stop half a clock read early so the average exit lands on the deadline.
+  while (monotonic_ns() + clock_read_ns / 2 < deadline_ns) {
+  }
+}
+
+void delay_microseconds(uint32_t micros) {
+  delay_until_ns(monotonic_ns() + micros * 1000ull);
+}
+
 void sleep_milliseconds(uint32_t millis) {
   struct timespec sleep;
   sleep.tv_sec = millis / 1000;
@@ -49,18 +127,177 @@ void sleep_milliseconds(uint32_t millis) {
   while (clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep, &sleep) && errno == EINTR);
 }
 
-void set_max_priority(void) {
+// Profile applied by set_max_priority().
+static rt_profile profile = {
+  0,      // priority, just below the watchdog
+  -1,     // cpu, not pinned
+  1,      // lock_memory
+  16384,  // stack_prefault
+  100     // max_rt_ms, the start signal and a frame with plenty to spare
+};
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The watchdog waits for a thread to go real-time and demotes it once its deadline passes.
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond;
+static pthread_t watchdog_thread;
+static int watchdog_started = 0;
+static int watchdog_armed = 0;
+static pthread_t watchdog_target;
+static uint64_t watchdog_deadline_ns = 0;
+static uint32_t watchdog_expired = 0;
+
+// The CPUs the thread could run on before it was pinned for the capture.
+static thread_local cpu_set_t saved_cpus;
+static thread_local int saved_cpus_valid = 0;
+
+static void set_thread_default(pthread_t thread) {
+  struct sched_param sched;
+  memset(&sched, 0, sizeof(sched));
+  // Go back to default scheduler with default 0 priority.
+  sched.sched_priority = 0;
+  pthread_setschedparam(thread, SCHED_OTHER, &sched);
+}
+
+static void* watchdog_main(void* arg) {
+  (void)arg;
+  pthread_mutex_lock(&watchdog_lock);
+  for (;;) {
+    if (!watchdog_armed) {
+      pthread_cond_wait(&watchdog_cond, &watchdog_lock);
+      continue;
+    }
+    uint64_t now = monotonic_ns();
+    if (now >= watchdog_deadline_ns) {
+      // Still real-time past its budget, take the CPU back.
+      set_thread_default(watchdog_target);
+      watchdog_armed = 0;
+      watchdog_expired++;
+      continue;
+    }
+    struct timespec deadline;
+    deadline.tv_sec = watchdog_deadline_ns / 1000000000ull;
+    deadline.tv_nsec = watchdog_deadline_ns % 1000000000ull;
+    pthread_cond_timedwait(&watchdog_cond, &watchdog_lock, &deadline);
+  }
+  return NULL;
+}
+
+// Start the watchdog at the top SCHED_FIFO priority, so it can preempt a capture even on a
+// single core.  Called with watchdog_lock held.
+static int start_watchdog(void) {
+  pthread_condattr_t condattr;
+  pthread_condattr_init(&condattr);
+  pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&watchdog_cond, &condattr);
+  pthread_condattr_destroy(&condattr);
+
+  pthread_attr_t attr;
   struct sched_param sched;
   memset(&sched, 0, sizeof(sched));
-  // Use FIFO scheduler with highest priority for the lowest chance of the kernel context switching.
   sched.sched_priority = sched_get_priority_max(SCHED_FIFO);
-  sched_setscheduler(0, SCHED_FIFO, &sched);
+  pthread_attr_init(&attr);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  pthread_attr_setschedparam(&attr, &sched);
+  int rc = pthread_create(&watchdog_thread, &attr, watchdog_main, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    // Without permission for real-time threads the capture will not be real-time either, a
+    // normal watchdog still catches a capture that ran long.
+    rc = pthread_create(&watchdog_thread, NULL, watchdog_main, NULL);
+  }
+  if (rc == 0) {
+    pthread_detach(watchdog_thread);
+    watchdog_started = 1;
+  }
+  return watchdog_started;
 }
 
-void set_default_priority(void) {
+// Touch the stack below the caller so the capture that follows cannot take a page fault on it.
+__attribute__((noinline)) static void prefault_stack(uint32_t bytes) {
+  volatile unsigned char* stack = (volatile unsigned char*)alloca(bytes);
+  uint32_t i = 0;
+  for (i; i < bytes; i += 256) {
+    stack[i] = 0;
+  }
+}
+
+void set_rt_profile(const rt_profile* newProfile) {
+  pthread_mutex_lock(&profile_lock);
+  profile = *newProfile;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+void get_rt_profile(rt_profile* current) {
+  pthread_mutex_lock(&profile_lock);
+  *current = profile;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+uint32_t rt_watchdog_expired(void) {
+  pthread_mutex_lock(&watchdog_lock);
+  uint32_t expired = watchdog_expired;
+  pthread_mutex_unlock(&watchdog_lock);
+  return expired;
+}
+
+void set_max_priority(void) {
+  static int memory_locked = 0;
+  rt_profile current;
+  get_rt_profile(&current);
+
+  // Page faults in the middle of a capture stretch pulses just like preemption does.
+  if (current.lock_memory && !__atomic_exchange_n(&memory_locked, 1, __ATOMIC_RELAXED)) {
+    mlockall(MCL_CURRENT | MCL_FUTURE);
+  }
+  if (current.stack_prefault) {
+    prefault_stack(current.stack_prefault);
+  }
+
+  // Pin the thread so it cannot migrate mid-capture, remembering where it was allowed to run.
+  saved_cpus_valid = 0;
+  if (current.cpu >= 0) {
+    if (sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus) == 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(current.cpu, &cpus);
+      saved_cpus_valid = sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+    }
+  }
+
+  // Arm the watchdog before going real-time, it has to be able to run to stop us.
+  if (current.max_rt_ms) {
+    pthread_mutex_lock(&watchdog_lock);
+    if (watchdog_started || start_watchdog()) {
+      watchdog_target = pthread_self();
+      watchdog_deadline_ns = monotonic_ns() + current.max_rt_ms * 1000000ull;
+      watchdog_armed = 1;
+      pthread_cond_signal(&watchdog_cond);
+    }
+    pthread_mutex_unlock(&watchdog_lock);
+  }
+
   struct sched_param sched;
   memset(&sched, 0, sizeof(sched));
-  // Go back to default scheduler with default 0 priority.
-  sched.sched_priority = 0;
-  sched_setscheduler(0, SCHED_OTHER, &sched);
+  // Use FIFO scheduler with high priority for the lowest chance of the kernel context switching.
+  // The top priority is left to the watchdog.
+  sched.sched_priority = current.priority ? current.priority : sched_get_priority_max(SCHED_FIFO) - 1;
+  sched_setscheduler(0, SCHED_FIFO, &sched);
+}
+
+void set_default_priority(void) {
+  // Disarm first, the watchdog must not demote whatever this thread runs next.
+  pthread_mutex_lock(&watchdog_lock);
+  if (watchdog_armed && pthread_equal(watchdog_target, pthread_self())) {
+    watchdog_armed = 0;
+  }
+  pthread_mutex_unlock(&watchdog_lock);
+
+  set_thread_default(pthread_self());
+
+  if (saved_cpus_valid) {
+    sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+    saved_cpus_valid = 0;
+  }
 }
@@ -22,12 +22,14 @@
 #define COMMON_DHT_READ_H
 
 #include <stdint.h>
+#include <time.h>
 
 // Define errors and return values.
 #define DHT_ERROR_TIMEOUT -1
 #define DHT_ERROR_CHECKSUM -2
 #define DHT_ERROR_ARGUMENT -3
 #define DHT_ERROR_GPIO -4
+#define DHT_ERROR_BUSY -5
 #define DHT_SUCCESS 0
 
 // Define sensor types.
@@ -35,17 +37,59 @@
 #define DHT22 22
 #define AM2302 22
 
+// Monotonic, high resolution time in nanoseconds.  Not affected by wall clock adjustments.
+static inline uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
 // Busy wait delay for most accurate timing, but high CPU usage.
 // Only use this for short periods of time (a few hundred milliseconds at most)!
 void busy_wait_milliseconds(uint32_t millis);
 
+// Precise delays that sleep on the monotonic clock for the bulk of the interval and only spin
+// for the final slice, sized to cover the timer slack the kernel actually shows.  Call
+// delay_calibrate() once at startup, before creating threads, otherwise the first delay does.
+void delay_calibrate(void);
+
+// Length of the spun final slice and the cost of one clock read, both in nanoseconds and 0
+// until the calibration has run.
+uint64_t delay_spin_ns(void);
+uint64_t delay_clock_ns(void);
+
+// Return at monotonic time deadline_ns, or right away if it has passed.
+void delay_until_ns(uint64_t deadline_ns);
+
+// Delay for the given number of microseconds.  Delays shorter than the spin slice never sleep.
+void delay_microseconds(uint32_t micros);
+
 // General delay that sleeps so CPU usage is low, but accuracy is potentially bad.
 void sleep_milliseconds(uint32_t millis);
 
-// Increase scheduling priority and algorithm to try to get 'real time' results.
+// How the capturing thread runs while it is real-time.
+typedef struct {
+  int priority;             // SCHED_FIFO priority, 0 for one below the maximum (the watchdog's)
+  int cpu;                  // CPU the thread is pinned to while real-time, -1 to leave it be
+  int lock_memory;          // lock all current and future pages in memory before the first capture
+  uint32_t stack_prefault;  // bytes of stack touched before each capture so it cannot fault
+  uint32_t max_rt_ms;       // longest the thread may stay real-time, 0 for no watchdog
+} rt_profile;
+
+// Replace or read the profile set_max_priority() applies.  The default raises the priority,
+// locks memory, prefaults 16KB of stack and gives up real-time after 100ms.
+void set_rt_profile(const rt_profile* profile);
+void get_rt_profile(rt_profile* profile);
+
+// Number of times the watchdog had to drop a thread out of real-time.
+uint32_t rt_watchdog_expired(void);
+
+// Increase scheduling priority and algorithm to try to get 'real time' results, as described by
+// the current rt_profile.  With max_rt_ms set, a watchdog thread running above the capture
+// drops the caller back to normal scheduling if it stays real-time too long.
 void set_max_priority(void);
 
-// Drop scheduling priority back to normal/default.
+// Drop scheduling priority back to normal/default, undoing the profile's CPU pinning.
 void set_default_priority(void);
 
 #endif
@@ -0,0 +1,228 @@
+// Copyright (c) 2014 Adafruit Industries
+// Author: Tony DiCola
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef DHT_CAPTURE_H
+#define DHT_CAPTURE_H
+
+#include <string.h>
+
+#include "dht_line.h"
+#include "dht_read.h"
+#include "fastgpiopin.h"
+
+// Time the line is given to rise after the start signal is released.
+#define DHT_RELEASE_US 2
+
+// Real-time part of a DHT read: send the start signal through gpio and record every change
+// of the sampled bits into trace.  Gpio is one of the accessors from fastgpiopin.h, so each
+// pass of the loop is one register load, a compare and, on a change, one store.  Nothing is
+// interpreted here; the trace is decoded after the priority has been dropped again.  The
+// capture ends when the lines have been quiet for a pulse timeout after the last edge (the
+// acknowledge timeout before the first one) or after the frame timeout.  The trace's pins
+// name the lines, whose idle state carries over from one capture to the next.
+template <class Gpio>
+void dht_capture(const Gpio& gpio, const dht_timing* timing, dht_trace* trace) {
+  const uint64_t ackTimeout = timing->ack_timeout_us * 1000ull;
+  const uint64_t idleTimeout = timing->pulse_timeout_us * 1000ull;
+  const uint64_t frameTimeout = timing->frame_timeout_us * 1000ull;
+
+  // Skip the idle preamble when every line has provably been idle high long enough: it is
+  // high right now and has been since the end of the last capture that left it high.
+  const uint64_t settle = DHT_LINE_SETTLE_MS * 1000000ull;
+  uint64_t settleWait = 0;
+  if ((uint32_t)gpio.Read() != trace->mask)
+  {
+    settleWait = settle;
+  }
+  else
+  {
+    uint64_t now = monotonic_ns();
+    int bit = 0;
+    for (bit; bit < 32; ++bit) {
+      if (trace->mask & (1u << bit))
+      {
+        uint64_t idle = dht_line_idle_ns(trace->pins[bit], now);
+        if (idle < settle && settle - idle > settleWait)
+        {
+          settleWait = settle - idle;
+        }
+      }
+    }
+  }
+
+  // Set pin high, then to output, so the line never glitches low.
+  //pi_mmio_set_output(pin);
+  //pi_mmio_set_high(pin);
+  gpio.Set(1);
+  gpio.SetDirection(1);
+  if (settleWait)
+  {
+    sleep_milliseconds((uint32_t)((settleWait + 999999) / 1000000));
+  }
+
+  // Bump up process priority and change scheduler to try to try to make process more 'real time'.
+  set_max_priority();
+
+  // The next calls are timing critical and care should be taken
+  // to ensure no unnecssary work is done below.
+
+  // Set pin low for the sensor's start time.  The delay sleeps for most of it, at real-time
+  // priority that yields the CPU instead of starving everything else.
+  //pi_mmio_set_low(pin);
+  gpio.Set(0);
+  delay_microseconds(timing->start_ms * 1000);
+
+  // Set pin at input.
+  //pi_mmio_set_input(pin);
+  gpio.SetDirection(0);
+  // Give the pull-up a moment to bring the line back high before sampling.  The sensor answers
+  // 20-40us after release, well after this.
+  delay_microseconds(DHT_RELEASE_US);
+
+  uint64_t start = monotonic_ns();
+  uint64_t last = start;
+  uint64_t now = start;
+  uint64_t sampled = start;
+  uint64_t maxGap = 0;
+  uint32_t previous = gpio.Read();
+  uint32_t head = 0;
+
+  trace->start_ns = start;
+  trace->idle = previous;
+  for (;;)
+  {
+    uint32_t levels = gpio.Read();
+    now = monotonic_ns();
+    // An edge can only be timed as precisely as the lines are sampled, keep the worst gap.
+    if (now - sampled > maxGap)
+    {
+      maxGap = now - sampled;
+    }
+    sampled = now;
+    if (levels != previous)
+    {
+      dht_edge* edge = &trace->edges[head++ & (DHT_TRACE_EDGES-1)];
+      edge->time_ns = (uint32_t)(now - start);
+      edge->levels = levels;
+      previous = levels;
+      last = now;
+    }
+    else if (now - last >= (head ? idleTimeout : ackTimeout))
+    {
+      break;
+    }
+    if (now - start >= frameTimeout)
+    {
+      break;
+    }
+  }
+  trace->head = head;
+  trace->end_ns = (uint32_t)(now - start);
+  trace->max_gap_ns = (uint32_t)maxGap;
+
+  // Done with timing critical code, drop back to normal priority.
+  set_default_priority();
+
+  // Lines the sensors released high are idle from here on, the rest are unknown.  When
+  // every line came back high they are held high until the next read.
+  {
+    int bit = 0;
+    for (bit; bit < 32; ++bit) {
+      if (trace->mask & (1u << bit))
+      {
+        if (previous & (1u << bit))
+        {
+          dht_line_set_idle(trace->pins[bit], now);
+        }
+        else
+        {
+          dht_line_invalidate(trace->pins[bit]);
+        }
+      }
+    }
+  }
+  if (previous == trace->mask)
+  {
+    gpio.Set(1);
+    gpio.SetDirection(1);
+  }
+}
+
+template <int Pin>
+int dht_read(int type, dht_reading* reading) {
+  // Validate the reading argument and mark it as not read.
+  if (reading == NULL)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+  memset(reading, 0, sizeof(*reading));
+  reading->temperature = -255.0f;
+  reading->humidity = -255.0f;
+
+  const dht_timing* timing = dht_get_timing(type);
+  if (timing == NULL)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+
+  FastGpioOmega2	gpioObj;
+  if (!gpioObj.IsReady())
+  {
+    return DHT_ERROR_GPIO;
+  }
+
+  // The pin reads back as bit 0 of the samples.
+  dht_trace* trace = dht_thread_trace();
+  dht_trace_reset(trace, type, 0x1);
+  trace->pins[0] = Pin;
+
+  if (gpioObj.GetBackend() != NULL)
+  {
+    dht_capture(FastGpioPin<Pin, GpioBackendAccess>(GpioBackendAccess(gpioObj.GetBackend())), timing, trace);
+  }
+  else
+  {
+    dht_capture(FastGpioPin<Pin>(GpioMmioAccess(gpioObj.GetRegisterAddress())), timing, trace);
+  }
+
+  int result = dht_decode_trace(trace, 0, reading);
+  if (result != DHT_SUCCESS)
+  {
+    dht_trace_save_failure(trace);
+  }
+  return result;
+}
+
+template <int Pin>
+int dht_read(int type, float* humidity, float* temperature) {
+  // Validate humidity and temperature arguments.
+  if (humidity == NULL || temperature == NULL)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+
+  dht_reading reading;
+  int result = dht_read<Pin>(type, &reading);
+  *humidity = reading.humidity;
+  *temperature = reading.temperature;
+  return result;
+}
+
+#endif
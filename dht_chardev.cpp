@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "dht_chardev.h"
+#include "dht_line.h"
+
+int dht_capture_events(FastGpioChardev* gpio, int pin, const dht_timing* timing, dht_trace* trace) {
+  const uint64_t ackTimeout = timing->ack_timeout_us * 1000ull;
+  const uint64_t idleTimeout = timing->pulse_timeout_us * 1000ull;
+  const uint64_t frameTimeout = timing->frame_timeout_us * 1000ull;
+
+  // Same idle rule as the polled capture: skip the preamble once the line is known idle.
+  const uint64_t settle = DHT_LINE_SETTLE_MS * 1000000ull;
+  uint64_t settleWait = settle;
+  int level = 0;
+  if (gpio->Read(pin, level) != EXIT_SUCCESS)
+  {
+    return DHT_ERROR_GPIO;
+  }
+  if (level)
+  {
+    uint64_t idle = dht_line_idle_ns(pin, monotonic_ns());
+    settleWait = idle < settle ? settle - idle : 0;
+  }
+
+  // Line high, then output, then hold it.
+  if (gpio->Set(pin, 1) != EXIT_SUCCESS || gpio->SetDirection(pin, 1) != EXIT_SUCCESS)
+  {
+    return DHT_ERROR_GPIO;
+  }
+  if (settleWait)
+  {
+    sleep_milliseconds((uint32_t)((settleWait + 999999) / 1000000));
+  }
+
+  // The start signal.  Its length is not critical, the delay sleeps through most of it.
+  gpio->Set(pin, 0);
+  delay_microseconds(timing->start_ms * 1000);
+
+  // Release the line and let the kernel timestamp every edge from here on.
+  uint64_t start = monotonic_ns();
+  if (gpio->WatchEdges(pin) != EXIT_SUCCESS)
+  {
+    return DHT_ERROR_GPIO;
+  }
+  trace->start_ns = start;
+  trace->idle = 0x1;
+
+  GpioEdgeEvent events[32];
+  uint64_t last = start;
+  uint64_t now = start;
+  uint32_t head = 0;
+  for (;;)
+  {
+    // Wait for the next edges, but no longer than the idle or frame timeout allows.
+    uint64_t deadline = last + (head ? idleTimeout : ackTimeout);
+    if (deadline > start + frameTimeout)
+    {
+      deadline = start + frameTimeout;
+    }
+    now = monotonic_ns();
+    if (now >= deadline)
+    {
+      break;
+    }
+    int count = gpio->ReadEdges(pin, events, 32, deadline - now);
+    if (count <= 0)
+    {
+      break;
+    }
+
+    int i = 0;
+    for (i; i < count; ++i) {
+      // An edge the kernel saw while the line was being switched over belongs to the release.
+      if (events[i].timestampNs < start)
+      {
+        continue;
+      }
+      dht_edge* edge = &trace->edges[head++ & (DHT_TRACE_EDGES-1)];
+      edge->time_ns = (uint32_t)(events[i].timestampNs - start);
+      edge->levels = events[i].level ? 0x1 : 0x0;
+      last = events[i].timestampNs;
+      level = events[i].level;
+    }
+  }
+  trace->head = head;
+  trace->end_ns = (uint32_t)(monotonic_ns() - start);
+  // No sampling loop, the kernel stamps edges in the interrupt handler.
+  trace->max_gap_ns = 0;
+
+  // A sensor that let go of the line leaves it idle, hold it high until the next read.
+  if (head == 0 || level)
+  {
+    gpio->Set(pin, 1);
+    gpio->SetDirection(pin, 1);
+    dht_line_set_idle(pin, monotonic_ns());
+  }
+  else
+  {
+    dht_line_invalidate(pin);
+  }
+  return DHT_SUCCESS;
+}
+
+int dht_read_chardev(int type, FastGpioChardev* gpio, int pin, dht_reading* reading) {
+  // Validate the reading argument and mark it as not read.
+  if (reading == NULL)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+  memset(reading, 0, sizeof(*reading));
+  reading->temperature = -255.0f;
+  reading->humidity = -255.0f;
+
+  const dht_timing* timing = dht_get_timing(type);
+  if (timing == NULL || gpio == NULL || pin < 0)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+  if (!gpio->IsOpen())
+  {
+    return DHT_ERROR_GPIO;
+  }
+
+  dht_trace* trace = dht_thread_trace();
+  dht_trace_reset(trace, type, 0x1);
+  trace->pins[0] = pin;
+
+  int result = dht_capture_events(gpio, pin, timing, trace);
+  if (result != DHT_SUCCESS)
+  {
+    return result;
+  }
+
+  result = dht_decode_trace(trace, 0, reading);
+  if (result != DHT_SUCCESS)
+  {
+    dht_trace_save_failure(trace);
+  }
+  return result;
+}
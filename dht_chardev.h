@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DHT_CHARDEV_H
+#define DHT_CHARDEV_H
+
+#include "dht_read.h"
+#include "fastgpiochardev.h"
+
+// Read a DHT sensor through the GPIO character device.  The start signal is sent as usual,
+// then the line becomes an input with both-edge events and the frame is rebuilt from the
+// kernel's edge timestamps: no polling loop, no real-time priority and no /dev/mem access.
+// pin is the line offset on gpio's chip.  Returns the same DHT_* codes as dht_read, and
+// DHT_ERROR_GPIO if the line cannot be requested.
+int dht_read_chardev(int sensor, FastGpioChardev* gpio, int pin, dht_reading* reading);
+
+// The capture half: send the start signal and record the edges into trace.
+int dht_capture_events(FastGpioChardev* gpio, int pin, const dht_timing* timing, dht_trace* trace);
+
+#endif
@@ -0,0 +1,382 @@
+// Copyright (c) 2014 Adafruit Industries
+// Author: Tony DiCola
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <stdlib.h>
+#include <string.h>
+
+#include "dht_read.h"
+
+// A low pulse this far from the frame's typical low means the capture loop stalled on the
+// neighbouring edge, and the time it lost was added to or taken from the adjacent high pulse.
+#define DHT_STALL_NS 15000
+
+// Bits closer to the 0/1 boundary than this fraction of the gap between the two clusters are
+// counted as ambiguous.
+#define DHT_AMBIGUOUS_MARGIN 0.35f
+
+// When the checksum fails, the least certain bits below this margin are tried flipped, at most
+// DHT_REPAIR_MAX_FLIPS of them together out of the DHT_REPAIR_CANDIDATES least certain.
+#define DHT_REPAIR_MAX_MARGIN 0.5f
+#define DHT_REPAIR_CANDIDATES 6
+#define DHT_REPAIR_MAX_FLIPS 2
+
+int dht_trace_pulses(const dht_trace* trace, int bit, uint32_t pulseNs[DHT_PULSES*2]) {
+  const dht_timing* timing = trace != NULL ? dht_get_timing(trace->type) : NULL;
+  if (timing == NULL || pulseNs == NULL || bit < 0 || bit > 31 || !(trace->mask & (1u << bit))) {
+    return DHT_ERROR_ARGUMENT;
+  }
+
+  // If the buffer wrapped, the start of the frame is gone.
+  if (trace->head > DHT_TRACE_EDGES) {
+    return DHT_ERROR_TIMEOUT;
+  }
+
+  const uint32_t bitMask = 1u << bit;
+  const uint32_t ackTimeout = timing->ack_timeout_us * 1000;
+  const uint32_t pulseTimeout = timing->pulse_timeout_us * 1000;
+  int level = (trace->idle & bitMask) != 0;
+  int count = -1;
+  uint32_t last = 0;
+  uint32_t i = 0;
+
+  // Walk the edges that touch this bit.  The sensor's acknowledge starts at its first
+  // falling edge, after that every change closes one pulse.
+  for (i; i < trace->head; ++i) {
+    const dht_edge* edge = &trace->edges[i];
+    int value = (edge->levels & bitMask) != 0;
+    if (value == level) {
+      continue;
+    }
+    level = value;
+
+    if (count < 0) {
+      if (level) {
+        continue;
+      }
+      if (edge->time_ns >= ackTimeout) {
+        return DHT_ERROR_TIMEOUT;
+      }
+      count = 0;
+      last = edge->time_ns;
+      continue;
+    }
+
+    uint32_t width = edge->time_ns - last;
+    if (width >= pulseTimeout) {
+      return DHT_ERROR_TIMEOUT;
+    }
+    pulseNs[count++] = width;
+    last = edge->time_ns;
+    if (count == DHT_PULSES*2) {
+      return DHT_SUCCESS;
+    }
+  }
+
+  return DHT_ERROR_TIMEOUT;
+}
+
+
+static int compare_uint32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+// Convert the five frame bytes to humidity and temperature.  Returns 1 when the values are
+// inside the sensor's measuring range.
+static int dht_convert(int type, const uint8_t data[5], dht_reading* reading) {
+  if (type == DHT11) {
+    // Get humidity and temp for DHT11 sensor.
+    reading->humidity = (float)data[0];
+    reading->temperature = (float)data[2];
+    return reading->humidity <= 100.0f && reading->temperature <= 60.0f;
+  }
+
+  // Calculate humidity and temp for DHT22 sensor.
+  reading->humidity = (data[0] * 256 + data[1]) / 10.0f;
+  reading->temperature = ((data[2] & 0x7F) * 256 + data[3]) / 10.0f;
+  if (data[2] & 0x80) {
+    reading->temperature *= -1.0f;
+  }
+  return reading->humidity <= 100.0f && reading->temperature >= -40.0f && reading->temperature <= 80.0f;
+}
+
+static void dht_pack(const uint8_t bits[40], uint8_t data[5]) {
+  memset(data, 0, 5);
+  int i = 0;
+  for (i; i < 40; ++i) {
+    data[i/8] = (data[i/8] << 1) | bits[i];
+  }
+}
+
+static int dht_checksum_ok(const uint8_t data[5]) {
+  return data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF);
+}
+
+int dht_decode_trace(const dht_trace* trace, int bit, dht_reading* reading) {
+  uint32_t pulseNs[DHT_PULSES*2] = {0};
+
+  if (reading == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+  int result = dht_trace_pulses(trace, bit, pulseNs);
+  if (result != DHT_SUCCESS) {
+    memset(reading, 0, sizeof(*reading));
+    reading->humidity = -255.0f;
+    reading->temperature = -255.0f;
+  }
+  else {
+    result = dht_decode(trace->type, pulseNs, reading);
+  }
+  if (trace != NULL) {
+    reading->max_gap_ns = trace->max_gap_ns;
+  }
+  return result;
+}
+
+int dht_decode_trace(const dht_trace* trace, int bit, float* humidity, float* temperature) {
+  dht_reading reading;
+
+  if (humidity == NULL || temperature == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+  int result = dht_decode_trace(trace, bit, &reading);
+  *humidity = reading.humidity;
+  *temperature = reading.temperature;
+  return result;
+}
+
+int dht_decode(int type, const uint32_t pulseNs[DHT_PULSES*2], dht_reading* reading) {
+  const dht_timing* timing = dht_get_timing(type);
+  if (timing == NULL || reading == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+  memset(reading, 0, sizeof(*reading));
+  reading->humidity = -255.0f;
+  reading->temperature = -255.0f;
+
+  // The typical low time of this frame.  Every bit starts with the same low pulse, so a
+  // median over them is a stable reference even if one or two were disturbed.
+  uint32_t lows[40];
+  {
+    int i = 0;
+    for (i; i < 40; ++i) {
+      lows[i] = pulseNs[2 + i*2];
+    }
+  }
+  qsort(lows, 40, sizeof(lows[0]), compare_uint32);
+  int64_t lowRef = (lows[19] + lows[20]) / 2;
+
+  // When the capture loop is preempted across an edge, the edge is stamped late: the pulse
+  // before it grows by the stall and the pulse after it shrinks by the same amount.  A bit's
+  // high time is therefore put back together from the lows on either side of it.
+  float high[40];
+  uint8_t stalled[40];
+  {
+    int i = 0;
+    for (i; i < 40; ++i) {
+      int64_t width = pulseNs[3 + i*2];
+      int64_t before = (int64_t)pulseNs[2 + i*2] - lowRef;
+      int64_t after = i < 39 ? lowRef - (int64_t)pulseNs[4 + i*2] : 0;
+      stalled[i] = 0;
+      if (before > DHT_STALL_NS) {
+        width += before;
+        stalled[i] = 1;
+      }
+      if (after > DHT_STALL_NS) {
+        width -= after;
+        stalled[i] = 1;
+      }
+      high[i] = (float)(width > 0 ? width : 0);
+    }
+  }
+
+  // Two-cluster split of the high times, starting from the nominal 0 and 1 widths.  Sensors
+  // and cable lengths shift both clusters, so the boundary is learned from the frame itself.
+  const float nominalZero = timing->zero_high_us * 1000.0f;
+  const float nominalOne = timing->one_high_us * 1000.0f;
+  float zero = nominalZero;
+  float one = nominalOne;
+  {
+    int pass = 0;
+    for (pass; pass < 8; ++pass) {
+      float boundary = (zero + one) / 2;
+      float sum[2] = {0, 0};
+      int count[2] = {0, 0};
+      int i = 0;
+      for (i; i < 40; ++i) {
+        int k = high[i] >= boundary;
+        sum[k] += high[i];
+        count[k]++;
+      }
+      // A value missing from the frame keeps its nominal width.
+      float newZero = count[0] ? sum[0] / count[0] : nominalZero;
+      float newOne = count[1] ? sum[1] / count[1] : nominalOne;
+      if (newZero == zero && newOne == one) {
+        break;
+      }
+      zero = newZero;
+      one = newOne;
+    }
+  }
+  // Clusters that collapsed onto each other say nothing about the boundary.
+  if (one - zero < (nominalOne - nominalZero) / 2) {
+    zero = nominalZero;
+    one = nominalOne;
+  }
+
+  // Classify each bit and rate it by its distance from the boundary: 0 right on it, 1 at or
+  // beyond the centre of its cluster.  Bits rebuilt after a stall are trusted half as much.
+  const float boundary = (zero + one) / 2;
+  const float half = (one - zero) / 2;
+  uint8_t bits[40];
+  float margin[40];
+  float minMargin = 1.0f;
+  {
+    int i = 0;
+    for (i; i < 40; ++i) {
+      float distance = high[i] - boundary;
+      bits[i] = distance >= 0;
+      margin[i] = (distance < 0 ? -distance : distance) / half;
+      if (margin[i] > 1.0f) {
+        margin[i] = 1.0f;
+      }
+      if (stalled[i]) {
+        margin[i] *= 0.5f;
+      }
+      if (margin[i] < DHT_AMBIGUOUS_MARGIN) {
+        reading->ambiguous_bits++;
+      }
+      if (margin[i] < minMargin) {
+        minMargin = margin[i];
+      }
+    }
+  }
+
+  // Useful debug info:
+  //printf("Boundary: %.0fns, clusters %.0fns and %.0fns\n", boundary, zero, one);
+
+  uint8_t data[5];
+  dht_pack(bits, data);
+  if (dht_checksum_ok(data)) {
+    dht_convert(type, data, reading);
+    reading->confidence = minMargin;
+    return DHT_SUCCESS;
+  }
+
+  // The checksum failed.  Collect the least certain bits, least certain first.
+  int candidates[40];
+  int numCandidates = 0;
+  {
+    int i = 0;
+    for (i; i < 40; ++i) {
+      if (margin[i] >= DHT_REPAIR_MAX_MARGIN) {
+        continue;
+      }
+      int j = numCandidates++;
+      for (j; j > 0 && margin[candidates[j-1]] > margin[i]; --j) {
+        candidates[j] = candidates[j-1];
+      }
+      candidates[j] = i;
+    }
+  }
+  if (numCandidates > DHT_REPAIR_CANDIDATES) {
+    numCandidates = DHT_REPAIR_CANDIDATES;
+  }
+
+  // Try every combination of up to DHT_REPAIR_MAX_FLIPS candidates, in order of the total
+  // margin they overrule, and take the first that satisfies the checksum with a reading in
+  // the sensor's range.  An additive checksum can be fooled, so the result is reported with a
+  // confidence of at most one half.
+  int best = -1;
+  float bestCost = 0;
+  {
+    int set = 1;
+    for (set; set < (1 << numCandidates); ++set) {
+      int flips = 0;
+      float cost = 0;
+      int i = 0;
+      for (i; i < numCandidates; ++i) {
+        if (set & (1 << i)) {
+          flips++;
+          cost += margin[candidates[i]];
+        }
+      }
+      if (flips > DHT_REPAIR_MAX_FLIPS || (best >= 0 && cost >= bestCost)) {
+        continue;
+      }
+
+      uint8_t repaired[40];
+      memcpy(repaired, bits, sizeof(repaired));
+      for (i = 0; i < numCandidates; ++i) {
+        if (set & (1 << i)) {
+          repaired[candidates[i]] ^= 1;
+        }
+      }
+      dht_reading candidate;
+      dht_pack(repaired, data);
+      if (dht_checksum_ok(data) && dht_convert(type, data, &candidate)) {
+        best = set;
+        bestCost = cost;
+      }
+    }
+  }
+  if (best < 0) {
+    return DHT_ERROR_CHECKSUM;
+  }
+
+  uint8_t flipped[40] = {0};
+  float confidence = 0.5f;
+  {
+    int i = 0;
+    for (i; i < numCandidates; ++i) {
+      if (best & (1 << i)) {
+        flipped[candidates[i]] = 1;
+        bits[candidates[i]] ^= 1;
+        confidence *= 1.0f - margin[candidates[i]];
+        reading->repaired_bits++;
+      }
+    }
+    // The weakest bit that was left alone still limits how far the frame can be trusted.
+    float weakest = 1.0f;
+    for (i = 0; i < 40; ++i) {
+      if (!flipped[i] && margin[i] < weakest) {
+        weakest = margin[i];
+      }
+    }
+    confidence *= weakest;
+  }
+  dht_pack(bits, data);
+  dht_convert(type, data, reading);
+  reading->confidence = confidence;
+  return DHT_SUCCESS;
+}
+
+int dht_decode(int type, const uint32_t pulseNs[DHT_PULSES*2], float* humidity, float* temperature) {
+  dht_reading reading;
+
+  if (humidity == NULL || temperature == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+  int result = dht_decode(type, pulseNs, &reading);
+  *humidity = reading.humidity;
+  *temperature = reading.temperature;
+  return result;
+}
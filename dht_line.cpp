@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <atomic>
+
+#include "dht_line.h"
+
+// Monotonic time each line went idle, 0 while unknown.  Sensors on different pins can be
+// read from different threads, so every slot is atomic.
+static std::atomic<uint64_t> dht_lines[DHT_LINE_PINS];
+
+void dht_line_set_idle(int pin, uint64_t since_ns) {
+  if (pin < 0 || pin >= DHT_LINE_PINS) {
+    return;
+  }
+  dht_lines[pin].store(since_ns ? since_ns : 1, std::memory_order_relaxed);
+}
+
+void dht_line_invalidate(int pin) {
+  if (pin < 0 || pin >= DHT_LINE_PINS) {
+    return;
+  }
+  dht_lines[pin].store(0, std::memory_order_relaxed);
+}
+
+uint64_t dht_line_idle_ns(int pin, uint64_t now_ns) {
+  if (pin < 0 || pin >= DHT_LINE_PINS) {
+    return 0;
+  }
+  uint64_t since = dht_lines[pin].load(std::memory_order_relaxed);
+  if (since == 0 || since > now_ns) {
+    return 0;
+  }
+  return now_ns - since;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DHT_LINE_H
+#define DHT_LINE_H
+
+#include <stdint.h>
+
+// How long a data line has to have been idle high before a start signal is sent.  The
+// original code held every line high this long before each read.
+#define DHT_LINE_SETTLE_MS 500
+
+// Number of GPIOs whose line state is tracked.
+#define DHT_LINE_PINS 96
+
+// A line is known idle from the moment a capture ends with the sensor released and the line
+// high.  Anything else, a failed capture or a line found low, makes its state unknown again
+// and the next read holds it high for the full settle time first.
+
+// Record that the pin's line has been idle high since the given monotonic time.
+void dht_line_set_idle(int pin, uint64_t since_ns);
+
+// Forget what is known about the pin's line.
+void dht_line_invalidate(int pin);
+
+// How long the pin's line has been idle high at monotonic time now_ns, 0 if unknown.
+uint64_t dht_line_idle_ns(int pin, uint64_t now_ns);
+
+#endif
@@ -21,183 +21,207 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "dht_read.h"
 //#include "onion_mmio.h"
-#include "fastgpioomega2.h"
-
-// This is the only processor specific magic value, the maximum amount of time to
-// spin in a loop before bailing out and considering the read a timeout.  This should
-// be a high value, but if you're running on a much faster platform than a Raspberry
-// Pi or Beaglebone Black then it might need to be increased.
-#define DHT_MAXCOUNT 32000
-
-// Number of bit pulses to expect from the DHT.  Note that this is 41 because
-// the first pulse is a constant 50 microsecond pulse, with 40 pulses to represent
-// the data afterwards.
-#define DHT_PULSES 41
+#include "dht_capture.h"
+
+// Nominal DHT timings from the datasheets.  Pulses are measured against the monotonic
+// clock, so unlike a loop counter these hold on any CPU speed or load.
+static const dht_timing dht11_timing = {
+  20,   // start_ms, datasheet minimum is 18ms
+  80,   // response_us
+  50,   // bit_low_us
+  28,   // zero_high_us, 26-28us
+  70,   // one_high_us
+  500,  // ack_timeout_us
+  250,  // pulse_timeout_us
+  10000,// frame_timeout_us
+  1000  // interval_ms, one conversion per second
+};
+
+static const dht_timing dht22_timing = {
+  20,   // start_ms, datasheet minimum is 1ms
+  80,   // response_us
+  50,   // bit_low_us
+  28,   // zero_high_us, 26-28us
+  70,   // one_high_us
+  500,  // ack_timeout_us
+  200,  // pulse_timeout_us
+  8000, // frame_timeout_us
+  2000  // interval_ms, one conversion every two seconds
+};
+
+const dht_timing* dht_get_timing(int type) {
+  if (type == DHT11) {
+    return &dht11_timing;
+  }
+  if (type == DHT22) {
+    return &dht22_timing;
+  }
+  return NULL;
+}
 
 int dht_read(int type, int pin, float* humidity, float* temperature) {
-  // Validate humidity and temperature arguments and set them to zero.
+  // Validate humidity and temperature arguments.
   if (humidity == NULL || temperature == NULL)
   {
     return DHT_ERROR_ARGUMENT;
   }
-  *temperature = -255.0f;
-  *humidity = -255.0f;
+
+  dht_reading reading;
+  int result = dht_read(type, pin, &reading);
+  *humidity = reading.humidity;
+  *temperature = reading.temperature;
+  return result;
+}
+
+int dht_read(int type, int pin, dht_reading* reading) {
+  // Validate the reading argument and mark it as not read.
+  if (reading == NULL)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
+  memset(reading, 0, sizeof(*reading));
+  reading->temperature = -255.0f;
+  reading->humidity = -255.0f;
+
+  const dht_timing* timing = dht_get_timing(type);
+  if (timing == NULL || pin < 0 || pin >= 96)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
 
   FastGpioOmega2	gpioObj;
   gpioObj.SetVerbosity(0);
   gpioObj.SetDebugMode(0);
 
-  // Initialize GPIO library.
-  //if (pi_mmio_init() < 0) {
-  if (false)
+  // The register block is mapped once and shared, this only fails if that mapping failed.
+  if (!gpioObj.IsReady())
   {
     return DHT_ERROR_GPIO;
   }
 
-  // Store the count that each DHT bit pulse is low and high.
-  // Make sure array is initialized to start at zero.
-  int pulseCounts[DHT_PULSES*2] = {0};
-
-  // Set pin to output.
-  //pi_mmio_set_output(pin);
-  int ok = gpioObj.SetDirection(pin, 1);
+  // The pin reads back as bit 0 of the samples.
+  dht_trace* trace = dht_thread_trace();
+  dht_trace_reset(trace, type, 0x1);
+  trace->pins[0] = pin;
 
-  // Bump up process priority and change scheduler to try to try to make process more 'real time'.
-  set_max_priority();
-
-  // Set pin high for ~500 milliseconds.
-  //pi_mmio_set_high(pin);
-  ok = gpioObj.Set(pin, 1);
-  sleep_milliseconds(500);
+  // Resolve the pin's registers once, the capture loop only loads and masks.
+  if (gpioObj.GetBackend() != NULL)
+  {
+    dht_capture(FastGpioRuntimePin<GpioBackendAccess>(pin, GpioBackendAccess(gpioObj.GetBackend())), timing, trace);
+  }
+  else
+  {
+    dht_capture(FastGpioRuntimePin<GpioMmioAccess>(pin, GpioMmioAccess(gpioObj.GetRegisterAddress())), timing, trace);
+  }
 
-  // The next calls are timing critical and care should be taken
-  // to ensure no unnecssary work is done below.
+  // Back at normal priority, interpret what was recorded.
+  int result = dht_decode_trace(trace, 0, reading);
+  if (result != DHT_SUCCESS)
+  {
+    dht_trace_save_failure(trace);
+  }
+  return result;
+}
 
-  // Set pin low for ~20 milliseconds.
-  //pi_mmio_set_low(pin);
-  ok = gpioObj.Set(pin, 0);
-  busy_wait_milliseconds(20);
+int dht_read_many(int type, const int* pins, int count, float* humidity, float* temperature, int* results) {
+  dht_reading readings[DHT_MAX_SENSORS];
 
-  // Set pin at input.
-  //pi_mmio_set_input(pin);
-  ok = gpioObj.SetDirection(pin, 0);
-  // Need a very short delay before reading pins or else value is sometimes still low.
+  if (humidity == NULL || temperature == NULL || count <= 0 || count > DHT_MAX_SENSORS)
   {
-    volatile int i = 0;
-    for (i; i < 50; ++i)
-    {
+    return DHT_ERROR_ARGUMENT;
+  }
+  int result = dht_read_many(type, pins, count, readings, results);
+  if (result == DHT_SUCCESS)
+  {
+    int i = 0;
+    for (i; i < count; ++i) {
+      humidity[i] = readings[i].humidity;
+      temperature[i] = readings[i].temperature;
     }
   }
+  return result;
+}
 
-  // Wait for DHT to pull pin low.
-  uint32_t count = 0;
-  int value = 0;
-  
-  //while (pi_mmio_input(pin))
-  do
+int dht_read_many(int type, const int* pins, int count, dht_reading* readings, int* results) {
+  // Validate arguments, every pin has to live in the same bank as the first.
+  if (pins == NULL || readings == NULL || results == NULL ||
+      count <= 0 || count > DHT_MAX_SENSORS)
   {
-    if (++count >= DHT_MAXCOUNT)
-    {
-      // Timeout waiting for response.
-      set_default_priority();
-      return DHT_ERROR_TIMEOUT;
-    }
-    gpioObj.Read(pin, value);
-    //printf("value: %i\n", value);
-  }while (value);
+    return DHT_ERROR_ARGUMENT;
+  }
+  const dht_timing* timing = dht_get_timing(type);
+  if (timing == NULL || pins[0] < 0 || pins[0] >= 96)
+  {
+    return DHT_ERROR_ARGUMENT;
+  }
 
+  int bank = pins[0] / 32;
+  uint32_t mask = 0;
   {
     int i = 0;
-    // Record pulse widths for the expected result bits.
-    for (i; i < DHT_PULSES*2; i+=2)
-    {
-      // Count how long pin is low and store in pulseCounts[i]
-      //while (!pi_mmio_input(pin))
-      do
+    for (i; i < count; ++i) {
+      if (pins[i] < 0 || pins[i] / 32 != bank || (mask & (1u << (pins[i] % 32))))
       {
-        if (++pulseCounts[i] >= DHT_MAXCOUNT)
-        {
-          // Timeout waiting for response.
-          set_default_priority();
-          return DHT_ERROR_TIMEOUT;
-        }
-        gpioObj.Read(pin, value);
-        //printf("value2: %i\n", value);
-      }while (!value);
-
-      // Count how long pin is high and store in pulseCounts[i+1]
-      //while (pi_mmio_input(pin))
-      do
-      {
-        if (++pulseCounts[i+1] >= DHT_MAXCOUNT)
-        {
-          // Timeout waiting for response.
-          set_default_priority();
-          return DHT_ERROR_TIMEOUT;
-        }
-        gpioObj.Read(pin, value);
-        //printf("value3: %i\n", value);
-      }while (value);
+        return DHT_ERROR_ARGUMENT;
+      }
+      mask |= 1u << (pins[i] % 32);
+      memset(&readings[i], 0, sizeof(readings[i]));
+      readings[i].humidity = -255.0f;
+      readings[i].temperature = -255.0f;
+      results[i] = DHT_ERROR_TIMEOUT;
     }
   }
 
-  // Done with timing critical code, now interpret the results.
-
-  // Drop back to normal priority.
-  set_default_priority();
+  FastGpioOmega2	gpioObj;
+  gpioObj.SetVerbosity(0);
+  gpioObj.SetDebugMode(0);
 
-  // Compute the average low pulse width to use as a 50 microsecond reference threshold.
-  // Ignore the first two readings because they are a constant 80 microsecond pulse.
-  uint32_t threshold = 0;
+  // The register block is mapped once and shared, this only fails if that mapping failed.
+  if (!gpioObj.IsReady())
   {
-    int i = 2;
-    for (i; i < DHT_PULSES*2; i+=2) {
-      threshold += pulseCounts[i];
-    }
+    return DHT_ERROR_GPIO;
   }
-  threshold /= DHT_PULSES-1;
 
-  // Interpret each high pulse as a 0 or 1 by comparing it to the 50us reference.
-  // If the count is less than 50us it must be a ~28us 0 pulse, and if it's higher
-  // then it must be a ~70us 1 pulse.
-  uint8_t data[5] = {0};
+  // Pins keep their own bit position in the samples.
+  dht_trace* trace = dht_thread_trace();
+  dht_trace_reset(trace, type, mask);
   {
-    int i = 3;
-    for (i; i < DHT_PULSES*2; i+=2) {
-      int index = (i-3)/16;
-      data[index] <<= 1;
-      if (pulseCounts[i] >= threshold) {
-        // One bit for long pulse.
-        data[index] |= 1;
-      }
-      // Else zero bit for short pulse.
+    int i = 0;
+    for (i; i < count; ++i) {
+      trace->pins[pins[i] % 32] = pins[i];
     }
   }
 
-  // Useful debug info:
-  //printf("Data: 0x%x 0x%x 0x%x 0x%x 0x%x\n", data[0], data[1], data[2], data[3], data[4]);
+  // One capture window for every sensor, each pass samples the whole bank with one load.
+  if (gpioObj.GetBackend() != NULL)
+  {
+    dht_capture(FastGpioBank<GpioBackendAccess>(bank, mask, GpioBackendAccess(gpioObj.GetBackend())), timing, trace);
+  }
+  else
+  {
+    dht_capture(FastGpioBank<GpioMmioAccess>(bank, mask, GpioMmioAccess(gpioObj.GetRegisterAddress())), timing, trace);
+  }
 
-  // Verify checksum of received data.
-  if (data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
-    if (type == DHT11) {
-      // Get humidity and temp for DHT11 sensor.
-      *humidity = (float)data[0];
-      *temperature = (float)data[2];
-    }
-    else if (type == DHT22) {
-      // Calculate humidity and temp for DHT22 sensor.
-      *humidity = (data[0] * 256 + data[1]) / 10.0f;
-      *temperature = ((data[2] & 0x7F) * 256 + data[3]) / 10.0f;
-      if (data[2] & 0x80) {
-        *temperature *= -1.0f;
+  // Back at normal priority, demultiplex and decode each sensor.
+  int failed = 0;
+  {
+    int i = 0;
+    for (i; i < count; ++i) {
+      results[i] = dht_decode_trace(trace, pins[i] % 32, &readings[i]);
+      if (results[i] != DHT_SUCCESS)
+      {
+        failed = 1;
       }
     }
-    return DHT_SUCCESS;
   }
-  else {
-    return DHT_ERROR_CHECKSUM;
+  if (failed)
+  {
+    dht_trace_save_failure(trace);
   }
+
+  return DHT_SUCCESS;
 }
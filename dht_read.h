@@ -22,11 +22,85 @@
 #define PI_DHT_READ_H
 
 #include "common_dht_read.h"
+#include "dht_trace.h"
+
+// Number of bit pulses to expect from the DHT.  Note that this is 41 because
+// the first pulse is a constant 50 microsecond pulse, with 40 pulses to represent
+// the data afterwards.
+#define DHT_PULSES 41
+
+// Nominal protocol timings for a sensor type, all in microseconds.
+typedef struct {
+  uint32_t start_ms;        // how long the host holds the line low to start a conversion
+  uint32_t response_us;     // the sensor's low and high acknowledge pulses
+  uint32_t bit_low_us;      // low time that precedes every data bit
+  uint32_t zero_high_us;    // high time of a 0 bit
+  uint32_t one_high_us;     // high time of a 1 bit
+  uint32_t ack_timeout_us;  // longest wait for the sensor to answer the start signal
+  uint32_t pulse_timeout_us;// longest any single level may last inside the frame
+  uint32_t frame_timeout_us;// upper bound on the whole capture
+  uint32_t interval_ms;     // shortest time between the end of one conversion and the next start
+} dht_timing;
+
+// Timings for DHT11 or DHT22/AM2302, NULL for an unknown type.
+const dht_timing* dht_get_timing(int sensor);
+
+// A decoded reading and how much the decoder trusts it.  confidence runs from 0 to 1: it is 1
+// when every bit's high pulse sat at or beyond the centre of its cluster and falls as the least
+// certain bit nears the 0/1 boundary.  Frames that only passed the checksum after flipping bits
+// are reported at 0.5 or below.
+typedef struct {
+  float humidity;
+  float temperature;
+  float confidence;
+  int ambiguous_bits;       // bits close to the 0/1 boundary
+  int repaired_bits;        // bits flipped to make the checksum agree
+  uint32_t max_gap_ns;      // worst gap between two samples during the capture, 0 if unknown
+} dht_reading;
 
 // Read DHT sensor connected to GPIO pin (using BCM numbering).  Humidity and temperature will be 
 // returned in the provided parameters. If a successfull reading could be made a value of 0 
 // (DHT_SUCCESS) will be returned.  If there was an error reading the sensor a negative value will
 // be returned.  Some errors can be ignored and retried, specifically DHT_ERROR_TIMEOUT or DHT_ERROR_CHECKSUM.
 int dht_read(int sensor, int pin, float* humidity, float* temperature);
+int dht_read(int sensor, int pin, dht_reading* reading);
+
+// Same as above for a pin known at compile time, e.g. dht_read<19>(DHT22, &h, &t).  The
+// register offsets and bit mask become constants in the capture loop.
+template <int Pin>
+int dht_read(int sensor, float* humidity, float* temperature);
+template <int Pin>
+int dht_read(int sensor, dht_reading* reading);
+
+// Maximum number of sensors dht_read_many can capture in one window.
+#define DHT_MAX_SENSORS 32
+
+// Read several DHT sensors of the same type at once.  All pins must be in the same 32 pin
+// GPIO bank, so a single data register read samples every sensor.  The start signal goes to
+// all sensors together and their frames are captured in one real-time window.  Each sensor's
+// readings and DHT_* status are returned at the same index in humidity, temperature and
+// results.  The return value is DHT_SUCCESS unless the arguments or GPIO setup are invalid.
+int dht_read_many(int sensor, const int* pins, int count, float* humidity, float* temperature, int* results);
+int dht_read_many(int sensor, const int* pins, int count, dht_reading* readings, int* results);
+
+// Pull the pulse widths, in nanoseconds, of the sensor on the given bit out of a capture.
+// Returns DHT_SUCCESS, DHT_ERROR_TIMEOUT when the frame is incomplete or a pulse is too long,
+// or DHT_ERROR_ARGUMENT.
+int dht_trace_pulses(const dht_trace* trace, int bit, uint32_t pulseNs[DHT_PULSES*2]);
+
+// The offline half of a read: decode the sensor on the given bit of a capture.  Runs at
+// normal priority after the capture, or on a trace loaded from a file.
+int dht_decode_trace(const dht_trace* trace, int bit, float* humidity, float* temperature);
+int dht_decode_trace(const dht_trace* trace, int bit, dht_reading* reading);
+
+// Interpret the low/high pulse widths, in nanoseconds, captured by dht_read.  Even entries are
+// the low part of each pulse, odd entries the high part.  The high widths are split into a 0 and
+// a 1 cluster learned from the frame, after undoing any stall the lows on either side show.  If
+// the checksum fails, the least certain bits are tried flipped before giving up.  Returns
+// DHT_SUCCESS, DHT_ERROR_CHECKSUM or DHT_ERROR_ARGUMENT for an unknown sensor type.
+int dht_decode(int sensor, const uint32_t pulseNs[DHT_PULSES*2], float* humidity, float* temperature);
+int dht_decode(int sensor, const uint32_t pulseNs[DHT_PULSES*2], dht_reading* reading);
+
+#include "dht_capture.h"
 
 #endif
@@ -0,0 +1,136 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common_dht_read.h"
+#include "dht_trace.h"
+
+static char trace_dir[256] = "";
+
+void dht_trace_reset(dht_trace* trace, int type, uint32_t mask) {
+  int i = 0;
+  trace->type = type;
+  for (i; i < 32; ++i) {
+    trace->pins[i] = -1;
+  }
+  trace->mask = mask;
+  trace->idle = 0;
+  trace->start_ns = 0;
+  trace->end_ns = 0;
+  trace->max_gap_ns = 0;
+  trace->head = 0;
+}
+
+dht_trace* dht_thread_trace(void) {
+  static thread_local dht_trace trace;
+  return &trace;
+}
+
+int dht_trace_save(const dht_trace* trace, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+
+  // Only the edges still in the buffer are written, oldest first.
+  uint32_t first = trace->head > DHT_TRACE_EDGES ? trace->head - DHT_TRACE_EDGES : 0;
+  uint32_t i = 0;
+
+  fprintf(file, "# dht trace v2\n");
+  fprintf(file, "type %d\n", trace->type);
+  fprintf(file, "pins");
+  for (i = 0; i < 32; ++i) {
+    fprintf(file, " %d", trace->pins[i]);
+  }
+  fprintf(file, "\n");
+  fprintf(file, "mask 0x%08" PRIx32 "\n", trace->mask);
+  fprintf(file, "idle 0x%08" PRIx32 "\n", trace->idle);
+  fprintf(file, "start %" PRIu64 "\n", trace->start_ns);
+  fprintf(file, "end %" PRIu32 "\n", trace->end_ns);
+  fprintf(file, "gap %" PRIu32 "\n", trace->max_gap_ns);
+  fprintf(file, "edges %" PRIu32 " %" PRIu32 "\n", trace->head, trace->head - first);
+  for (i = first; i < trace->head; ++i) {
+    const dht_edge* edge = &trace->edges[i & (DHT_TRACE_EDGES-1)];
+    fprintf(file, "%" PRIu32 " 0x%08" PRIx32 "\n", edge->time_ns, edge->levels);
+  }
+
+  int ok = (ferror(file) == 0);
+  ok = (fclose(file) == 0) && ok;
+  return ok ? DHT_SUCCESS : DHT_ERROR_ARGUMENT;
+}
+
+int dht_trace_load(dht_trace* trace, const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return DHT_ERROR_ARGUMENT;
+  }
+
+  char header[32] = "";
+  uint32_t head = 0;
+  uint32_t kept = 0;
+  uint32_t i = 0;
+  int ok = fgets(header, sizeof(header), file) != NULL;
+  // Version 1 traces predate the gap measurement.
+  int version = 0;
+  if (ok && strcmp(header, "# dht trace v1\n") == 0) {
+    version = 1;
+  }
+  else if (ok && strcmp(header, "# dht trace v2\n") == 0) {
+    version = 2;
+  }
+  ok = ok && version != 0;
+
+  dht_trace_reset(trace, 0, 0);
+  ok = ok && fscanf(file, " type %d", &trace->type) == 1;
+  ok = ok && fscanf(file, " pins") == 0;
+  for (i = 0; ok && i < 32; ++i) {
+    ok = fscanf(file, " %d", &trace->pins[i]) == 1;
+  }
+  ok = ok && fscanf(file, " mask %" SCNx32, &trace->mask) == 1;
+  ok = ok && fscanf(file, " idle %" SCNx32, &trace->idle) == 1;
+  ok = ok && fscanf(file, " start %" SCNu64, &trace->start_ns) == 1;
+  ok = ok && fscanf(file, " end %" SCNu32, &trace->end_ns) == 1;
+  if (version >= 2) {
+    ok = ok && fscanf(file, " gap %" SCNu32, &trace->max_gap_ns) == 1;
+  }
+  ok = ok && fscanf(file, " edges %" SCNu32 " %" SCNu32, &head, &kept) == 2;
+  ok = ok && kept <= DHT_TRACE_EDGES && kept <= head;
+  for (i = head - kept; ok && i < head; ++i) {
+    dht_edge* edge = &trace->edges[i & (DHT_TRACE_EDGES-1)];
+    ok = fscanf(file, " %" SCNu32 " %" SCNx32, &edge->time_ns, &edge->levels) == 2;
+  }
+  trace->head = ok ? head : 0;
+
+  fclose(file);
+  return ok ? DHT_SUCCESS : DHT_ERROR_ARGUMENT;
+}
+
+void dht_set_trace_dir(const char* dir) {
+  if (dir == NULL) {
+    trace_dir[0] = '\0';
+    return;
+  }
+  snprintf(trace_dir, sizeof(trace_dir), "%s", dir);
+}
+
+void dht_trace_save_failure(const dht_trace* trace) {
+  if (trace_dir[0] == '\0') {
+    return;
+  }
+
+  // Name the file after the first pin and the wall clock time of the failure in milliseconds.
+  char path[320];
+  struct timespec now;
+  int pin = -1;
+  int i = 0;
+  for (i; i < 32 && pin < 0; ++i) {
+    pin = trace->pins[i];
+  }
+  clock_gettime(CLOCK_REALTIME, &now);
+  snprintf(path, sizeof(path), "%s/dht-%d-%lld%03ld.trace", trace_dir, pin,
+           (long long)now.tv_sec, now.tv_nsec / 1000000L);
+  if (dht_trace_save(trace, path) != DHT_SUCCESS) {
+    fprintf(stderr, "Unable to save DHT trace to %s\n", path);
+  }
+}
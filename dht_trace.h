@@ -0,0 +1,46 @@
+#ifndef DHT_TRACE_H
+#define DHT_TRACE_H
+
+#include <stdint.h>
+
+// Number of edges a trace can hold, a power of two.  A DHT frame is 84 edges per
+// sensor, so this covers every pin of a bank even when none of their edges coincide.
+#define DHT_TRACE_EDGES 4096
+
+// One change of the sampled data bits.
+typedef struct {
+  uint32_t time_ns;         // since the capture started
+  uint32_t levels;          // the sampled bits after the change
+} dht_edge;
+
+// Raw result of the real-time part of a DHT read: every change seen on the sampled
+// bits, with no interpretation.  Decoding happens later at normal priority, or from a
+// file when replaying a trace saved in the field.
+typedef struct {
+  int type;                 // DHT11 or DHT22
+  int pins[32];             // GPIO behind each bit of levels, -1 where nothing is connected
+  uint32_t mask;            // bits of levels that carry a sensor
+  uint32_t idle;            // levels when the capture started
+  uint64_t start_ns;        // monotonic time the capture started
+  uint32_t end_ns;          // length of the capture
+  uint32_t max_gap_ns;      // longest time between two samples of the lines, i.e. scheduling jitter
+  uint32_t head;            // edges recorded, only the last DHT_TRACE_EDGES are kept
+  dht_edge edges[DHT_TRACE_EDGES];
+} dht_trace;
+
+// Empty the trace before a capture of the given sensor type and bits.
+void dht_trace_reset(dht_trace* trace, int type, uint32_t mask);
+
+// Preallocated trace for captures made by the calling thread.
+dht_trace* dht_thread_trace(void);
+
+// Write a trace as text, or read one back.  Both return DHT_SUCCESS or DHT_ERROR_ARGUMENT.
+int dht_trace_save(const dht_trace* trace, const char* path);
+int dht_trace_load(dht_trace* trace, const char* path);
+
+// When a directory is set, captures that fail to decode are saved there for replay.
+// NULL, the default, turns this off.
+void dht_set_trace_dir(const char* dir);
+void dht_trace_save_failure(const dht_trace* trace);
+
+#endif
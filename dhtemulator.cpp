@@ -0,0 +1,181 @@
+#include <dhtemulator.h>
+
+#include <string.h>
+
+// Datasheet timings, in nanoseconds.
+#define DHT_EMU_START_MIN_DHT11		18000000u	// host start signal, DHT11
+#define DHT_EMU_START_MIN_DHT22		800000u		// host start signal, DHT22/AM2302
+#define DHT_EMU_RELEASE_NS			30000u		// sensor waits 20-40us after release
+#define DHT_EMU_RESPONSE_NS			80000u		// 80us low then 80us high
+#define DHT_EMU_BIT_LOW_NS			50000u
+#define DHT_EMU_ZERO_HIGH_NS		28000u
+#define DHT_EMU_ONE_HIGH_NS			70000u
+
+DhtEmulator::DhtEmulator(int input) : rng(0x44485432)
+{
+	type 				= input;
+	humidity 			= 50.0f;
+	temperature 		= 21.5f;
+	jitterNs 			= 0;
+	bitFlipRate 		= 0.0;
+	dropRate 			= 0.0;
+
+	hostLevel 			= SIM_HOST_RELEASED;
+	hostLowSince 		= 0;
+	cursor 				= 0;
+	numFrames 			= 0;
+	numCorruptFrames	= 0;
+	memset(frame, 0, sizeof(frame));
+}
+
+DhtEmulator::~DhtEmulator(void)
+{
+	// nothing for now
+}
+
+void DhtEmulator::SetReading(float inHumidity, float inTemperature)
+{
+	humidity 	= inHumidity;
+	temperature = inTemperature;
+}
+
+void DhtEmulator::SetJitter(uint32_t input)
+{
+	jitterNs 	= input;
+}
+
+void DhtEmulator::SetCorruption(double input)
+{
+	bitFlipRate = input;
+}
+
+void DhtEmulator::SetDropRate(double input)
+{
+	dropRate 	= input;
+}
+
+void DhtEmulator::SetSeed(uint32_t seed)
+{
+	rng.seed(seed);
+}
+
+void DhtEmulator::LastFrame(uint8_t data[5])
+{
+	memcpy(data, frame, sizeof(frame));
+}
+
+void DhtEmulator::HostDrive(int level, uint64_t nowNs)
+{
+	uint32_t 	startMin 	= (type == DHT11 ? DHT_EMU_START_MIN_DHT11 : DHT_EMU_START_MIN_DHT22);
+	int 		wasLow 		= (hostLevel == 0);
+
+	hostLevel 	= level;
+
+	if (level == 0) {
+		// host is pulling the line down, abandon anything still being sent
+		edges.clear();
+		cursor 			= 0;
+		hostLowSince 	= nowNs;
+		return;
+	}
+
+	if (wasLow && nowNs - hostLowSince >= startMin) {
+		std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+		if (chance(rng) >= dropRate) {
+			_BuildFrame(nowNs);
+		}
+	}
+}
+
+int DhtEmulator::Level(uint64_t nowNs)
+{
+	// reads come in time order, so the cursor only ever moves forward
+	while (cursor < edges.size() && edges[cursor].timeNs <= nowNs) {
+		cursor++;
+	}
+
+	if (cursor == 0) {
+		return 1;		// idle line is held high by the pull-up
+	}
+
+	return edges[cursor - 1].level;
+}
+
+void DhtEmulator::_BuildFrame(uint64_t startNs)
+{
+	uint64_t 	t 	= startNs;
+	uint8_t 	data[5];
+	int 		i;
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+	_Encode(data);
+
+	// corrupt after the checksum so the host sees a checksum mismatch
+	for (i = 0; i < 40; i++) {
+		if (bitFlipRate > 0.0 && chance(rng) < bitFlipRate) {
+			data[i / 8] ^= (0x80 >> (i % 8));
+		}
+	}
+	if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+		numCorruptFrames++;
+	}
+	memcpy(frame, data, sizeof(frame));
+
+	edges.clear();
+	cursor 	= 0;
+
+	t += _Width(DHT_EMU_RELEASE_NS);
+	edges.push_back({t, 0});
+	t += _Width(DHT_EMU_RESPONSE_NS);
+	edges.push_back({t, 1});
+	t += _Width(DHT_EMU_RESPONSE_NS);
+
+	for (i = 0; i < 40; i++) {
+		int bit = (data[i / 8] >> (7 - (i % 8))) & 0x1;
+
+		edges.push_back({t, 0});
+		t += _Width(DHT_EMU_BIT_LOW_NS);
+		edges.push_back({t, 1});
+		t += _Width(bit ? DHT_EMU_ONE_HIGH_NS : DHT_EMU_ZERO_HIGH_NS);
+	}
+
+	// trailing low, then the sensor lets go of the line
+	edges.push_back({t, 0});
+	t += _Width(DHT_EMU_BIT_LOW_NS);
+	edges.push_back({t, 1});
+
+	numFrames++;
+}
+
+void DhtEmulator::_Encode(uint8_t data[5])
+{
+	if (type == DHT11) {
+		data[0] 	= (uint8_t)humidity;
+		data[1] 	= 0;
+		data[2] 	= (uint8_t)temperature;
+		data[3] 	= 0;
+	}
+	else {
+		int 	h 	= (int)(humidity * 10.0f + 0.5f);
+		int 	c 	= (int)((temperature < 0 ? -temperature : temperature) * 10.0f + 0.5f);
+
+		data[0] 	= (h >> 8) & 0xFF;
+		data[1] 	= h & 0xFF;
+		data[2] 	= ((c >> 8) & 0x7F) | (temperature < 0 ? 0x80 : 0x00);
+		data[3] 	= c & 0xFF;
+	}
+	data[4] 	= (data[0] + data[1] + data[2] + data[3]) & 0xFF;
+}
+
+uint64_t DhtEmulator::_Width(uint32_t nominalNs)
+{
+	if (jitterNs == 0) {
+		return nominalNs;
+	}
+
+	std::uniform_int_distribution<int64_t> jitter(-(int64_t)jitterNs, (int64_t)jitterNs);
+	int64_t 	width 	= (int64_t)nominalNs + jitter(rng);
+
+	return (width > 1000 ? width : 1000);
+}
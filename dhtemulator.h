@@ -0,0 +1,68 @@
+#ifndef _DHT_EMULATOR_H_
+#define _DHT_EMULATOR_H_
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+#include <common_dht_read.h>
+#include <simregisterfile.h>
+
+// Emulates the single wire protocol of a DHT11/DHT22 on a simulated GPIO pin.
+// Once the host has held the line low for the sensor's minimum start time and
+// released it, the emulator answers with the 80us low/80us high preamble and 40
+// data bits of 50us low followed by ~28us (zero) or ~70us (one) high, all timed
+// against the register file clock.
+class DhtEmulator : public SimPinDevice {
+public:
+	DhtEmulator(int type = DHT22);
+	~DhtEmulator(void);
+
+	void 	SetReading 			(float humidity, float temperature);
+	// every pulse width is moved by a uniform random amount in [-jitterNs, jitterNs]
+	void 	SetJitter 			(uint32_t jitterNs);
+	// probability that each transmitted bit is inverted after the checksum is computed
+	void 	SetCorruption 		(double bitFlipRate);
+	// probability that the sensor ignores a start signal altogether
+	void 	SetDropRate 		(double dropRate);
+	void 	SetSeed 			(uint32_t seed);
+
+	void 	HostDrive 			(int level, uint64_t nowNs);
+	int 	Level 				(uint64_t nowNs);
+
+	int 	NumFrames 			(void) { return numFrames; }
+	int 	NumCorruptFrames 	(void) { return numCorruptFrames; }
+	// the five bytes of the last frame as they went out on the wire
+	void 	LastFrame 			(uint8_t data[5]);
+
+private:
+	struct Edge {
+		uint64_t 	timeNs;
+		int 		level;
+	};
+
+	void 		_BuildFrame 	(uint64_t startNs);
+	void 		_Encode 		(uint8_t data[5]);
+	uint64_t 	_Width 			(uint32_t nominalNs);
+
+	int 				type;
+	float 				humidity;
+	float 				temperature;
+	uint32_t 			jitterNs;
+	double 				bitFlipRate;
+	double 				dropRate;
+
+	int 				hostLevel;
+	uint64_t 			hostLowSince;
+
+	std::vector<Edge> 	edges;
+	size_t 				cursor;
+	uint8_t 			frame[5];
+
+	int 				numFrames;
+	int 				numCorruptFrames;
+
+	std::mt19937 		rng;
+};
+
+#endif 	// _DHT_EMULATOR_H_
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dhtsensor.h"
+
+DhtSensor::DhtSensor(int type, int pin) :
+    m_haveGood(false), m_pending(false), m_retriesLeft(0), m_maxRetries(2), m_type(type), m_pin(pin),
+    m_conversions(0), m_failures(0), m_cacheHits(0)
+{
+    const dht_timing *timing = dht_get_timing(type);
+
+    m_minInterval = std::chrono::milliseconds(timing ? timing->interval_ms : 2000);
+    m_read = [type, pin](dht_reading *reading) { return dht_read(type, pin, reading); };
+}
+
+/**
+ * \func int DhtSensor::read(dht_reading *reading, Clock::duration *age)
+ * \param reading Receives the fresh reading, or the last good one
+ * \param age Receives how old the reading is, zero for a fresh one
+ * \return DHT_SUCCESS for a fresh reading, DHT_ERROR_BUSY when the sensor is
+ * inside its interval, otherwise the error of the conversion
+ *
+ * Runs a conversion if the sensor can take one now. Otherwise, or if the
+ * conversion failed, reading holds the last good reading (if there is one)
+ * and age says how old it is. A failed conversion schedules a retry at
+ * nextConversion() while retries remain.
+ */
+int DhtSensor::read(dht_reading *reading, Clock::duration *age)
+{
+    std::lock_guard<std::mutex> bus(m_bus);
+    dht_reading fresh;
+    int result;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Clock::time_point now = Clock::now();
+        if (now < m_nextConversion) {
+            m_cacheHits++;
+            cached(reading, age, now);
+            return DHT_ERROR_BUSY;
+        }
+    }
+
+    // The capture takes over half a second, readers of latest() are not held up by it
+    result = m_read(&fresh);
+    complete(result, fresh, reading, age);
+    return result;
+}
+
+/**
+ * \func void DhtSensor::readGroup(DhtSensor *const *sensors, int count, const GroupReadFunction &read, dht_reading *readings, Clock::duration *ages, int *results)
+ * \param sensors Sensors of one type, whose pins read can capture together
+ * \param count Number of sensors, at most DHT_MAX_SENSORS
+ * \param read Captures several pins in one window, dht_read_many() or equivalent
+ * \param readings One per sensor, as read() fills in
+ * \param ages One per sensor, may be NULL
+ * \param results One per sensor, what read() would have returned
+ *
+ * read() for several sensors at once. Sensors still inside their interval
+ * answer from their cache, the others are captured together in one call to
+ * read, so the group costs one capture window instead of one each.
+ */
+void DhtSensor::readGroup(DhtSensor *const *sensors, int count, const GroupReadFunction &read,
+                          dht_reading *readings, Clock::duration *ages, int *results)
+{
+    std::unique_lock<std::mutex> buses[DHT_MAX_SENSORS];
+    int pins[DHT_MAX_SENSORS];
+    int index[DHT_MAX_SENSORS];
+    int ready = 0;
+
+    if (count > DHT_MAX_SENSORS)
+        count = DHT_MAX_SENSORS;
+
+    for (int i = 0; i < count; i++) {
+        DhtSensor *sensor = sensors[i];
+        buses[i] = std::unique_lock<std::mutex>(sensor->m_bus);
+
+        std::lock_guard<std::mutex> lock(sensor->m_mutex);
+        Clock::time_point now = Clock::now();
+        if (now < sensor->m_nextConversion) {
+            sensor->m_cacheHits++;
+            sensor->cached(&readings[i], ages ? &ages[i] : nullptr, now);
+            results[i] = DHT_ERROR_BUSY;
+            continue;
+        }
+        pins[ready] = sensor->m_pin;
+        index[ready++] = i;
+    }
+    if (ready == 0)
+        return;
+
+    dht_reading fresh[DHT_MAX_SENSORS];
+    int captured[DHT_MAX_SENSORS];
+    int result = read(pins, ready, fresh, captured);
+
+    for (int j = 0; j < ready; j++) {
+        int i = index[j];
+        // A failure of the whole capture is every sensor's failure
+        results[i] = (result == DHT_SUCCESS) ? captured[j] : result;
+        sensors[i]->complete(results[i], fresh[j], &readings[i], ages ? &ages[i] : nullptr);
+    }
+}
+
+void DhtSensor::complete(int result, const dht_reading &fresh, dht_reading *reading, Clock::duration *age)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+
+    m_conversions++;
+    m_nextConversion = now + m_minInterval;
+    if (result == DHT_SUCCESS) {
+        m_good = fresh;
+        m_goodAt = now;
+        m_haveGood = true;
+        m_pending = false;
+        m_retriesLeft = 0;
+    }
+    else {
+        m_failures++;
+        m_pending = m_retriesLeft > 0;
+        if (m_pending)
+            m_retriesLeft--;
+    }
+    cached(reading, age, now);
+}
+
+/**
+ * \func bool DhtSensor::latest(dht_reading *reading, Clock::duration *age) const
+ * \return false if the sensor has never been read successfully
+ *
+ * The last good reading and its age. Never touches the bus, safe from any thread.
+ */
+bool DhtSensor::latest(dht_reading *reading, Clock::duration *age) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return cached(reading, age, Clock::now());
+}
+
+/**
+ * \func void DhtSensor::request()
+ *
+ * Ask for a new reading. pending() stays true until a conversion succeeds or
+ * the retries run out; the owner runs read() once nextConversion() has passed.
+ * Asking again while a request is outstanding does not restart its retries.
+ */
+void DhtSensor::request()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pending)
+        return;
+    m_pending = true;
+    m_retriesLeft = m_maxRetries;
+}
+
+bool DhtSensor::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+/**
+ * \func DhtSensor::Clock::time_point DhtSensor::nextConversion() const
+ *
+ * The earliest instant the sensor will answer a start signal
+ */
+DhtSensor::Clock::time_point DhtSensor::nextConversion() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nextConversion;
+}
+
+uint64_t DhtSensor::conversions() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_conversions;
+}
+
+uint64_t DhtSensor::failures() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failures;
+}
+
+uint64_t DhtSensor::cacheHits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cacheHits;
+}
+
+bool DhtSensor::cached(dht_reading *reading, Clock::duration *age, Clock::time_point now) const
+{
+    if (!m_haveGood) {
+        if (reading) {
+            *reading = dht_reading();
+            reading->humidity = -255.0f;
+            reading->temperature = -255.0f;
+        }
+        if (age)
+            *age = Clock::duration::zero();
+        return false;
+    }
+    if (reading)
+        *reading = m_good;
+    if (age)
+        *age = now - m_goodAt;
+    return true;
+}
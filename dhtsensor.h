@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DHTSENSOR_H
+#define DHTSENSOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "dht_read.h"
+
+/**
+ * One DHT sensor and the rules for talking to it. A DHT only starts a new
+ * conversion a minimum interval after the last one (1s for the DHT11, 2s for
+ * the DHT22); a start signal inside that window is ignored and the read is
+ * guaranteed to time out. DhtSensor remembers when the last conversion ended,
+ * answers anything asked inside the window from the last good reading, and
+ * schedules retries of a failed read for the earliest instant the sensor will
+ * answer again.
+ */
+class DhtSensor
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<int(dht_reading*)> ReadFunction;
+    typedef std::function<int(const int *pins, int count, dht_reading *readings, int *results)> GroupReadFunction;
+
+    DhtSensor(int type, int pin);
+
+    void setReadFunction(ReadFunction read) { m_read = read; }
+    void setMaxRetries(int retries) { m_maxRetries = retries; }
+
+    int type() const { return m_type; }
+    int pin() const { return m_pin; }
+    Clock::duration minInterval() const { return m_minInterval; }
+
+    int read(dht_reading *reading, Clock::duration *age = nullptr);
+    static void readGroup(DhtSensor *const *sensors, int count, const GroupReadFunction &read,
+                          dht_reading *readings, Clock::duration *ages, int *results);
+    bool latest(dht_reading *reading, Clock::duration *age = nullptr) const;
+
+    void request();
+    bool pending() const;
+    Clock::time_point nextConversion() const;
+
+    uint64_t conversions() const;
+    uint64_t failures() const;
+    uint64_t cacheHits() const;
+
+private:
+    bool cached(dht_reading *reading, Clock::duration *age, Clock::time_point now) const;
+    void complete(int result, const dht_reading &fresh, dht_reading *reading, Clock::duration *age);
+
+    ReadFunction m_read;
+    Clock::duration m_minInterval;
+    Clock::time_point m_nextConversion;
+    Clock::time_point m_goodAt;
+    dht_reading m_good;
+    bool m_haveGood;
+    bool m_pending;
+    int m_retriesLeft;
+    int m_maxRetries;
+    int m_type;
+    int m_pin;
+    uint64_t m_conversions;
+    uint64_t m_failures;
+    uint64_t m_cacheHits;
+    mutable std::mutex m_mutex;
+    std::mutex m_bus;
+};
+
+#endif // DHTSENSOR_H
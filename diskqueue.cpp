@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "diskqueue.h"
+
+/*
+ * A segment starts with a 16 byte header:
+ *   uint32 SegmentMagic, uint32 sequence, uint32 read offset, uint32 reserved
+ * followed by records, each aligned to 4 bytes:
+ *   uint16 RecordMagic, uint16 topic length including its NUL,
+ *   uint32 payload length, uint32 CRC-32 of the first 8 bytes, topic and payload,
+ *   then the topic and the payload.
+ * The file is zero filled when created, so a zero magic marks the end of the
+ * records. Fields are in host byte order, the files never leave the device.
+ */
+static const uint32_t SegmentMagic = 0x51524c50;
+static const uint16_t RecordMagic = 0xd1a7;
+static const size_t SegmentHeaderSize = 16;
+static const size_t RecordHeaderSize = 12;
+
+static size_t align4(size_t value)
+{
+    return (value + 3) & ~static_cast<size_t>(3);
+}
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static uint32_t table[256];
+    static bool ready = false;
+
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t load32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void store32(uint8_t *data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+/**
+ * \func DiskQueue::DiskQueue(const std::string &directory, size_t segmentSize, int maxSegments)
+ * \param directory Where the segment files live, created by open() if missing
+ * \param segmentSize Size of each segment file, rounded up to whole pages
+ * \param maxSegments Segments kept before the oldest is dropped, at least 2
+ */
+DiskQueue::DiskQueue(const std::string &directory, size_t segmentSize, int maxSegments) :
+    m_directory(directory), m_maxSegments(std::max(maxSegments, 2)), m_syncInterval(8),
+    m_unsynced(0), m_open(false), m_full(false), m_records(0), m_dropped(0), m_discarded(0)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    m_segmentSize = std::max(page, (segmentSize + page - 1) / page * page);
+}
+
+DiskQueue::~DiskQueue()
+{
+    close();
+}
+
+std::string DiskQueue::segmentPath(uint32_t sequence) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/segment-%08x.dat", sequence);
+    return m_directory + name;
+}
+
+size_t DiskQueue::maxRecordSize() const
+{
+    return m_segmentSize - SegmentHeaderSize - RecordHeaderSize;
+}
+
+/**
+ * \func bool DiskQueue::open()
+ * \return false if the directory can't be created or read
+ *
+ * Maps every segment left by a previous run, oldest first, and checks their
+ * records. Damaged segments are removed, torn records are discarded.
+ */
+bool DiskQueue::open()
+{
+    std::vector<uint32_t> sequences;
+
+    if (m_open)
+        return true;
+
+    if (mkdir(m_directory.c_str(), 0755) < 0 && errno != EEXIST) {
+        std::cerr << __FUNCTION__ << ": Unable to create " << m_directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    DIR *dir = opendir(m_directory.c_str());
+    if (dir == NULL) {
+        std::cerr << __FUNCTION__ << ": Unable to read " << m_directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        uint32_t sequence;
+        char tail;
+        if (sscanf(entry->d_name, "segment-%8x.da%c", &sequence, &tail) == 2 && tail == 't')
+            sequences.push_back(sequence);
+    }
+    closedir(dir);
+    std::sort(sequences.begin(), sequences.end());
+
+    for (size_t i = 0; i < sequences.size(); i++) {
+        Segment segment = {};
+        segment.sequence = sequences[i];
+        if (!mapSegment(segment, false)) {
+            std::cerr << __FUNCTION__ << ": Removing unreadable " << segmentPath(segment.sequence) << std::endl;
+            unlink(segmentPath(segment.sequence).c_str());
+            continue;
+        }
+        recoverSegment(segment, i + 1 == sequences.size());
+        m_records += segment.records;
+        m_segments.push_back(segment);
+    }
+    while (m_segments.size() > static_cast<size_t>(m_maxSegments))
+        dropOldest();
+
+    m_open = true;
+    sync();
+    return true;
+}
+
+/**
+ * \func void DiskQueue::close()
+ *
+ * Flushes whatever is still dirty and unmaps every segment. The files stay
+ * for the next open().
+ */
+void DiskQueue::close()
+{
+    if (!m_open)
+        return;
+
+    sync();
+    for (Segment &segment : m_segments)
+        releaseSegment(segment, false);
+    m_segments.clear();
+    m_records = 0;
+    m_open = false;
+}
+
+bool DiskQueue::mapSegment(Segment &segment, bool create)
+{
+    std::string path = segmentPath(segment.sequence);
+    struct stat st;
+
+    segment.fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (segment.fd < 0)
+        return false;
+
+    if (create && ftruncate(segment.fd, m_segmentSize) < 0) {
+        ::close(segment.fd);
+        return false;
+    }
+    // A segment written with another size is still read at its own size
+    if (fstat(segment.fd, &st) < 0 || st.st_size < static_cast<off_t>(SegmentHeaderSize + RecordHeaderSize)) {
+        ::close(segment.fd);
+        return false;
+    }
+    segment.base = static_cast<uint8_t*>(mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0));
+    if (segment.base == MAP_FAILED) {
+        ::close(segment.fd);
+        return false;
+    }
+    segment.size = st.st_size;
+
+    if (create) {
+        store32(segment.base, SegmentMagic);
+        store32(segment.base + 4, segment.sequence);
+        store32(segment.base + 8, SegmentHeaderSize);
+        segment.readOffset = SegmentHeaderSize;
+        segment.writeOffset = SegmentHeaderSize;
+        segment.dirtyStart = 0;
+        segment.dirtyEnd = SegmentHeaderSize;
+        return true;
+    }
+
+    if (load32(segment.base) != SegmentMagic || load32(segment.base + 4) != segment.sequence) {
+        releaseSegment(segment, false);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns the size of the record at offset including padding, or 0 if there
+ * is no intact record there
+ */
+size_t DiskQueue::recordAt(const Segment &segment, size_t offset, const char **topic, const uint8_t **payload, size_t *size) const
+{
+    if (offset + RecordHeaderSize > segment.size)
+        return 0;
+
+    const uint8_t *record = segment.base + offset;
+    uint16_t magic, topicSize;
+    memcpy(&magic, record, sizeof(magic));
+    memcpy(&topicSize, record + 2, sizeof(topicSize));
+    uint32_t payloadSize = load32(record + 4);
+
+    if (magic != RecordMagic || topicSize == 0 || payloadSize > segment.size)
+        return 0;
+    size_t length = align4(RecordHeaderSize + topicSize + payloadSize);
+    if (offset + length > segment.size)
+        return 0;
+
+    uint32_t crc = crc32Update(0, record, 8);
+    crc = crc32Update(crc, record + RecordHeaderSize, topicSize + payloadSize);
+    if (crc != load32(record + 8) || record[RecordHeaderSize + topicSize - 1] != '\0')
+        return 0;
+
+    if (topic)
+        *topic = reinterpret_cast<const char*>(record + RecordHeaderSize);
+    if (payload)
+        *payload = record + RecordHeaderSize + topicSize;
+    if (size)
+        *size = payloadSize;
+    return length;
+}
+
+/**
+ * Walks the records from the stored read offset to the first one that is
+ * missing or fails its CRC. Anything after that is from a write that never
+ * completed; in the segment being appended to it is zeroed so a later
+ * append can't be mistaken for part of it.
+ */
+void DiskQueue::recoverSegment(Segment &segment, bool last)
+{
+    size_t offset = load32(segment.base + 8);
+    if (offset < SegmentHeaderSize || offset > segment.size || (offset & 3))
+        offset = SegmentHeaderSize;
+
+    segment.readOffset = offset;
+    segment.records = 0;
+    segment.dirtyStart = segment.dirtyEnd = 0;
+
+    size_t length;
+    while ((length = recordAt(segment, offset, NULL, NULL, NULL)) != 0) {
+        offset += length;
+        segment.records++;
+    }
+    segment.writeOffset = offset;
+
+    size_t tail = std::min(segment.size - offset, RecordHeaderSize);
+    bool torn = false;
+    for (size_t i = 0; i < tail; i++) {
+        if (segment.base[offset + i] != 0)
+            torn = true;
+    }
+    if (torn) {
+        std::cerr << __FUNCTION__ << ": Discarding damaged records in " << segmentPath(segment.sequence)
+            << " from offset " << offset << std::endl;
+        m_discarded++;
+        if (last) {
+            memset(segment.base + offset, 0, segment.size - offset);
+            segment.dirtyStart = offset;
+            segment.dirtyEnd = segment.size;
+        }
+        else {
+            segment.writeOffset = segment.size;
+        }
+    }
+}
+
+void DiskQueue::releaseSegment(Segment &segment, bool remove)
+{
+    munmap(segment.base, segment.size);
+    ::close(segment.fd);
+    if (remove)
+        unlink(segmentPath(segment.sequence).c_str());
+}
+
+/**
+ * Makes room by throwing away the oldest segment and whatever was still
+ * waiting in it
+ */
+void DiskQueue::dropOldest()
+{
+    Segment &segment = m_segments.front();
+
+    if (segment.records) {
+        // Once per spell of being full, not for every segment
+        if (!m_full)
+            std::cerr << __FUNCTION__ << ": Queue full, dropping the oldest messages" << std::endl;
+        m_full = true;
+        m_dropped += segment.records;
+        m_records -= segment.records;
+    }
+    releaseSegment(segment, true);
+    m_segments.pop_front();
+}
+
+/**
+ * Seals the segment being written and starts the next one. Fully read
+ * segments are removed first, then the oldest ones if the queue is full.
+ */
+bool DiskQueue::addSegment()
+{
+    Segment segment = {};
+
+    if (!m_segments.empty()) {
+        syncSegment(m_segments.back());
+        segment.sequence = m_segments.back().sequence + 1;
+    }
+    while (m_segments.size() > 1 && m_segments.front().records == 0) {
+        releaseSegment(m_segments.front(), true);
+        m_segments.pop_front();
+    }
+    while (m_segments.size() >= static_cast<size_t>(m_maxSegments))
+        dropOldest();
+
+    if (!mapSegment(segment, true)) {
+        std::cerr << __FUNCTION__ << ": Unable to create " << segmentPath(segment.sequence) << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    syncSegment(segment);
+
+    // Make the new file itself survive a power cut
+    int dirfd = ::open(m_directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirfd >= 0) {
+        fsync(dirfd);
+        ::close(dirfd);
+    }
+
+    m_segments.push_back(segment);
+    return true;
+}
+
+/**
+ * \func bool DiskQueue::push(const std::string &topic, const uint8_t *payload, size_t size)
+ * \return false if the queue isn't open, the record can't fit in a segment
+ * or a new segment can't be created
+ *
+ * Appends one message. The record is in the page cache when this returns,
+ * safe from a crash of this process; it reaches flash at the next sync.
+ */
+bool DiskQueue::push(const std::string &topic, const uint8_t *payload, size_t size)
+{
+    if (!m_open || topic.size() >= 0xffff)
+        return false;
+
+    uint16_t topicSize = topic.size() + 1;
+    uint32_t payloadSize = size;
+    size_t length = align4(RecordHeaderSize + topicSize + payloadSize);
+    if (length > m_segmentSize - SegmentHeaderSize)
+        return false;
+
+    if (m_segments.empty() || m_segments.back().writeOffset + length > m_segments.back().size) {
+        if (!addSegment())
+            return false;
+    }
+
+    Segment &segment = m_segments.back();
+    uint8_t *record = segment.base + segment.writeOffset;
+
+    uint8_t header[RecordHeaderSize];
+    memcpy(header, &RecordMagic, sizeof(RecordMagic));
+    memcpy(header + 2, &topicSize, sizeof(topicSize));
+    store32(header + 4, payloadSize);
+    uint32_t crc = crc32Update(0, header, 8);
+    crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(topic.c_str()), topicSize);
+    store32(header + 8, crc32Update(crc, payload, payloadSize));
+
+    memcpy(record + RecordHeaderSize, topic.c_str(), topicSize);
+    if (payloadSize)
+        memcpy(record + RecordHeaderSize + topicSize, payload, payloadSize);
+    // The magic goes in last, until then the record reads as the end of the segment
+    memcpy(record + 2, header + 2, RecordHeaderSize - 2);
+    memcpy(record, header, 2);
+
+    if (segment.dirtyStart == segment.dirtyEnd)
+        segment.dirtyStart = segment.writeOffset;
+    segment.dirtyStart = std::min(segment.dirtyStart, segment.writeOffset);
+    segment.writeOffset += length;
+    segment.dirtyEnd = std::max(segment.dirtyEnd, segment.writeOffset);
+    segment.records++;
+    m_records++;
+
+    if (++m_unsynced >= m_syncInterval)
+        sync();
+    return true;
+}
+
+/**
+ * \func size_t DiskQueue::drain(Publisher publish, size_t maxRecords)
+ * \param publish Called with each message in order, returns false to stop
+ * \param maxRecords Most messages to hand over in this call
+ * \return The number of messages published and removed
+ *
+ * A message is only removed once publish accepted it. The new read position
+ * is written once for the whole batch.
+ */
+size_t DiskQueue::drain(Publisher publish, size_t maxRecords)
+{
+    size_t count = 0;
+
+    if (!m_open)
+        return 0;
+
+    while (count < maxRecords && m_records) {
+        Segment &segment = m_segments.front();
+
+        if (segment.records == 0) {
+            releaseSegment(segment, true);
+            m_segments.pop_front();
+            continue;
+        }
+
+        const char *topic;
+        const uint8_t *payload;
+        size_t size;
+        size_t length = recordAt(segment, segment.readOffset, &topic, &payload, &size);
+        if (length == 0) {
+            // Damaged since it was written or recovered, skip what's left of the segment
+            std::cerr << __FUNCTION__ << ": Discarding " << segment.records << " damaged messages" << std::endl;
+            m_discarded += segment.records;
+            m_records -= segment.records;
+            segment.records = 0;
+            segment.readOffset = segment.writeOffset;
+            storeReadOffset(segment);
+            continue;
+        }
+        if (!publish(topic, payload, size))
+            break;
+
+        segment.readOffset += length;
+        segment.records--;
+        m_records--;
+        count++;
+    }
+
+    while (m_segments.size() > 1 && m_segments.front().records == 0) {
+        releaseSegment(m_segments.front(), true);
+        m_segments.pop_front();
+    }
+    if (count)
+        m_full = false;
+    if (count && !m_segments.empty()) {
+        storeReadOffset(m_segments.front());
+        sync();
+    }
+    return count;
+}
+
+void DiskQueue::storeReadOffset(Segment &segment)
+{
+    store32(segment.base + 8, segment.readOffset);
+    if (segment.dirtyStart == segment.dirtyEnd)
+        segment.dirtyEnd = SegmentHeaderSize;
+    segment.dirtyStart = 0;
+}
+
+void DiskQueue::syncSegment(Segment &segment)
+{
+    if (segment.dirtyStart == segment.dirtyEnd)
+        return;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = segment.dirtyStart / page * page;
+    if (msync(segment.base + start, segment.dirtyEnd - start, MS_SYNC) < 0)
+        std::cerr << __FUNCTION__ << ": msync failed: " << strerror(errno) << std::endl;
+    segment.dirtyStart = segment.dirtyEnd = 0;
+}
+
+/**
+ * \func void DiskQueue::sync()
+ *
+ * Writes every dirty page back to flash. push() calls this every
+ * syncInterval records and drain() once per batch.
+ */
+void DiskQueue::sync()
+{
+    for (Segment &segment : m_segments)
+        syncSegment(segment);
+    m_unsynced = 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DISKQUEUE_H
+#define DISKQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+/**
+ * Append-only queue of MQTT messages kept in memory mapped segment files,
+ * for holding readings while the broker cannot be reached.
+ *
+ * Every record carries a CRC, so a record torn by a crash or power cut is
+ * found when the queue is opened and everything from it to the end of its
+ * segment is discarded. Appends only touch the mapping; the dirty pages are
+ * flushed with msync every syncInterval records, not per record, to keep
+ * flash writes down. The read position is stored in each segment's header
+ * and only advanced once per drained batch. Delivery is at least once: a
+ * crash between publishing a batch and recording it repeats that batch.
+ *
+ * The queue is bounded by segment size times segment count. When it is full
+ * the oldest segment is dropped to make room, so push() never blocks and
+ * never fails for lack of space.
+ *
+ * Not thread safe, it belongs to the thread that publishes.
+ */
+class DiskQueue
+{
+public:
+    typedef std::function<bool(const char *topic, const uint8_t *payload, size_t size)> Publisher;
+
+    DiskQueue(const std::string &directory, size_t segmentSize = 64 * 1024, int maxSegments = 16);
+    ~DiskQueue();
+
+    bool open();
+    bool isOpen() const { return m_open; }
+    void close();
+
+    bool push(const std::string &topic, const uint8_t *payload, size_t size);
+    size_t drain(Publisher publish, size_t maxRecords);
+    void sync();
+
+    void setSyncInterval(int records) { m_syncInterval = records > 0 ? records : 1; }
+
+    bool empty() const { return m_records == 0; }
+    size_t size() const { return m_records; }
+    uint64_t dropped() const { return m_dropped; }
+    uint64_t discarded() const { return m_discarded; }
+    size_t maxRecordSize() const;
+
+private:
+    struct Segment {
+        uint32_t sequence;
+        int fd;
+        uint8_t *base;
+        size_t size;
+        size_t readOffset;
+        size_t writeOffset;
+        size_t records;
+        size_t dirtyStart;
+        size_t dirtyEnd;
+    };
+
+    std::string segmentPath(uint32_t sequence) const;
+    bool mapSegment(Segment &segment, bool create);
+    bool addSegment();
+    void recoverSegment(Segment &segment, bool last);
+    void releaseSegment(Segment &segment, bool remove);
+    void dropOldest();
+    void syncSegment(Segment &segment);
+    void storeReadOffset(Segment &segment);
+    size_t recordAt(const Segment &segment, size_t offset, const char **topic, const uint8_t **payload, size_t *size) const;
+
+    std::string m_directory;
+    size_t m_segmentSize;
+    int m_maxSegments;
+    int m_syncInterval;
+    int m_unsynced;
+    bool m_open;
+    bool m_full;
+    size_t m_records;
+    uint64_t m_dropped;
+    uint64_t m_discarded;
+    std::deque<Segment> m_segments;
+};
+
+#endif // DISKQUEUE_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "environment.h"
+
+/**
+ * \func void environmentDocument(nlohmann::json &doc, const EnvironmentReading &reading)
+ * \param doc JSON document to fill in
+ * \param reading The sample to describe
+ * 
+ * Builds the document published on planter/environment. Kept out of main.cpp so the
+ * benchmark suite measures exactly what the device sends.
+ */
+void environmentDocument(nlohmann::json &doc, const EnvironmentReading &reading)
+{
+    doc["location"] = reading.location;
+    doc["system"]["name"] = reading.name;
+    doc["system"]["uptime"] = reading.uptime;
+    doc["light"] = reading.light;
+    doc["environment"]["humidity"] = reading.humidity;
+    doc["environment"]["celsius"] = reading.celsius;
+    doc["environment"]["farenheit"] = reading.celsius * 1.8 + 32;
+    doc["environment"]["confidence"] = reading.confidence;
+}
+
+/**
+ * \func void soilDocument(nlohmann::json &doc, const SoilReading &reading)
+ * \param doc JSON document to fill in
+ * \param reading The probes to describe
+ * 
+ * Builds the document published on planter/soil
+ */
+void soilDocument(nlohmann::json &doc, const SoilReading &reading)
+{
+    doc["location"] = reading.location;
+    doc["system"]["name"] = reading.name;
+    doc["soil"] = nlohmann::json::array();
+    for (const SoilProbeReading &probe : reading.probes) {
+        nlohmann::json entry;
+        entry["channel"] = probe.channel;
+        entry["moisture"] = probe.moisture;
+        entry["raw"] = probe.raw;
+        doc["soil"].push_back(entry);
+    }
+}
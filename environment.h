@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+/**
+ * One environment sample as it is published on planter/environment
+ */
+struct EnvironmentReading {
+    std::string location;
+    std::string name;
+    long uptime;
+    int light;
+    float humidity;
+    float celsius;
+    float confidence;
+};
+
+/**
+ * One soil moisture probe's filtered reading
+ */
+struct SoilProbeReading {
+    int channel;
+    float moisture;     // percent between the probe's dry and wet calibration
+    float raw;          // filtered ADC counts
+};
+
+/**
+ * Every soil probe, as published on planter/soil
+ */
+struct SoilReading {
+    std::string location;
+    std::string name;
+    std::vector<SoilProbeReading> probes;
+};
+
+void environmentDocument(nlohmann::json &doc, const EnvironmentReading &reading);
+void soilDocument(nlohmann::json &doc, const SoilReading &reading);
+
+#endif // ENVIRONMENT_H
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eventloop.h"
+
+static const uint64_t TickNs = 1000000;     // 1ms per slot on the first level
+static const int SlotBits = 6;
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t rotateRight(uint64_t bits, int count)
+{
+    return count ? (bits >> count) | (bits << (64 - count)) : bits;
+}
+
+EventLoop::EventLoop() : m_current(0), m_nextId(1), m_firing(0), m_firingCancelled(false),
+    m_running(false), m_overruns(0), m_wakeups(0)
+{
+    memset(m_wheel, 0, sizeof(m_wheel));
+    memset(m_tail, 0, sizeof(m_tail));
+    memset(m_occupied, 0, sizeof(m_occupied));
+    m_start = monotonicNs();
+
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventFd < 0)
+        std::cerr << __FUNCTION__ << ": Unable to create eventfd: " << strerror(errno) << std::endl;
+}
+
+EventLoop::~EventLoop()
+{
+    if (m_eventFd >= 0)
+        close(m_eventFd);
+}
+
+/**
+ * \func uint64_t EventLoop::now() const
+ * \return ns on CLOCK_MONOTONIC since the loop was created
+ */
+uint64_t EventLoop::now() const
+{
+    return monotonicNs() - m_start;
+}
+
+/**
+ * \func EventLoop::TimerId EventLoop::after(std::chrono::milliseconds delay, Task task)
+ * \return An id for cancel(), never 0
+ *
+ * Runs task once, delay from now
+ */
+EventLoop::TimerId EventLoop::after(std::chrono::milliseconds delay, Task task)
+{
+    uint64_t ns = delay.count() > 0 ? static_cast<uint64_t>(delay.count()) * TickNs : 0;
+    return addTimer(now() + ns, 0, task);
+}
+
+/**
+ * \func EventLoop::TimerId EventLoop::every(std::chrono::milliseconds period, Task task, std::chrono::milliseconds first)
+ * \param period Time between the starts of two runs, at least 1ms
+ * \param first Delay before the first run, 0 to run on the next pass
+ * \return An id for cancel(), never 0
+ */
+EventLoop::TimerId EventLoop::every(std::chrono::milliseconds period, Task task, std::chrono::milliseconds first)
+{
+    uint64_t periodNs = period.count() > 0 ? static_cast<uint64_t>(period.count()) * TickNs : TickNs;
+    uint64_t firstNs = first.count() > 0 ? static_cast<uint64_t>(first.count()) * TickNs : 0;
+    return addTimer(now() + firstNs, periodNs, task);
+}
+
+EventLoop::TimerId EventLoop::addTimer(uint64_t deadline, uint64_t period, Task task)
+{
+    std::unique_ptr<Timer> timer(new Timer());
+
+    timer->id = m_nextId++;
+    timer->deadline = deadline;
+    timer->period = period;
+    timer->tick = std::max((deadline + TickNs - 1) / TickNs, m_current + 1);
+    timer->task = task;
+    timer->level = -1;
+    timer->cancelled = false;
+    insert(timer.get());
+
+    TimerId id = timer->id;
+    m_timers[id] = std::move(timer);
+    return id;
+}
+
+/**
+ * \func bool EventLoop::cancel(TimerId id)
+ * \return false if there is no such timer, or it was a one-shot that already ran
+ *
+ * Safe from inside any task, including the one being cancelled.
+ */
+bool EventLoop::cancel(TimerId id)
+{
+    auto it = m_timers.find(id);
+    if (it == m_timers.end() || it->second->cancelled)
+        return false;
+
+    Timer *timer = it->second.get();
+    if (timer->level >= 0)
+        unlink(timer);
+    if (id == m_firing) {
+        // Still running, fire() frees it when the task returns
+        timer->cancelled = true;
+        m_firingCancelled = true;
+        return true;
+    }
+    m_timers.erase(it);
+    return true;
+}
+
+/**
+ * Files a timer on the lowest level whose slots reach its tick. A level's
+ * slots cover 63 of its units past the current one, so a slot is never
+ * reused before it has been processed. Anything beyond the top level goes
+ * in its furthest slot and is filed again when that slot cascades.
+ */
+void EventLoop::insert(Timer *timer)
+{
+    int level = Levels - 1;
+    int slot = ((m_current >> (SlotBits * level)) + Slots - 1) & (Slots - 1);
+
+    for (int k = 0; k < Levels; k++) {
+        uint64_t shift = SlotBits * k;
+        if ((timer->tick >> shift) - (m_current >> shift) < Slots) {
+            level = k;
+            slot = (timer->tick >> shift) & (Slots - 1);
+            break;
+        }
+    }
+
+    // Appended, so timers due on the same tick run in the order they were added
+    timer->level = level;
+    timer->slot = slot;
+    timer->next = NULL;
+    timer->prev = m_tail[level][slot];
+    if (timer->prev)
+        timer->prev->next = timer;
+    else
+        m_wheel[level][slot] = timer;
+    m_tail[level][slot] = timer;
+    m_occupied[level] |= 1ull << slot;
+}
+
+void EventLoop::unlink(Timer *timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        m_wheel[timer->level][timer->slot] = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    else
+        m_tail[timer->level][timer->slot] = timer->prev;
+    if (m_wheel[timer->level][timer->slot] == NULL)
+        m_occupied[timer->level] &= ~(1ull << timer->slot);
+    timer->level = -1;
+}
+
+/**
+ * Finds the next tick with anything to do: a first level slot to expire, or
+ * a higher level slot to cascade. The occupancy bitmaps make this a few
+ * rotates and bit scans, however many timers there are.
+ */
+bool EventLoop::nextTick(uint64_t &tick) const
+{
+    bool found = false;
+
+    for (int k = 0; k < Levels; k++) {
+        if (m_occupied[k] == 0)
+            continue;
+        uint64_t shift = SlotBits * k;
+        uint64_t base = (m_current >> shift) + 1;
+        uint64_t bits = rotateRight(m_occupied[k], base & (Slots - 1));
+        uint64_t candidate = (base + __builtin_ctzll(bits)) << shift;
+        if (!found || candidate < tick)
+            tick = candidate;
+        found = true;
+    }
+    return found;
+}
+
+/**
+ * Processes every tick up to target that has work, skipping the rest
+ */
+void EventLoop::advance(uint64_t target)
+{
+    uint64_t tick;
+
+    while (nextTick(tick) && tick <= target) {
+        m_current = tick;
+        for (int k = Levels - 1; k > 0; k--) {
+            uint64_t mask = (1ull << (SlotBits * k)) - 1;
+            if ((tick & mask) == 0)
+                cascade(k, (tick >> (SlotBits * k)) & (Slots - 1));
+        }
+        expire(tick & (Slots - 1));
+    }
+    if (target > m_current)
+        m_current = target;
+}
+
+void EventLoop::cascade(int level, int slot)
+{
+    Timer *timer = m_wheel[level][slot];
+
+    m_wheel[level][slot] = NULL;
+    m_tail[level][slot] = NULL;
+    m_occupied[level] &= ~(1ull << slot);
+    while (timer) {
+        Timer *next = timer->next;
+        insert(timer);
+        timer = next;
+    }
+}
+
+void EventLoop::expire(int slot)
+{
+    // One at a time, a task may cancel or add timers in this same slot
+    while (m_wheel[0][slot]) {
+        Timer *timer = m_wheel[0][slot];
+        unlink(timer);
+        fire(timer);
+    }
+}
+
+void EventLoop::fire(Timer *timer)
+{
+    TimerId id = timer->id;
+
+    if (timer->period) {
+        uint64_t current = now();
+        uint64_t next = timer->deadline + timer->period;
+        if (next <= current) {
+            uint64_t missed = (current - timer->deadline) / timer->period;
+            m_overruns += missed;
+            next = timer->deadline + (missed + 1) * timer->period;
+        }
+        timer->deadline = next;
+        timer->tick = std::max((next + TickNs - 1) / TickNs, m_current + 1);
+        insert(timer);
+    }
+
+    m_firing = id;
+    m_firingCancelled = false;
+    timer->task();
+    m_firing = 0;
+
+    if (!timer->period || m_firingCancelled)
+        m_timers.erase(id);
+}
+
+/**
+ * \func void EventLoop::wake()
+ *
+ * Makes the loop run its wake handler as soon as it can. Safe from any
+ * thread; several calls before the loop gets to it run the handler once.
+ */
+void EventLoop::wake()
+{
+    uint64_t one = 1;
+    if (write(m_eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        std::cerr << __FUNCTION__ << ": " << strerror(errno) << std::endl;
+}
+
+void EventLoop::drainWake()
+{
+    uint64_t count;
+
+    if (read(m_eventFd, &count, sizeof(count)) != sizeof(count))
+        return;
+    m_wakeups++;
+    if (m_wakeHandler)
+        m_wakeHandler();
+}
+
+/**
+ * \func bool EventLoop::runOnce(int maxWaitMs)
+ * \param maxWaitMs Longest time to sleep, -1 to wait for the next deadline or wake()
+ * \return false if waiting failed
+ *
+ * Runs what is due, sleeps until the next deadline or a wake(), then runs
+ * what became due during the sleep.
+ */
+bool EventLoop::runOnce(int maxWaitMs)
+{
+    struct pollfd fd = { m_eventFd, POLLIN, 0 };
+    struct timespec timeout;
+    struct timespec *wait = NULL;
+    uint64_t tick;
+
+    advance(now() / TickNs);
+
+    if (nextTick(tick)) {
+        uint64_t current = now();
+        uint64_t ns = tick * TickNs > current ? tick * TickNs - current : 0;
+        if (maxWaitMs >= 0 && ns > static_cast<uint64_t>(maxWaitMs) * TickNs)
+            ns = static_cast<uint64_t>(maxWaitMs) * TickNs;
+        timeout.tv_sec = ns / 1000000000;
+        timeout.tv_nsec = ns % 1000000000;
+        wait = &timeout;
+    }
+    else if (maxWaitMs >= 0) {
+        timeout.tv_sec = maxWaitMs / 1000;
+        timeout.tv_nsec = (maxWaitMs % 1000) * 1000000L;
+        wait = &timeout;
+    }
+
+    int rc = ppoll(&fd, 1, wait, NULL);
+    if (rc < 0 && errno != EINTR) {
+        std::cerr << __FUNCTION__ << ": ppoll failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (rc > 0 && (fd.revents & POLLIN))
+        drainWake();
+
+    advance(now() / TickNs);
+    return true;
+}
+
+/**
+ * \func void EventLoop::run()
+ *
+ * Runs tasks until stop() is called from one of them
+ */
+void EventLoop::run()
+{
+    m_running = true;
+    while (m_running) {
+        if (!runOnce())
+            break;
+    }
+}
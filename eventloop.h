@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * Single threaded scheduler for the main loop. Tasks run once after a delay
+ * or periodically. Periods are kept against CLOCK_MONOTONIC from the first
+ * deadline, not from when the task last finished, so they don't drift; a
+ * task that falls more than a period behind skips the missed runs.
+ *
+ * Timers live in a hierarchical timing wheel: four levels of 64 slots, the
+ * first at 1ms per slot and each level 64 times coarser than the one before,
+ * which covers 4.6 hours before timers have to be re-filed. Deadlines are
+ * rounded up to the next millisecond. Adding and cancelling are O(1). Between tasks the loop sleeps in ppoll() until the
+ * next deadline; there is no periodic tick. wake() is the one call that is
+ * safe from other threads. It interrupts the sleep through an eventfd and
+ * runs the wake handler on the loop's thread.
+ */
+class EventLoop
+{
+public:
+    typedef uint64_t TimerId;
+    typedef std::function<void()> Task;
+
+    static constexpr int Levels = 4;
+    static constexpr int Slots = 64;
+
+    EventLoop();
+    ~EventLoop();
+
+    TimerId after(std::chrono::milliseconds delay, Task task);
+    TimerId every(std::chrono::milliseconds period, Task task, std::chrono::milliseconds first = std::chrono::milliseconds(0));
+    bool cancel(TimerId id);
+    bool pending(TimerId id) const { return m_timers.count(id) != 0; }
+
+    void setWakeHandler(Task task) { m_wakeHandler = task; }
+    void wake();
+
+    void run();
+    bool runOnce(int maxWaitMs = -1);
+    void stop() { m_running = false; }
+
+    uint64_t now() const;
+    uint64_t overruns() const { return m_overruns; }
+    uint64_t wakeups() const { return m_wakeups; }
+
+private:
+    struct Timer {
+        TimerId id;
+        uint64_t deadline;      // ns since the loop was created
+        uint64_t period;        // ns, 0 for a one-shot
+        uint64_t tick;
+        Task task;
+        Timer *prev;
+        Timer *next;
+        int level;
+        int slot;
+        bool cancelled;
+    };
+
+    TimerId addTimer(uint64_t deadline, uint64_t period, Task task);
+    void insert(Timer *timer);
+    void unlink(Timer *timer);
+    bool nextTick(uint64_t &tick) const;
+    void advance(uint64_t target);
+    void cascade(int level, int slot);
+    void expire(int slot);
+    void fire(Timer *timer);
+    void drainWake();
+
+    Timer *m_wheel[Levels][Slots];
+    Timer *m_tail[Levels][Slots];
+    uint64_t m_occupied[Levels];
+    uint64_t m_current;         // last tick processed
+    uint64_t m_start;           // CLOCK_MONOTONIC ns at tick 0
+    std::unordered_map<TimerId, std::unique_ptr<Timer>> m_timers;
+    TimerId m_nextId;
+    TimerId m_firing;
+    bool m_firingCancelled;
+    int m_eventFd;
+    bool m_running;
+    Task m_wakeHandler;
+    uint64_t m_overruns;
+    uint64_t m_wakeups;
+};
+
+#endif // EVENTLOOP_H
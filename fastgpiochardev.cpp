@@ -0,0 +1,298 @@
+#include <fastgpiochardev.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+static uint64_t monotonicNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+FastGpioChardev::FastGpioChardev(const char *chipPath)
+{
+	chipFd 	= -1;
+
+	// the simulator stands in for the chip when it is installed
+	if (backend != NULL)
+	{
+		simGpio.reset(new FastGpioOmega2());
+	}
+	else
+	{
+		chipFd = open(chipPath, O_RDWR | O_CLOEXEC);
+		if (chipFd < 0 && verbosityLevel > 0)
+		{
+			printf("Unable to open %s: %s\n", chipPath, strerror(errno));
+		}
+	}
+}
+
+FastGpioChardev::~FastGpioChardev(void)
+{
+	// releasing a line returns it to the kernel
+	for (std::map<int, Line>::iterator it = lines.begin(); it != lines.end(); ++it)
+	{
+		close(it->second.fd);
+	}
+	if (chipFd >= 0)
+	{
+		close(chipFd);
+	}
+}
+
+// request the line with the given flags, or change the flags of a line we already hold
+int FastGpioChardev::_Configure(int pinNum, uint64_t flags)
+{
+	struct gpio_v2_line_config 	config;
+	std::map<int, Line>::iterator 	it;
+	int 	value;
+
+	it 		= lines.find(pinNum);
+	value 	= (it != lines.end() ? it->second.value : 0);
+
+	memset(&config, 0, sizeof(config));
+	config.flags 	= flags;
+	if (flags & GPIO_V2_LINE_FLAG_OUTPUT)
+	{
+		// the level to drive as soon as the line turns into an output
+		config.num_attrs 					= 1;
+		config.attrs[0].attr.id 			= GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		config.attrs[0].attr.values 		= (value ? 1 : 0);
+		config.attrs[0].mask 				= 1;
+	}
+
+	if (it != lines.end())
+	{
+		if (ioctl(it->second.fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+		{
+			return (EXIT_FAILURE);
+		}
+		it->second.flags 	= flags;
+		return (EXIT_SUCCESS);
+	}
+
+	struct gpio_v2_line_request 	request;
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] 			= pinNum;
+	request.num_lines 			= 1;
+	request.config 				= config;
+	request.event_buffer_size 	= GPIO_CHARDEV_EVENT_BUFFER;
+	strncpy(request.consumer, GPIO_CHARDEV_CONSUMER, sizeof(request.consumer) - 1);
+
+	if (chipFd < 0 || ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0)
+	{
+		if (verbosityLevel > 0) printf("Unable to request line %d: %s\n", pinNum, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	Line 	line;
+	line.fd 	= request.fd;
+	line.flags 	= flags;
+	line.value 	= value;
+	lines[pinNum] 	= line;
+
+	return (EXIT_SUCCESS);
+}
+
+// public functions
+int FastGpioChardev::SetDirection(int pinNum, int bOutput)
+{
+	if (backend != NULL)
+	{
+		return simGpio->SetDirection(pinNum, bOutput);
+	}
+
+	return _Configure(pinNum, (bOutput ? GPIO_V2_LINE_FLAG_OUTPUT : GPIO_V2_LINE_FLAG_INPUT));
+}
+
+int FastGpioChardev::GetDirection(int pinNum, int &bOutput)
+{
+	if (backend != NULL)
+	{
+		return simGpio->GetDirection(pinNum, bOutput);
+	}
+
+	std::map<int, Line>::iterator 	it = lines.find(pinNum);
+	bOutput = (it != lines.end() && (it->second.flags & GPIO_V2_LINE_FLAG_OUTPUT) ? 1 : 0);
+
+	return (EXIT_SUCCESS);
+}
+
+int FastGpioChardev::Set(int pinNum, int value)
+{
+	if (backend != NULL)
+	{
+		return simGpio->Set(pinNum, value);
+	}
+
+	std::map<int, Line>::iterator 	it = lines.find(pinNum);
+	if (it == lines.end())
+	{
+		// request the line as an input, the level is driven once it becomes an output
+		if (_Configure(pinNum, GPIO_V2_LINE_FLAG_INPUT) != EXIT_SUCCESS)
+		{
+			return (EXIT_FAILURE);
+		}
+		it = lines.find(pinNum);
+	}
+
+	it->second.value 	= (value ? 1 : 0);
+	if (!(it->second.flags & GPIO_V2_LINE_FLAG_OUTPUT))
+	{
+		return (EXIT_SUCCESS);
+	}
+
+	struct gpio_v2_line_values 	values;
+	values.bits 	= (value ? 1 : 0);
+	values.mask 	= 1;
+	if (ioctl(it->second.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+	{
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+int FastGpioChardev::Read(int pinNum, int &value)
+{
+	if (backend != NULL)
+	{
+		return simGpio->Read(pinNum, value);
+	}
+
+	std::map<int, Line>::iterator 	it = lines.find(pinNum);
+	if (it == lines.end())
+	{
+		if (_Configure(pinNum, GPIO_V2_LINE_FLAG_INPUT) != EXIT_SUCCESS)
+		{
+			return (EXIT_FAILURE);
+		}
+		it = lines.find(pinNum);
+	}
+
+	struct gpio_v2_line_values 	values;
+	values.bits 	= 0;
+	values.mask 	= 1;
+	if (ioctl(it->second.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+	{
+		return (EXIT_FAILURE);
+	}
+	value 	= (int)(values.bits & 0x1);
+
+	return (EXIT_SUCCESS);
+}
+
+int FastGpioChardev::WatchEdges(int pinNum)
+{
+	if (backend != NULL)
+	{
+		int 	level;
+		simGpio->SetDirection(pinNum, 0);
+		simGpio->Read(pinNum, level);
+		simLevels[pinNum] 	= level;
+		return (EXIT_SUCCESS);
+	}
+
+	// timestamps default to CLOCK_MONOTONIC
+	return _Configure(pinNum, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING);
+}
+
+int FastGpioChardev::ReadEdges(int pinNum, GpioEdgeEvent *events, int maxEvents, uint64_t timeoutNs)
+{
+	if (events == NULL || maxEvents <= 0)
+	{
+		return -1;
+	}
+
+	if (backend != NULL)
+	{
+		// no interrupts in the simulator, poll until the level changes
+		std::map<int, int>::iterator 	it = simLevels.find(pinNum);
+		if (it == simLevels.end())
+		{
+			return -1;
+		}
+		uint64_t 	deadline 	= monotonicNs() + timeoutNs;
+		int 		level;
+		for (;;)
+		{
+			simGpio->Read(pinNum, level);
+			uint64_t 	now 	= monotonicNs();
+			if (level != it->second)
+			{
+				it->second 				= level;
+				events[0].timestampNs 	= now;
+				events[0].level 		= level;
+				return 1;
+			}
+			if (now >= deadline)
+			{
+				return 0;
+			}
+		}
+	}
+
+	std::map<int, Line>::iterator 	it = lines.find(pinNum);
+	if (it == lines.end())
+	{
+		return -1;
+	}
+
+	struct pollfd 		pfd;
+	struct timespec 	timeout;
+	uint64_t 			deadline 	= monotonicNs() + timeoutNs;
+	uint64_t 			remaining 	= timeoutNs;
+	int 				ready;
+	pfd.fd 			= it->second.fd;
+	pfd.events 		= POLLIN;
+
+	// a signal is not the end of the wait, the caller takes 0 as the frame being over
+	for (;;)
+	{
+		pfd.revents 	= 0;
+		timeout.tv_sec 	= remaining / 1000000000ull;
+		timeout.tv_nsec = remaining % 1000000000ull;
+
+		ready 	= ppoll(&pfd, 1, &timeout, NULL);
+		if (ready >= 0 || errno != EINTR)
+		{
+			break;
+		}
+
+		uint64_t 	now 	= monotonicNs();
+		if (now >= deadline)
+		{
+			return 0;
+		}
+		remaining 	= deadline - now;
+	}
+	if (ready <= 0)
+	{
+		return (ready == 0) ? 0 : -1;
+	}
+
+	// everything queued so far, up to what the caller has room for
+	struct gpio_v2_line_event 	buffer[32];
+	int 	want 	= (maxEvents < 32 ? maxEvents : 32);
+	ssize_t bytes 	= read(it->second.fd, buffer, want * sizeof(buffer[0]));
+	if (bytes < 0)
+	{
+		return -1;
+	}
+
+	int 	count 	= (int)(bytes / sizeof(buffer[0]));
+	int 	i;
+	for (i = 0; i < count; i++)
+	{
+		events[i].timestampNs 	= buffer[i].timestamp_ns;
+		events[i].level 		= (buffer[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ? 1 : 0);
+	}
+
+	return count;
+}
@@ -0,0 +1,66 @@
+#ifndef _FAST_GPIO_CHARDEV_H_
+#define _FAST_GPIO_CHARDEV_H_
+
+#include <fastgpio.h>
+#include <fastgpioomega2.h>
+
+#include <map>
+#include <memory>
+
+#define GPIO_CHARDEV_DEFAULT_CHIP		"/dev/gpiochip0"
+#define GPIO_CHARDEV_CONSUMER			"planter"
+// edges the kernel queues per line before it starts dropping them, a DHT frame is 84
+#define GPIO_CHARDEV_EVENT_BUFFER		256
+
+// one edge reported for a watched line
+struct GpioEdgeEvent {
+	uint64_t 	timestampNs;	// CLOCK_MONOTONIC, stamped by the kernel in the interrupt handler
+	int 		level;			// level of the line after the edge
+};
+
+// GPIO through the Linux character device (uAPI v2) instead of /dev/mem. Needs no root
+// register access, and edges on a watched line are queued and timestamped by the kernel, so
+// nothing has to poll the line. Pin numbers are line offsets on the chip.
+//
+// When a RegisterBackend is installed (see Module::SetRegisterBackend) the lines are served
+// by the simulated Omega2 registers instead, and edges are found by polling them.
+class FastGpioChardev : public FastGpio {
+public:
+	FastGpioChardev(const char *chipPath = GPIO_CHARDEV_DEFAULT_CHIP);
+	~FastGpioChardev(void);
+
+	// false when the chip could not be opened and no backend is installed
+	bool 	IsOpen 			(void) { return (chipFd >= 0 || backend != NULL); }
+
+	int 	SetDirection	(int pinNum, int bOutput);
+	int 	GetDirection 	(int pinNum, int &bOutput);
+
+	int 	Set 			(int pinNum, int value);
+	int 	Read 			(int pinNum, int &value);
+
+	// switch the pin to input and queue every edge on it from now on, until the
+	// next SetDirection
+	int 	WatchEdges 		(int pinNum);
+	// wait up to timeoutNs for edges on a watched pin; returns the number stored
+	// in events, 0 on timeout, -1 on error. Signals don't cut the wait short.
+	int 	ReadEdges 		(int pinNum, GpioEdgeEvent *events, int maxEvents, uint64_t timeoutNs);
+
+private:
+	struct Line {
+		int 		fd;
+		uint64_t 	flags;
+		int 		value;		// output level, kept while the line is an input
+	};
+
+	int 	_Configure 		(int pinNum, uint64_t flags);
+
+	int 					chipFd;
+	std::map<int, Line> 	lines;
+
+	// simulated registers, only created when a backend is installed
+	std::unique_ptr<FastGpioOmega2> 	simGpio;
+	std::map<int, int> 		simLevels;
+};
+
+
+#endif 	// _FAST_GPIO_CHARDEV_H_
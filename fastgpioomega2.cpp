@@ -6,6 +6,11 @@ FastGpioOmega2::FastGpioOmega2(void)
 	_SetupAddress(REG_BLOCK_ADDR, REG_BLOCK_SIZE);
 }
 
+FastGpioOmega2::FastGpioOmega2(const char *device, uint32_t blockBaseAddr)
+{
+	_SetupAddress(blockBaseAddr, REG_BLOCK_SIZE, device);
+}
+
 FastGpioOmega2::~FastGpioOmega2(void)
 {
 	// nothing for now
@@ -35,17 +40,17 @@ void FastGpioOmega2::setGpioOffset(int gpio){
 // public functions
 int FastGpioOmega2::SetDirection(int pinNum, int bOutput)
 {
-	unsigned long int regVal;
+	uint32_t regVal;
 	setGpioOffset(pinNum);
 	int gpio;
 	gpio = pinNum % 32;
 	// read the current input and output settings
 	regVal = _ReadReg(ctrlOffset);
-	if (verbosityLevel > 0) printf("Direction setting read: 0x%08lx\n", regVal);
+	if (verbosityLevel > 0) printf("Direction setting read: 0x%08" PRIx32 "\n", regVal);
 
 	// set the OE for this pin
 	_SetBit(regVal, gpio, bOutput);
-	if (verbosityLevel > 0) printf("Direction setting write: 0x%08lx\n", regVal);
+	if (verbosityLevel > 0) printf("Direction setting write: 0x%08" PRIx32 "\n", regVal);
 
 	// write the new register value
 	_WriteReg(ctrlOffset, regVal);
@@ -56,13 +61,13 @@ int FastGpioOmega2::SetDirection(int pinNum, int bOutput)
 
 int FastGpioOmega2::GetDirection(int pinNum, int &bOutput)
 {
-	unsigned long int regVal;
+	uint32_t regVal;
 	setGpioOffset(pinNum);
 	int gpio;
 	gpio = pinNum % 32;
 	// read the current input and output settings
 	regVal 	= _ReadReg(ctrlOffset);
-	if (verbosityLevel > 0) printf("Direction setting read: 0x%08lx\n", regVal);
+	if (verbosityLevel > 0) printf("Direction setting read: 0x%08" PRIx32 "\n", regVal);
 
 	bOutput = _GetBit(regVal, gpio);
 
@@ -71,8 +76,8 @@ int FastGpioOmega2::GetDirection(int pinNum, int &bOutput)
 
 int FastGpioOmega2::Set(int pinNum, int value)
 {
-	unsigned long int 	regAddr;
-	unsigned long int 	regVal;
+	uint32_t 	regAddr;
+	uint32_t 	regVal;
 	setGpioOffset(pinNum);
 	int gpio;
 	gpio = pinNum % 32;
@@ -87,7 +92,7 @@ int FastGpioOmega2::Set(int pinNum, int value)
 	}
 
 	// put the desired pin value into the register 
-	regVal = (0x1 << gpio);
+	regVal = (0x1u << gpio);
 
 	// write to the register
 	_WriteReg (regAddr, regVal);
@@ -97,7 +102,7 @@ int FastGpioOmega2::Set(int pinNum, int value)
 
 int FastGpioOmega2::Read(int pinNum, int &value)
 {
-	unsigned long int 	regVal;
+	uint32_t 	regVal;
 	setGpioOffset(pinNum);
 	int gpio;
 	gpio = pinNum % 32;
@@ -108,5 +113,49 @@ int FastGpioOmega2::Read(int pinNum, int &value)
 	value 	= _GetBit(regVal, gpio);
 
 
+	return EXIT_SUCCESS;
+}
+
+int FastGpioOmega2::SetDirectionMask(int bank, uint32_t mask, int bOutput)
+{
+	uint32_t 	regVal;
+	setGpioOffset(bank * 32);
+
+	// read the current input and output settings
+	regVal = _ReadReg(ctrlOffset);
+	if (verbosityLevel > 0) printf("Direction setting read: 0x%08" PRIx32 "\n", regVal);
+
+	// set the OE for all pins in the mask
+	if (bOutput) {
+		regVal |= mask;
+	}
+	else {
+		regVal &= ~mask;
+	}
+	if (verbosityLevel > 0) printf("Direction setting write: 0x%08" PRIx32 "\n", regVal);
+
+	// write the new register value
+	_WriteReg(ctrlOffset, regVal);
+
+	return (EXIT_SUCCESS);
+}
+
+int FastGpioOmega2::SetMask(int bank, uint32_t mask, int value)
+{
+	setGpioOffset(bank * 32);
+
+	// the set and clear registers only touch the pins whose bits are written
+	_WriteReg ((value == 0 ? dataClrOffset : dataSetOffset), mask);
+
+	return EXIT_SUCCESS;
+}
+
+int FastGpioOmega2::ReadBank(int bank, uint32_t &value)
+{
+	setGpioOffset(bank * 32);
+
+	// read the current value of all pins in the bank
+	value 	= _ReadReg (dataOffset);
+
 	return EXIT_SUCCESS;
 }
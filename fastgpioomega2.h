@@ -45,6 +45,9 @@
 class FastGpioOmega2 : public FastGpio {
 public:
 	FastGpioOmega2(void);
+	// maps blockBaseAddr of device instead of the registers in /dev/mem, to exercise
+	// the mapping off hardware (a shared /dev/zero mapping only reads from offset 0)
+	FastGpioOmega2(const char *device, uint32_t blockBaseAddr);
 	~FastGpioOmega2(void);
 
 	int 	SetDirection	(int pinNum, int bOutput);
@@ -53,6 +56,11 @@ public:
 	int 	Set 			(int pinNum, int value);
 	int 	Read 			(int pinNum, int &value);
 
+	// operate on every pin of a 32 pin bank selected by mask at once
+	int 	SetDirectionMask(int bank, uint32_t mask, int bOutput);
+	int 	SetMask 		(int bank, uint32_t mask, int value);
+	int 	ReadBank 		(int bank, uint32_t &value);
+
 private:
 	// private functions
 	int 	pinNumber;
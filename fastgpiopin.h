@@ -0,0 +1,134 @@
+#ifndef _FAST_GPIO_PIN_H_
+#define _FAST_GPIO_PIN_H_
+
+#include <fastgpioomega2.h>
+
+// Register access policies for the pin accessors below. Both are cheap to copy
+// and resolve at compile time, so a pin read on hardware is one volatile load.
+
+// Straight to the /dev/mem mapping
+class GpioMmioAccess {
+public:
+	explicit GpioMmioAccess(volatile uint32_t *base) : base(base) {}
+
+	inline uint32_t	Load 	(uint32_t registerOffset) const 			{ return base[registerOffset]; }
+	inline void 	Store 	(uint32_t registerOffset, uint32_t value) const	{ base[registerOffset] = value; }
+
+private:
+	volatile uint32_t 	*base;
+};
+
+// Through a RegisterBackend, used with the simulator
+class GpioBackendAccess {
+public:
+	explicit GpioBackendAccess(RegisterBackend *backend) : backend(backend) {}
+
+	inline uint32_t	Load 	(uint32_t registerOffset) const 			{ return backend->Read(registerOffset); }
+	inline void 	Store 	(uint32_t registerOffset, uint32_t value) const	{ backend->Write(registerOffset, value); }
+
+private:
+	RegisterBackend 	*backend;
+};
+
+// Omega2 GPIO with the pin number known at compile time. Bank, register offsets
+// and mask are constants, there are no virtual calls, divisions or branches.
+template <int N, class Access = GpioMmioAccess>
+class FastGpioPin {
+public:
+	static_assert(N >= 0 && N < 96, "Omega2 GPIOs are numbered 0 to 95");
+
+	static constexpr int 		bank 			= N / 32;
+	static constexpr uint32_t 	mask 			= 1u << (N % 32);
+	static constexpr uint32_t 	ctrlOffset 		= REGISTER_CTRL0_OFFSET + bank;
+	static constexpr uint32_t 	dataOffset 		= REGISTER_DATA0_OFFSET + bank;
+	static constexpr uint32_t 	dataSetOffset 	= REGISTER_DSET0_OFFSET + bank;
+	static constexpr uint32_t 	dataClrOffset 	= REGISTER_DCLR0_OFFSET + bank;
+
+	explicit FastGpioPin(Access access) : access(access) {}
+
+	inline int 		Read 			(void) const 	{ return (access.Load(dataOffset) & mask) != 0; }
+	inline void 	Set 			(int value) const
+	{
+		access.Store((value ? dataSetOffset : dataClrOffset), mask);
+	}
+	inline void 	SetDirection 	(int bOutput) const
+	{
+		uint32_t regVal = access.Load(ctrlOffset);
+		access.Store(ctrlOffset, (bOutput ? (regVal | mask) : (regVal & ~mask)));
+	}
+
+private:
+	Access 		access;
+};
+
+// Same operations for a pin only known at run time. Offsets and mask are worked
+// out once in the constructor, so reads are still one load plus a mask.
+template <class Access = GpioMmioAccess>
+class FastGpioRuntimePin {
+public:
+	FastGpioRuntimePin(int pinNum, Access access) :
+		mask 			(1u << (pinNum % 32)),
+		ctrlOffset 		(REGISTER_CTRL0_OFFSET + pinNum / 32),
+		dataOffset 		(REGISTER_DATA0_OFFSET + pinNum / 32),
+		dataSetOffset 	(REGISTER_DSET0_OFFSET + pinNum / 32),
+		dataClrOffset 	(REGISTER_DCLR0_OFFSET + pinNum / 32),
+		access 			(access)
+	{}
+
+	inline int 		Read 			(void) const 	{ return (access.Load(dataOffset) & mask) != 0; }
+	inline void 	Set 			(int value) const
+	{
+		access.Store((value ? dataSetOffset : dataClrOffset), mask);
+	}
+	inline void 	SetDirection 	(int bOutput) const
+	{
+		uint32_t regVal = access.Load(ctrlOffset);
+		access.Store(ctrlOffset, (bOutput ? (regVal | mask) : (regVal & ~mask)));
+	}
+
+private:
+	const uint32_t 	mask;
+	const uint32_t 	ctrlOffset;
+	const uint32_t 	dataOffset;
+	const uint32_t 	dataSetOffset;
+	const uint32_t 	dataClrOffset;
+	Access 			access;
+};
+
+// A group of pins in one 32 pin bank, selected by mask. Read samples all of them
+// with a single load and returns their bits in place; Set and SetDirection apply
+// to every pin in the mask. Same interface as the single pin accessors, so the
+// same capture code drives one sensor or a whole bank.
+template <class Access = GpioMmioAccess>
+class FastGpioBank {
+public:
+	FastGpioBank(int bank, uint32_t mask, Access access) :
+		mask 			(mask),
+		ctrlOffset 		(REGISTER_CTRL0_OFFSET + bank),
+		dataOffset 		(REGISTER_DATA0_OFFSET + bank),
+		dataSetOffset 	(REGISTER_DSET0_OFFSET + bank),
+		dataClrOffset 	(REGISTER_DCLR0_OFFSET + bank),
+		access 			(access)
+	{}
+
+	inline uint32_t	Read 			(void) const 	{ return access.Load(dataOffset) & mask; }
+	inline void 	Set 			(int value) const
+	{
+		access.Store((value ? dataSetOffset : dataClrOffset), mask);
+	}
+	inline void 	SetDirection 	(int bOutput) const
+	{
+		uint32_t regVal = access.Load(ctrlOffset);
+		access.Store(ctrlOffset, (bOutput ? (regVal | mask) : (regVal & ~mask)));
+	}
+
+private:
+	const uint32_t 	mask;
+	const uint32_t 	ctrlOffset;
+	const uint32_t 	dataOffset;
+	const uint32_t 	dataSetOffset;
+	const uint32_t 	dataClrOffset;
+	Access 			access;
+};
+
+#endif 	// _FAST_GPIO_PIN_H_
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "i2cbus.h"
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+I2cDevBus::I2cDevBus(const std::string &path) : m_path(path), m_fd(-1), m_address(-1)
+{
+}
+
+I2cDevBus::~I2cDevBus()
+{
+    close();
+}
+
+/**
+ * \func bool I2cDevBus::open()
+ * \return false if the adapter could not be opened
+ */
+bool I2cDevBus::open()
+{
+    if (m_fd >= 0)
+        return true;
+
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (m_fd < 0) {
+        std::cerr << __PRETTY_FUNCTION__ << ": Unable to open " << m_path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_address = -1;
+    return true;
+}
+
+void I2cDevBus::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+    m_address = -1;
+}
+
+/**
+ * \func int I2cDevBus::transfer(uint8_t address, std::vector<I2cMessage> &messages)
+ * \param address 7 bit device address
+ * \param messages Writes and reads, in order
+ * \return 0, or a negative errno from the first message that failed
+ *
+ * The device is only selected again when it changes, which saves an ioctl
+ * per transaction when the same device is talked to repeatedly.
+ */
+int I2cDevBus::transfer(uint8_t address, std::vector<I2cMessage> &messages)
+{
+    if (m_fd < 0)
+        return -ENODEV;
+
+    if (m_address != address) {
+        if (ioctl(m_fd, I2C_SLAVE, address) < 0) {
+            m_address = -1;
+            return -errno;
+        }
+        m_address = address;
+    }
+
+    for (I2cMessage &message : messages) {
+        ssize_t rc;
+        if (message.read)
+            rc = ::read(m_fd, message.data.data(), message.data.size());
+        else
+            rc = ::write(m_fd, message.data.data(), message.data.size());
+
+        if (rc < 0)
+            return -errno;
+        if (static_cast<size_t>(rc) != message.data.size())
+            return -EIO;
+    }
+    return 0;
+}
+
+/**
+ * \func I2cScheduler::I2cScheduler(I2cTransport &bus)
+ * \param bus Where transactions go, it must outlive the scheduler
+ *
+ * Starts the thread that runs the queue.
+ */
+I2cScheduler::I2cScheduler(I2cTransport &bus) : m_bus(bus), m_running(true)
+{
+    m_thread = std::thread(&I2cScheduler::run, this);
+}
+
+I2cScheduler::~I2cScheduler()
+{
+    stop();
+}
+
+/**
+ * \func void I2cScheduler::stop()
+ *
+ * Lets the transaction on the wire finish and joins the thread. Anything
+ * still queued completes with -ECANCELED, and so does anything submitted
+ * afterwards.
+ */
+void I2cScheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    std::vector<std::unique_ptr<Request>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &queue : m_queues) {
+            for (auto &request : queue)
+                cancelled.push_back(std::move(request));
+            queue.clear();
+        }
+        m_keyed.clear();
+    }
+    for (auto &request : cancelled) {
+        for (auto &done : request->done) {
+            if (done)
+                done(-ECANCELED, request->messages);
+        }
+    }
+}
+
+/**
+ * \func void I2cScheduler::submit(uint8_t address, std::vector<I2cMessage> messages, Priority priority, Completion done, int key)
+ * \param address 7 bit device address
+ * \param messages Run back to back, nothing else gets on the bus in between
+ * \param priority Queue to wait in, lower values go first
+ * \param done Called on the scheduler thread with the result and the messages, reads filled in
+ * \param key Coalescing key, usually the register written, or -1 to always queue
+ *
+ * Returns right away. If a transaction with the same address and key is
+ * still waiting, its messages are replaced by these and done is called
+ * when it completes, keeping its place in the queue.
+ */
+void I2cScheduler::submit(uint8_t address, std::vector<I2cMessage> messages, Priority priority, Completion done, int key)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_running) {
+        lock.unlock();
+        if (done)
+            done(-ECANCELED, messages);
+        return;
+    }
+
+    if (key >= 0) {
+        auto it = m_keyed.find(coalesceKey(address, key));
+        if (it != m_keyed.end()) {
+            it->second->messages = std::move(messages);
+            it->second->done.push_back(done);
+            m_stats[address].coalesced++;
+            return;
+        }
+    }
+
+    std::unique_ptr<Request> request(new Request);
+    request->address = address;
+    request->key = key;
+    request->submitted = monotonicNs();
+    request->messages = std::move(messages);
+    request->done.push_back(done);
+    if (key >= 0)
+        m_keyed[coalesceKey(address, key)] = request.get();
+    m_queues[priority].push_back(std::move(request));
+    lock.unlock();
+    m_wake.notify_one();
+}
+
+/**
+ * \func int I2cScheduler::transfer(uint8_t address, std::vector<I2cMessage> &messages, Priority priority, int key)
+ * \return 0, or a negative errno
+ *
+ * Queues the messages and waits for them, reads are filled in on return.
+ * With a key, this may complete as part of a later submit for the same key.
+ * Not to be called from a completion, the scheduler thread would wait on
+ * itself.
+ */
+int I2cScheduler::transfer(uint8_t address, std::vector<I2cMessage> &messages, Priority priority, int key)
+{
+    std::promise<int> result;
+    std::future<int> finished = result.get_future();
+
+    submit(address, messages, priority, [&result, &messages](int rc, const std::vector<I2cMessage> &done) {
+        messages = done;
+        result.set_value(rc);
+    }, key);
+    return finished.get();
+}
+
+/**
+ * \func int I2cScheduler::writeRegister(uint8_t address, uint8_t reg, uint8_t value, Priority priority)
+ * \return 0, or a negative errno
+ */
+int I2cScheduler::writeRegister(uint8_t address, uint8_t reg, uint8_t value, Priority priority)
+{
+    std::vector<I2cMessage> messages = { I2cMessage::send({ reg, value }) };
+    return transfer(address, messages, priority);
+}
+
+/**
+ * \func int I2cScheduler::readRegister(uint8_t address, uint8_t reg, uint8_t *value, Priority priority)
+ * \return 0, or a negative errno
+ */
+int I2cScheduler::readRegister(uint8_t address, uint8_t reg, uint8_t *value, Priority priority)
+{
+    std::vector<I2cMessage> messages = { I2cMessage::send({ reg }), I2cMessage::receive(1) };
+    int rc = transfer(address, messages, priority);
+    if (rc == 0)
+        *value = messages[1].data[0];
+    return rc;
+}
+
+size_t I2cScheduler::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (auto &queue : m_queues)
+        count += queue.size();
+    return count;
+}
+
+/**
+ * \func std::vector<uint8_t> I2cScheduler::devices() const
+ * \return Every address a transaction was submitted for
+ */
+std::vector<uint8_t> I2cScheduler::devices() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint8_t> result;
+    for (auto &entry : m_stats)
+        result.push_back(entry.first);
+    return result;
+}
+
+/**
+ * \func I2cScheduler::DeviceStats I2cScheduler::stats(uint8_t address, bool reset)
+ * \param address Device to report on
+ * \param reset Start the counters over after reading them
+ */
+I2cScheduler::DeviceStats I2cScheduler::stats(uint8_t address, bool reset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DeviceStats &stats = m_stats[address];
+    DeviceStats result = stats;
+    if (reset)
+        stats = DeviceStats{};
+    return result;
+}
+
+void I2cScheduler::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_running) {
+        std::unique_ptr<Request> request;
+        for (auto &queue : m_queues) {
+            if (!queue.empty()) {
+                request = std::move(queue.front());
+                queue.pop_front();
+                break;
+            }
+        }
+        if (!request) {
+            m_wake.wait(lock);
+            continue;
+        }
+        // From here on a submit with the same key queues a new write behind this one
+        if (request->key >= 0)
+            m_keyed.erase(coalesceKey(request->address, request->key));
+        lock.unlock();
+
+        uint64_t start = monotonicNs();
+        int rc = m_bus.transfer(request->address, request->messages);
+        uint64_t end = monotonicNs();
+
+        size_t bytes = 0;
+        for (auto &message : request->messages)
+            bytes += message.data.size();
+
+        lock.lock();
+        DeviceStats &stats = m_stats[request->address];
+        stats.transactions++;
+        stats.bytes += bytes;
+        stats.busNs += end - start;
+        stats.latency.record(end - request->submitted);
+        if (rc != 0)
+            stats.errors++;
+        lock.unlock();
+
+        for (auto &done : request->done) {
+            if (done)
+                done(rc, request->messages);
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latencyhistogram.h"
+
+/**
+ * One write or read on the bus. A read message is sized to the number of
+ * bytes wanted and filled in by the transfer.
+ */
+struct I2cMessage {
+    bool read;
+    std::vector<uint8_t> data;
+
+    static I2cMessage send(std::vector<uint8_t> bytes) { return I2cMessage{false, std::move(bytes)}; }
+    static I2cMessage receive(size_t length) { return I2cMessage{true, std::vector<uint8_t>(length)}; }
+};
+
+/**
+ * Something that can carry messages to a device: the kernel's i2c-dev
+ * driver, or a simulated bus. Returns 0 or a negative errno.
+ */
+class I2cTransport
+{
+public:
+    virtual ~I2cTransport() {}
+
+    virtual int transfer(uint8_t address, std::vector<I2cMessage> &messages) = 0;
+};
+
+/**
+ * /dev/i2c-N through i2c-dev, the same plain write() and read() calls the
+ * Onion libraries make, so it works with the Omega2's controller.
+ */
+class I2cDevBus : public I2cTransport
+{
+public:
+    explicit I2cDevBus(const std::string &path = "/dev/i2c-0");
+    ~I2cDevBus();
+
+    bool open();
+    void close();
+    bool isOpen() const { return m_fd >= 0; }
+
+    int transfer(uint8_t address, std::vector<I2cMessage> &messages) override;
+
+private:
+    std::string m_path;
+    int m_fd;
+    int m_address;      // device selected with I2C_SLAVE, -1 for none
+};
+
+/**
+ * The only thing that talks to the bus. Transactions are queued by
+ * priority and run one at a time on the scheduler's own thread, so a relay
+ * command waits for at most the transaction already on the wire, never for
+ * a queue of display updates. A transaction submitted with a key replaces
+ * the data of one still queued for the same device and key, which is how
+ * a register written twice before the bus gets to it costs one write.
+ */
+class I2cScheduler
+{
+public:
+    enum Priority {
+        Control = 0,    // actuators, relays
+        Normal,
+        Display,        // bulk display updates
+        Priorities
+    };
+
+    typedef std::function<void(int result, const std::vector<I2cMessage> &messages)> Completion;
+
+    struct DeviceStats {
+        uint64_t transactions;
+        uint64_t errors;
+        uint64_t coalesced;
+        uint64_t bytes;
+        uint64_t busNs;             // time spent on the wire
+        LatencyHistogram latency;   // submit to completion
+    };
+
+    explicit I2cScheduler(I2cTransport &bus);
+    ~I2cScheduler();
+
+    void submit(uint8_t address, std::vector<I2cMessage> messages, Priority priority, Completion done = nullptr, int key = -1);
+    int transfer(uint8_t address, std::vector<I2cMessage> &messages, Priority priority = Control, int key = -1);
+    int writeRegister(uint8_t address, uint8_t reg, uint8_t value, Priority priority = Control);
+    int readRegister(uint8_t address, uint8_t reg, uint8_t *value, Priority priority = Control);
+
+    void stop();
+    size_t pending() const;
+    std::vector<uint8_t> devices() const;
+    DeviceStats stats(uint8_t address, bool reset = false);
+
+private:
+    struct Request {
+        uint8_t address;
+        int key;
+        uint64_t submitted;
+        std::vector<I2cMessage> messages;
+        std::vector<Completion> done;
+    };
+
+    static uint32_t coalesceKey(uint8_t address, int key) { return (static_cast<uint32_t>(address) << 16) | (key & 0xffff); }
+    void run();
+
+    I2cTransport &m_bus;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::unique_ptr<Request>> m_queues[Priorities];
+    std::map<uint32_t, Request*> m_keyed;
+    std::map<uint8_t, DeviceStats> m_stats;
+    std::thread m_thread;
+    bool m_running;
+};
+
+#endif // I2CBUS_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+
+#include "latencyhistogram.h"
+
+// Upper limit of every bucket but the last, in ns
+static const uint64_t s_limits[LatencyHistogram::Buckets - 1] = {
+    100000, 200000, 500000,
+    1000000, 2000000, 5000000,
+    10000000, 20000000, 50000000,
+    100000000, 200000000, 500000000,
+    1000000000, 2000000000, 5000000000,
+};
+
+/**
+ * \func uint64_t LatencyHistogram::bucketLimit(int bucket)
+ * \return The largest latency counted in bucket, UINT64_MAX for the last
+ */
+uint64_t LatencyHistogram::bucketLimit(int bucket)
+{
+    if (bucket < 0)
+        return 0;
+    if (bucket >= Buckets - 1)
+        return UINT64_MAX;
+    return s_limits[bucket];
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    int bucket = 0;
+    while (bucket < Buckets - 1 && ns > s_limits[bucket])
+        bucket++;
+
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += ns;
+    if (ns > m_max)
+        m_max = ns;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+/**
+ * \func uint64_t LatencyHistogram::percentile(double fraction) const
+ * \param fraction 0.5 for the median, 0.99 for p99
+ * \return The upper limit of the bucket the percentile falls in, or the
+ * largest latency seen if that is lower. 0 when nothing was recorded.
+ */
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    if (m_count == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(fraction * m_count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < Buckets; bucket++) {
+        seen += m_buckets[bucket];
+        if (seen >= rank)
+            return bucketLimit(bucket) < m_max ? bucketLimit(bucket) : m_max;
+    }
+    return m_max;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdint>
+
+/**
+ * Fixed bucket histogram of latencies in nanoseconds. The buckets run from
+ * 100us to 5s in 1-2-5 steps, with one more for anything slower, so
+ * recording costs a short scan and the memory never grows.
+ * Not thread safe, the owner serializes access.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr int Buckets = 16;
+
+    LatencyHistogram() { reset(); }
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_count ? static_cast<double>(m_sum) / m_count : 0; }
+    uint64_t percentile(double fraction) const;
+
+    uint64_t bucketCount(int bucket) const { return m_buckets[bucket]; }
+    static uint64_t bucketLimit(int bucket);
+
+private:
+    uint64_t m_buckets[Buckets];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_max;
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,25 +1,75 @@
+#include <algorithm>
 #include <string>
 #include <thread>
 #include <chrono>
+#include <cerrno>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
 #include <fcntl.h>
-#include <oled-exp.h>
-#include <relay-exp.h>
 #include <nlohmann/json.hpp>
 #include <sys/sysinfo.h>
 
 #include "mqttclient.h"
+#include "diskqueue.h"
+#include "dht_chardev.h"
 #include "dht_read.h"
+#include "environment.h"
+#include "eventloop.h"
+#include "fastgpioomega2.h"
+#include "i2cbus.h"
+#include "payloadcodec.h"
+#include "planterconfig.h"
+#include "relaycontroller.h"
+#include "relayexpansion.h"
+#include "samplebatch.h"
+#include "soilsensor.h"
+#include "sensorthread.h"
 
 MQTTClient *g_client;
+int g_qos;
+DiskQueue *g_queue;
 std::string g_mqttname;
+PayloadEncoder g_encoder;
+RelayController g_relays;
+PlanterConfig g_config;
+size_t g_batchSamples;
+int g_batchSeconds;
+EventLoop *g_loop;
+EventLoop::TimerId g_drainTimer;
+I2cScheduler *g_i2c;
+
+/**
+ * A DHT from the registry, with the batch its samples collect in when
+ * PLANTER_BATCH is set
+ */
+struct DhtEntry {
+    const SensorConfig *config;
+    std::unique_ptr<DhtSensor> sensor;
+    std::unique_ptr<SampleBatch> batch;
+};
+std::map<int, DhtEntry> g_dht;      // by pin
+
+typedef std::map<std::pair<std::string, std::string>, SoilReading> SoilReadings;     // by topic and location
+
+/**
+ * Soil probes on one ADC at one interval, read together on the sensor
+ * thread. The last pass's readings wait in ready for the main loop.
+ */
+struct SoilGroup {
+    std::vector<const SensorConfig*> configs;
+    std::vector<SoilSensor> probes;
+    std::mutex mutex;
+    SoilReadings ready;
+};
+std::vector<std::unique_ptr<SoilGroup>> g_soil;
 
 /**
  * \func void get_name(std::string &name)
@@ -52,13 +102,15 @@ void genericCallback(MQTTClient::CallbackType type, int mid)
 {
     if (type == MQTTClient::CallbackType::CONNECT) {
         std::cout << "MQTT Connected" << std::endl;
+        // Start sending anything queued while we were away
+        g_loop->wake();
     }
     if (type == MQTTClient::CallbackType::DISCONNECT) {
         std::cout << "MQTT disconnected, code: " << errno << std::endl;
     }
 }
 
-void incomingMessage(int mid, std::string topic, uint32_t *payload, int size)
+void incomingMessage(std::string_view topic, const uint8_t *payload, size_t size)
 {
 }
 
@@ -78,72 +130,491 @@ void setupMQTT(std::string host, int port)
     g_client->setErrorCallback(mqttError);
 }
 
-void temperature(double &c, double &f, double &h)
+/**
+ * \func void sendPayload(const std::string &topic, const uint8_t *payload, size_t size)
+ *
+ * Publishes now if the broker is there and nothing older is waiting, so
+ * readings arrive in order. Otherwise the payload joins the queue.
+ */
+void sendPayload(const std::string &topic, const uint8_t *payload, size_t size)
+{
+    if (g_client->isConnected() && g_queue->empty()) {
+        if (g_client->publish(NULL, topic.c_str(), size, payload, g_qos, false) == MOSQ_ERR_SUCCESS)
+            return;
+    }
+    if (!g_queue->push(topic, payload, size))
+        std::cout << "not connected, reading lost" << std::endl;
+}
+
+/**
+ * \func void publishBatch(DhtEntry &entry)
+ *
+ * Sends the samples a sensor collected so far as one message on its topic
+ * with /batch appended
+ */
+void publishBatch(DhtEntry &entry)
+{
+    if (entry.batch->empty())
+        return;
+
+    const std::vector<uint8_t> &payload = entry.batch->encode();
+    sendPayload(entry.config->topic + "/batch", payload.data(), payload.size());
+}
+
+/**
+ * \func void publishEnvironment(const SensorSample &sample)
+ * \param sample A sample taken off the sensor thread's queue
+ *
+ * Runs on the main thread, which owns the relay board and the MQTT client.
+ * The sample's pin says which registry entry, and so which location and
+ * topic, it belongs to.
+ */
+void publishEnvironment(const SensorSample &sample)
 {
-    nlohmann::json doc;
     struct sysinfo info;
-    float humidity = 0.0f;
-    float temperature = 0.0f;
-    int result = 0;
-    int maxRetry = 3;
-    int state;
-  
+
+    auto it = g_dht.find(sample.pin);
+    if (sample.result != DHT_SUCCESS || it == g_dht.end())
+        return;
+    DhtEntry &entry = it->second;
+
     if (sysinfo(&info) < 0) {
         std::cerr << "Unable to get sysinfo" << std::endl;
     }
     
-    if (relayReadChannel (7, 1, &state) == EXIT_FAILURE)
-        state = -1;
+    // What the lamp, the first relay, was last told; verifyRelays() keeps that honest without a read per sample
+    int state = -1;
+    if (!g_config.relays.empty())
+        state = g_relays.state(g_config.relays[0].address, g_config.relays[0].channel);
     
-    do {
-        result = dht_read(DHT22, 19, &humidity, &temperature);
-        maxRetry--;
-    } while(result != 0 && maxRetry > 0);
-    
-    if (result == 0 && maxRetry > 0) {
-        doc["location"] = "familyroom";
-        doc["system"]["name"] = g_mqttname;
-        doc["system"]["uptime"] = info.uptime;
-        doc["light"] = state;
-        doc["environment"]["humidity"] = humidity;
-        doc["environment"]["celsius"] = temperature;
-        doc["environment"]["farenheit"] = temperature * 1.8 + 32;
-        if (g_client->isConnected())
-            g_client->publish(NULL, "planter/environment", doc.dump().size(), doc.dump().c_str(), 0, false);
-        else
-            std::cout << "not connected" << std::endl;
+    EnvironmentReading reading;
+    reading.location = entry.config->location;
+    reading.name = g_mqttname;
+    reading.uptime = info.uptime;
+    reading.light = state;
+    reading.humidity = sample.reading.humidity;
+    reading.celsius = sample.reading.temperature;
+    reading.confidence = sample.reading.confidence;
+
+    if (entry.batch) {
+        // The first sample of a batch sets when it is due at the latest
+        if (entry.batch->empty()) {
+            DhtEntry *batched = &entry;
+            g_loop->after(std::chrono::seconds(entry.batch->maxSeconds()), [batched]() {
+                if (batched->batch->due(time(0)))
+                    publishBatch(*batched);
+            });
+        }
+        if (entry.batch->add(reading, sample.time))
+            publishBatch(entry);
+        return;
+    }
+
+    const std::vector<uint8_t> &payload = g_encoder.encode(reading);
+    sendPayload(g_encoder.topic(entry.config->topic), payload.data(), payload.size());
+}
+
+/**
+ * \func void readSoil(SoilGroup &group)
+ *
+ * Reads a group's probes back to back on the sensor thread, each burst takes
+ * about 40ms, and leaves the ones that have a value for publishSoil(), one
+ * reading per topic and location
+ */
+void readSoil(SoilGroup &group)
+{
+    SoilReadings readings;
+
+    for (size_t i = 0; i < group.probes.size(); i++) {
+        SoilSensor &probe = group.probes[i];
+        const SensorConfig *config = group.configs[i];
+
+        int rc = probe.read();
+        if (rc != 0)
+            std::cerr << "Unable to read soil probe " << probe.channel() << ": " << strerror(-rc) << std::endl;
+        if (!probe.valid())
+            continue;
+
+        SoilReading &reading = readings[std::make_pair(config->topic, config->location)];
+        reading.location = config->location;
+        reading.name = g_mqttname;
+        reading.probes.push_back(SoilProbeReading{ probe.channel(), probe.moisture(), probe.raw() });
     }
+
+    std::lock_guard<std::mutex> lock(group.mutex);
+    group.ready.swap(readings);
+}
+
+/**
+ * \func void publishSoil(SoilGroup &group)
+ *
+ * Publishes what readSoil() left in the group, in the environment payload's
+ * format. Runs on the main loop.
+ */
+void publishSoil(SoilGroup &group)
+{
+    SoilReadings readings;
+
+    {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        readings.swap(group.ready);
+    }
+
+    for (auto &entry : readings) {
+        const std::vector<uint8_t> &payload = g_encoder.encode(entry.second);
+        sendPayload(g_encoder.topic(entry.first.first), payload.data(), payload.size());
+    }
+}
+
+/**
+ * \func void drainQueue()
+ *
+ * Publishes readings kept while the broker was unreachable, a batch a second
+ * so a long backlog never holds up the relay or new samples. Whatever the
+ * client refuses stays queued for the next pass. The timer only exists while
+ * there is something to send.
+ */
+void drainQueue()
+{
+    if (!g_client->isConnected() || g_queue->empty()) {
+        if (g_drainTimer) {
+            g_loop->cancel(g_drainTimer);
+            g_drainTimer = 0;
+        }
+        return;
+    }
+
+    g_queue->drain([](const char *topic, const uint8_t *payload, size_t size) {
+        return g_client->publish(NULL, topic, size, payload, g_qos, false) == MOSQ_ERR_SUCCESS;
+    }, 32);
+    if (!g_drainTimer && !g_queue->empty())
+        g_drainTimer = g_loop->every(std::chrono::seconds(1), drainQueue, std::chrono::seconds(1));
+}
+
+/**
+ * \func void publishStats()
+ *
+ * Publishes the state of the client and the offline queue on planter/mqtt/stats,
+ * along with the publish latency histogram since the last report.
+ */
+void publishStats()
+{
+    if (!g_client->isConnected())
+        return;
+
+    LatencyHistogram latency = g_client->latency(true);
+    ConnectionStats connection = g_client->connectionStats();
+    nlohmann::json doc;
+
+    doc["system"]["name"] = g_mqttname;
+    doc["mqtt"]["inflight"] = g_client->inflight();
+    doc["mqtt"]["max_inflight"] = g_client->maxInflight();
+    doc["mqtt"]["window_full"] = g_client->windowFull();
+    doc["mqtt"]["attempts"] = connection.attempts;
+    doc["mqtt"]["connects"] = connection.connects;
+    doc["mqtt"]["disconnects"] = connection.disconnects;
+    doc["mqtt"]["first_connect_ms"] = connection.firstConnectNs / 1000000;
+    doc["mqtt"]["last_connect_ms"] = connection.lastConnectNs / 1000000;
+    doc["relay"]["writes"] = g_relays.writes();
+    doc["relay"]["skipped"] = g_relays.skipped();
+    doc["relay"]["mismatches"] = g_relays.mismatches();
+    doc["relay"]["errors"] = g_relays.errors();
+    for (uint8_t address : g_i2c->devices()) {
+        I2cScheduler::DeviceStats i2c = g_i2c->stats(address, true);
+        char name[8];
+        snprintf(name, sizeof(name), "0x%02x", address);
+        doc["i2c"][name]["transactions"] = i2c.transactions;
+        doc["i2c"][name]["errors"] = i2c.errors;
+        doc["i2c"][name]["coalesced"] = i2c.coalesced;
+        doc["i2c"][name]["p99_us"] = i2c.latency.percentile(0.99) / 1000;
+        doc["i2c"][name]["max_us"] = i2c.latency.max() / 1000;
+    }
+    doc["queue"]["size"] = g_queue->size();
+    doc["queue"]["dropped"] = g_queue->dropped();
+    doc["latency"]["count"] = latency.count();
+    doc["latency"]["mean_us"] = latency.mean() / 1000;
+    doc["latency"]["p50_us"] = latency.percentile(0.5) / 1000;
+    doc["latency"]["p99_us"] = latency.percentile(0.99) / 1000;
+    doc["latency"]["max_us"] = latency.max() / 1000;
+    for (int i = 0; i < LatencyHistogram::Buckets; i++)
+        doc["latency"]["buckets"].push_back(latency.bucketCount(i));
+
+    std::string data = doc.dump();
+    g_client->publish(NULL, "planter/mqtt/stats", data.size(), data.c_str(), 0, false);
+}
+
+/**
+ * \func void updateRelay()
+ *
+ * Brings the relays to what their schedules say and comes back at the next
+ * transition. The wait is capped at 15 minutes in case the wall clock is
+ * set in between, which only costs a schedule evaluation, not a write.
+ */
+void updateRelay()
+{
+    time_t now = time(0);
+    time_t next = g_relays.apply(now);
+    long delay = std::max(1L, std::min(900L, static_cast<long>(next - now)));
+
+    g_loop->after(std::chrono::seconds(delay), updateRelay);
+}
+
+/**
+ * \func void verifyRelays()
+ *
+ * Reads the relays back and rewrites any that lost their state
+ */
+void verifyRelays()
+{
+    int corrected = g_relays.verify();
+    if (corrected)
+        std::cerr << "Rewrote " << corrected << " relay channels that did not match" << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
     bool relayState = false;
-    int relay = 0;
-    double c = 0.0;
-    double f = 0.0;
-    double h = 0.0;
+    EventLoop loop;
 
-    relayDriverInit(7);
-    relayCheckInit (7, &relay);
-    
-    if (relay == 0) {
-        std::cout << "Unable to initialize relay board" << std::endl;
+    g_loop = &loop;
+
+    // PLANTER_GPIOCHIP reads the DHT through the GPIO character device instead of /dev/mem
+    const char *gpioChip = getenv("PLANTER_GPIOCHIP");
+    std::unique_ptr<FastGpioChardev> chardev;
+    std::shared_ptr<RegisterMap> gpioRegisters;
+
+    if (gpioChip) {
+        chardev.reset(new FastGpioChardev(gpioChip));
+        if (!chardev->IsOpen()) {
+            std::cerr << "Unable to open " << gpioChip << std::endl;
+            exit(-1);
+        }
+    }
+    else {
+        // Map the GPIO registers once for the life of the process, every sensor read shares it
+        gpioRegisters = RegisterMap::Acquire(REG_BLOCK_ADDR, REG_BLOCK_SIZE);
+        if (!gpioRegisters) {
+            std::cerr << "Unable to map GPIO registers" << std::endl;
+            exit(-1);
+        }
+    }
+
+    // Measure timer slack for the DHT delays before any thread is started, they inherit it
+    delay_calibrate();
+
+    // PLANTER_PAYLOAD picks the wire format: json (default), cbor, msgpack or packed
+    if (getenv("PLANTER_PAYLOAD")) {
+        PayloadFormat format;
+        if (!payloadFormatFromName(getenv("PLANTER_PAYLOAD"), format)) {
+            std::cerr << "Unknown payload format " << getenv("PLANTER_PAYLOAD") << std::endl;
+            exit(-1);
+        }
+        g_encoder.setFormat(format);
+    }
+
+    // PLANTER_BATCH=N[:SECONDS] sends N samples per message, or whatever is there after SECONDS
+    if (getenv("PLANTER_BATCH")) {
+        int samples = 0;
+        int seconds = 0;
+        if (sscanf(getenv("PLANTER_BATCH"), "%d:%d", &samples, &seconds) < 1 || samples < 1) {
+            std::cerr << "PLANTER_BATCH must be SAMPLES or SAMPLES:SECONDS" << std::endl;
+            exit(-1);
+        }
+        g_batchSamples = samples;
+        g_batchSeconds = seconds;
+    }
+
+    // PLANTER_CONFIG names a JSON file listing the sensors, relays, location and broker,
+    // see PlanterConfig::parse(). Without it, this is the original single tray installation.
+    if (getenv("PLANTER_CONFIG")) {
+        std::string error;
+        if (!g_config.load(getenv("PLANTER_CONFIG"), error)) {
+            std::cerr << "Bad configuration: " << error << std::endl;
+            exit(-1);
+        }
+    }
+
+    // Readings taken while disconnected wait here, on flash, until the broker is back
+    const char *queueDir = getenv("PLANTER_QUEUE_DIR");
+    g_queue = new DiskQueue(queueDir ? queueDir : "/root/planter-queue");
+    if (!g_queue->open())
+        std::cerr << "Unable to open the reading queue, readings taken while disconnected will be lost" << std::endl;
+    else if (!g_queue->empty())
+        std::cout << g_queue->size() << " queued readings waiting for the broker" << std::endl;
+
+    // Failed DHT captures are saved here for replay with dht_replay
+    if (getenv("PLANTER_TRACE_DIR"))
+        dht_set_trace_dir(getenv("PLANTER_TRACE_DIR"));
+
+    // Everything on /dev/i2c-0 goes through the scheduler, relay commands ahead of anything else
+    I2cDevBus i2cBus("/dev/i2c-0");
+    if (!i2cBus.open()) {
+        std::cout << "Unable to open the I2C bus" << std::endl;
         exit(-1);
     }
+    I2cScheduler i2c(i2cBus);
+    g_i2c = &i2c;
 
-    setupMQTT("172.24.1.13", 1883);
- 
-    while (1) {
-        time_t ttime = time(0);
-        tm *lt = localtime(&ttime);
-        if (lt->tm_hour >= 20 || lt->tm_hour <= 6) {
-            relaySetChannel(7, 1, 0);
+    // One relay expansion per address in use, each initialized once
+    std::map<int, std::unique_ptr<RelayExpansion>> relayBoards;
+    for (const RelayConfig &relay : g_config.relays) {
+        if (relayBoards.count(relay.address))
+            continue;
+        std::unique_ptr<RelayExpansion> board(new RelayExpansion(i2c, relay.address));
+        if (board->init() != 0 || !board->isInitialized()) {
+            std::cout << "Unable to initialize relay board " << relay.address << std::endl;
+            exit(-1);
         }
-        else {
-            relaySetChannel(7, 1, 1);
+        relayBoards[relay.address] = std::move(board);
+    }
+
+    // PLANTER_LIGHT_SCHEDULE and PLANTER_LIGHT_RAMP=YYYY-MM-DD/DAYS/HH:MM/HH:MM still override
+    // the schedule of the lamp, the first relay
+    if (!g_config.relays.empty()) {
+        RelaySchedule &lamp = g_config.relays[0].schedule;
+        if (getenv("PLANTER_LIGHT_SCHEDULE") && !lamp.parseWindows(getenv("PLANTER_LIGHT_SCHEDULE"))) {
+            std::cerr << "PLANTER_LIGHT_SCHEDULE must be HH:MM-HH:MM[,HH:MM-HH:MM...]" << std::endl;
+            exit(-1);
+        }
+        if (getenv("PLANTER_LIGHT_RAMP") && !lamp.parseRamp(getenv("PLANTER_LIGHT_RAMP"))) {
+            std::cerr << "PLANTER_LIGHT_RAMP must be YYYY-MM-DD/DAYS/HH:MM/HH:MM" << std::endl;
+            exit(-1);
+        }
+    }
+    g_relays.setWriteFunction([&relayBoards](int address, int channel, int state) {
+        auto it = relayBoards.find(address);
+        return it != relayBoards.end() ? it->second->setChannel(channel, state) : -ENODEV;
+    });
+    g_relays.setReadFunction([&relayBoards](int address, int channel, int *state) {
+        auto it = relayBoards.find(address);
+        return it != relayBoards.end() ? it->second->readChannel(channel, state) : -ENODEV;
+    });
+    for (const RelayConfig &relay : g_config.relays)
+        g_relays.setSchedule(relay.address, relay.channel, relay.schedule);
+
+    // PLANTER_SOIL=CHANNEL:DRY:WET[,...] adds soil probes on the ADC expansion, with the
+    // filtered counts each reads in dry air and in water
+    if (getenv("PLANTER_SOIL")) {
+        std::string probes = getenv("PLANTER_SOIL");
+        size_t start = 0;
+        while (start <= probes.size()) {
+            size_t end = probes.find(',', start);
+            std::string probe = probes.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            nlohmann::json entry = { { "driver", "soil" } };
+            int channel;
+            float dry, wet;
+            std::string error;
+            if (sscanf(probe.c_str(), "%d:%f:%f", &channel, &dry, &wet) != 3) {
+                std::cerr << "PLANTER_SOIL must be CHANNEL:DRY:WET[,CHANNEL:DRY:WET...]" << std::endl;
+                exit(-1);
+            }
+            entry["channel"] = channel;
+            entry["dry"] = dry;
+            entry["wet"] = wet;
+            if (!g_config.addSensor(entry, error)) {
+                std::cerr << "PLANTER_SOIL: " << error << std::endl;
+                exit(-1);
+            }
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
         }
+    }
+
+    setupMQTT(g_config.broker, g_config.port);
 
-        temperature(c, f, h);
-        std::this_thread::sleep_for(std::chrono::seconds(60));
+    // PLANTER_QOS=1 or 2 has readings acknowledged; at most PLANTER_MAX_INFLIGHT (20) wait at
+    // once, anything past that stays in the offline queue until the broker catches up
+    if (getenv("PLANTER_QOS")) {
+        g_qos = atoi(getenv("PLANTER_QOS"));
+        if (g_qos < 0 || g_qos > 2) {
+            std::cerr << "PLANTER_QOS must be 0, 1 or 2" << std::endl;
+            exit(-1);
+        }
     }
+    if (getenv("PLANTER_MAX_INFLIGHT"))
+        g_client->setMaxInflight(atoi(getenv("PLANTER_MAX_INFLIGHT")));
+
+    // Sensor reads get their own thread, optionally pinned with PLANTER_SENSOR_CPU
+    SensorThread sensors;
+    if (getenv("PLANTER_SENSOR_CPU"))
+        sensors.setCpu(atoi(getenv("PLANTER_SENSOR_CPU")));
+
+    // Each group of the registry is read in one acquisition window: DHTs on one GPIO bank in one
+    // capture, soil probes on one ADC in one pass
+    std::map<int, std::unique_ptr<Ads1115>> adcs;
+    for (const SensorGroup &group : g_config.groups()) {
+        std::chrono::seconds interval(group.interval);
+        const SensorConfig &first = g_config.sensors[group.members[0]];
+
+        if (first.dhtType() > 0) {
+            int type = first.dhtType();
+            std::vector<DhtSensor*> members;
+
+            for (size_t index : group.members) {
+                const SensorConfig &config = g_config.sensors[index];
+                DhtEntry &entry = g_dht[config.pin];
+                entry.config = &config;
+                entry.sensor.reset(new DhtSensor(type, config.pin));
+                if (chardev) {
+                    FastGpioChardev *gpio = chardev.get();
+                    int pin = config.pin;
+                    entry.sensor->setReadFunction([gpio, type, pin](dht_reading *reading) { return dht_read_chardev(type, gpio, pin, reading); });
+                }
+                // Without a time limit, wait no longer than the samples should take to arrive
+                if (g_batchSamples)
+                    entry.batch.reset(new SampleBatch(g_batchSamples, g_batchSeconds > 0 ? g_batchSeconds : g_batchSamples * group.interval));
+                members.push_back(entry.sensor.get());
+            }
+
+            DhtSensor::GroupReadFunction read;
+            if (chardev) {
+                // The character device has no bank wide capture, read the pins one after another
+                FastGpioChardev *gpio = chardev.get();
+                read = [gpio, type](const int *pins, int count, dht_reading *readings, int *results) {
+                    for (int i = 0; i < count; i++)
+                        results[i] = dht_read_chardev(type, gpio, pins[i], &readings[i]);
+                    return DHT_SUCCESS;
+                };
+            }
+            else {
+                read = [type](const int *pins, int count, dht_reading *readings, int *results) {
+                    return dht_read_many(type, pins, count, readings, results);
+                };
+            }
+            sensors.addGroup(members, interval, read);
+        }
+        else {
+            std::unique_ptr<Ads1115> &adc = adcs[group.bus];
+            if (!adc)
+                adc.reset(new Ads1115(i2c, group.bus));
+
+            std::unique_ptr<SoilGroup> soil(new SoilGroup);
+            for (size_t index : group.members) {
+                const SensorConfig &config = g_config.sensors[index];
+                soil->configs.push_back(&config);
+                soil->probes.emplace_back(*adc, config.channel, config.calibration);
+            }
+            SoilGroup *task = soil.get();
+            g_soil.push_back(std::move(soil));
+            sensors.addTask([task]() { readSoil(*task); }, interval);
+        }
+    }
+
+    // Everything else runs on this thread, each task at its own rate; between them it sleeps
+    SensorSample sample;
+    loop.setWakeHandler([&sensors, &sample]() {
+        while (sensors.nextSample(sample))
+            publishEnvironment(sample);
+        for (auto &soil : g_soil)
+            publishSoil(*soil);
+        drainQueue();
+    });
+    sensors.setNotify([&loop]() { loop.wake(); });
+    sensors.start();
+
+    updateRelay();
+    loop.every(std::chrono::hours(1), verifyRelays, std::chrono::hours(1));
+    loop.every(std::chrono::minutes(10), publishStats, std::chrono::minutes(10));
+    loop.run();
 }
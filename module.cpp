@@ -1,5 +1,7 @@
 #include <module.h>
 
+RegisterBackend *Module::defaultBackend = NULL;
+
 Module::Module(void)
 {
 	// not verbose by default
@@ -7,11 +9,15 @@ Module::Module(void)
 
 	// not in debug mode by default
 	debugLevel		= 0;
+
+	// nothing mapped yet, pick up the simulated registers if any are installed
+	regAddress		= NULL;
+	backend			= defaultBackend;
 }
 
 Module::~Module(void)
 {
-	// nothing for now
+	// regMap lets go of the shared register mapping
 }
 
 
@@ -36,64 +42,77 @@ void Module::SetDebugMode (bool input)
 	debugLevel		= (input ? 1 : 0);
 }
 
+void Module::SetRegisterBackend (RegisterBackend *input)
+{
+	defaultBackend	= input;
+}
+
+RegisterBackend* Module::GetRegisterBackend (void)
+{
+	return defaultBackend;
+}
+
 
 // Register access
-int Module::_SetupAddress(unsigned long int blockBaseAddr, unsigned long int blockSize)
+int Module::_SetupAddress(uint32_t blockBaseAddr, uint32_t blockSize, const char *device)
 {
-	int  m_mfd;
+	if (backend != NULL)
+	{
+		return EXIT_SUCCESS;	// registers are served by the backend
+	}
 
 	if (debugLevel == 0)
 	{
-		if ((m_mfd = open("/dev/mem", O_RDWR)) < 0)
+		// shared with every other module using the same block, unmapped with the last one
+		regMap = RegisterMap::Acquire(blockBaseAddr, blockSize, device);
+		if (!regMap)
 		{
 			return EXIT_FAILURE;	// maybe return -1
 		}
 
-		regAddress = (unsigned long*)mmap	(	NULL, 
-												blockSize, 
-												PROT_READ|PROT_WRITE, 
-												MAP_SHARED, 
-												m_mfd, 
-												blockBaseAddr
-											);
-		close(m_mfd);
-
-		if (regAddress == MAP_FAILED)
-		{
-			return EXIT_FAILURE;	// maybe return -2
-		}
+		regAddress = regMap->GetAddress();
 	}
 
 	return EXIT_SUCCESS;	// regAddress is now populated
 }
 
-void Module::_WriteReg(unsigned long int registerOffset, unsigned long int value)
+void Module::_WriteReg(uint32_t registerOffset, uint32_t value)
 {
-	if (verbosityLevel > 0)	printf("Writing register 0x%08lx with data 0x%08lx \n", (regAddress + registerOffset), value);
+	if (verbosityLevel > 0)	printf("Writing register %p with data 0x%08" PRIx32 " \n", (regAddress + registerOffset), value);
+
+	if (backend != NULL) {
+		backend->Write(registerOffset, value);
+		return;
+	}
 
 	*(regAddress + registerOffset) = value;
 }
 
-unsigned long int Module::_ReadReg(unsigned long int registerOffset)
+uint32_t Module::_ReadReg(uint32_t registerOffset)
 {
-	unsigned long int 	value = 0x0;
+	uint32_t 	value = 0x0;
 
 	// read the value 
-	value = *(regAddress + registerOffset);
+	if (backend != NULL) {
+		value = backend->Read(registerOffset);
+	}
+	else {
+		value = *(regAddress + registerOffset);
+	}
 
-	if (verbosityLevel > 0)	printf("Read register 0x%08lx, data: 0x%08lx \n", (regAddress + registerOffset), value);
+	if (verbosityLevel > 0)	printf("Read register %p, data: 0x%08" PRIx32 " \n", (regAddress + registerOffset), value);
 
 	return(value);
 }
 
 // change the value of a single bit
-void Module::_SetBit(unsigned long int &regVal, int bitNum, int value)
+void Module::_SetBit(uint32_t &regVal, int bitNum, int value)
 {
 	if (value == 1) {
-		regVal |= (1 << bitNum);
+		regVal |= (1u << bitNum);
 	}
 	else {
-		regVal &= ~(1 << bitNum);
+		regVal &= ~(1u << bitNum);
 	}
 
 	// try this out
@@ -101,7 +120,7 @@ void Module::_SetBit(unsigned long int &regVal, int bitNum, int value)
 }
 
 // find the value of a single bit
-int Module::_GetBit(unsigned long int regVal, int bitNum)
+int Module::_GetBit(uint32_t regVal, int bitNum)
 {
 	int value;
 
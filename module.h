@@ -6,10 +6,15 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <memory>
 
+#include <registerbackend.h>
+#include <registermap.h>
 
 
 
@@ -24,21 +29,40 @@ public:
 	void	SetDebugMode	(int input);
 	void	SetDebugMode	(bool input);
 
+	// Route register access for every Module created afterwards through backend
+	// instead of /dev/mem. Pass NULL to go back to the hardware registers.
+	static void 			SetRegisterBackend	(RegisterBackend *backend);
+	static RegisterBackend*	GetRegisterBackend	(void);
+
+	// what this module's registers resolve to, for the accessors in fastgpiopin.h
+	volatile uint32_t* 		GetRegisterAddress 	(void) { return regAddress; }
+	RegisterBackend* 		GetBackend 			(void) { return backend; }
+
+	// false when neither a mapping nor a backend could be set up
+	bool 					IsReady 			(void) { return (regAddress != NULL || backend != NULL); }
+
 
 protected:
 	// protected functions
-	int 				_SetupAddress	(unsigned long int blockBaseAddr, unsigned long int blockSize);
-	void 				_WriteReg 		(unsigned long int registerOffset, unsigned long int value);
-	unsigned long int 	_ReadReg 		(unsigned long int registerOffset);
+	// device is what gets mapped, /dev/zero stands in for /dev/mem off hardware
+	int 				_SetupAddress	(uint32_t blockBaseAddr, uint32_t blockSize, const char *device = "/dev/mem");
+	void 				_WriteReg 		(uint32_t registerOffset, uint32_t value);
+	uint32_t 			_ReadReg 		(uint32_t registerOffset);
 	
-	void 				_SetBit			(unsigned long int &regVal, int bitNum, int value);
-	int 				_GetBit			(unsigned long int regVal, int bitNum);
+	void 				_SetBit			(uint32_t &regVal, int bitNum, int value);
+	int 				_GetBit			(uint32_t regVal, int bitNum);
 
 	// protected members
 	int				verbosityLevel;
 	int 			debugLevel;
 
-	volatile unsigned long int *regAddress;
+	// registers are 32 bits wide on the SoC, whatever the host's long is
+	volatile uint32_t 	*regAddress;
+	RegisterBackend 	*backend;
+	std::shared_ptr<RegisterMap> 	regMap;
+
+private:
+	static RegisterBackend 	*defaultBackend;
 };
 
-#endif 	// _MODULE_H_
\ No newline at end of file
+#endif 	// _MODULE_H_
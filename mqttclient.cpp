@@ -23,31 +23,50 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <ctime>
+
 #include "mqttclient.h"
 
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
 /**
- * \func MQTTClient::MQTTClient(std::string &id, std::string &host, std::string &username, std::string &password, int port)
+ * \func MQTTClient::MQTTClient(std::string &id, std::string host, int port, int keepalive)
  * \param id MQTT connection name
  * \param host MQTT hostname to connect to
- * \param username MQTT connection username
- * \param password MQTT connection password
  * \param port MQTT port to connect to
+ * \param keepalive Seconds between pings when nothing else is sent
  * 
- * This will create a new connection and start the loop. It does not return an error, that would be handled by callbacks. Note
- * that this implementation will resuse username and password for both the standard connection and TLS options. This is specific
- * to MQTTClient and may not be compatible with other cloud providers.
+ * Starts the network thread, which connects in the background and returns
+ * immediately whether or not the broker is reachable. Failed attempts and
+ * lost connections are retried with an exponential backoff, see
+ * setReconnectDelay(). Connecting is reported through the callbacks.
  */
-MQTTClient::MQTTClient(std::string &id, std::string host, int port) : mosqpp::mosquittopp(id.c_str()),
-    m_name(id), m_host(host), m_port(port)
+MQTTClient::MQTTClient(std::string &id, std::string host, int port, int keepalive) : mosqpp::mosquittopp(id.c_str()),
+    m_name(id), m_host(host), m_port(port), m_keepalive(keepalive),
+    m_initialDelay(1000), m_maxDelay(120000), m_failures(0)
 {
     m_debug = false;
     m_connected = false;
+    m_inflightQos = 0;
+    m_windowFull = 0;
+    m_stats = {};
+    m_createdNs = monotonicNs();
+    m_attemptNs = 0;
+    // Seeded per device so a fleet restarted together spreads its reconnects
+    m_random.seed(std::random_device()() ^ std::hash<std::string>()(id));
+
     mosqpp::lib_init();			// Initialize libmosquitto
+    threaded_set(true);         // publish() is called from other threads than the loop
+    setMaxInflight(20);
 
-	int keepalive = 120; // seconds
-    
-	int code = connect(m_host.c_str(), m_port, keepalive);
-    loop_start();
+    m_nextAttempt = std::chrono::steady_clock::now();
+    m_running = true;
+    m_thread = std::thread(&MQTTClient::run, this);
 }
 
 /**
@@ -57,10 +76,223 @@ MQTTClient::MQTTClient(std::string &id, std::string host, int port) : mosqpp::mo
  */
 MQTTClient::~MQTTClient()
 {
-    loop_stop();            // Kill the thread
+    {
+        std::lock_guard<std::mutex> lock(m_runMutex);
+        m_running = false;
+    }
+    disconnect();              // Sent by the last pass of the network thread
+    m_wake.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();       // Kill the thread
     mosqpp::lib_cleanup();    // Mosquitto library cleanup
 }
 
+/**
+ * \func void MQTTClient::setReconnectDelay(std::chrono::milliseconds initial, std::chrono::milliseconds max)
+ * \param initial Wait after the first failure, 1s by default
+ * \param max Longest wait, 2 minutes by default
+ *
+ * The wait doubles with every failure in a row up to max. Each actual wait is
+ * picked at random between half of that and all of it, so devices that lost
+ * the broker at the same moment don't all come back at the same moment.
+ */
+void MQTTClient::setReconnectDelay(std::chrono::milliseconds initial, std::chrono::milliseconds max)
+{
+    std::lock_guard<std::mutex> lock(m_runMutex);
+
+    m_initialDelay = std::max(initial, std::chrono::milliseconds(1));
+    m_maxDelay = std::max(max, m_initialDelay);
+}
+
+ConnectionStats MQTTClient::connectionStats()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+/**
+ * Called on the network thread after a failed attempt or a lost connection
+ */
+void MQTTClient::scheduleReconnect()
+{
+    std::lock_guard<std::mutex> lock(m_runMutex);
+
+    int64_t base = m_maxDelay.count();
+    if (m_failures < 31)
+        base = std::min<int64_t>(base, m_initialDelay.count() << m_failures);
+    m_failures++;
+
+    std::uniform_int_distribution<int64_t> jitter(base / 2, base);
+    std::chrono::milliseconds delay(jitter(m_random));
+    m_nextAttempt = std::chrono::steady_clock::now() + delay;
+
+    std::lock_guard<std::mutex> statsLock(m_statsMutex);
+    m_stats.backoffNs = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+}
+
+/**
+ * The network thread. Replaces loop_start(), whose reconnects have no
+ * jitter: connect and reconnect are started here without blocking on the
+ * broker, and loop() is run while there is a socket.
+ */
+void MQTTClient::run()
+{
+    bool started = false;
+    bool open = false;
+
+    while (m_running) {
+        if (!open) {
+            {
+                std::unique_lock<std::mutex> lock(m_runMutex);
+                m_wake.wait_until(lock, m_nextAttempt, [this] { return !m_running; });
+                if (!m_running)
+                    break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_statsMutex);
+                m_stats.attempts++;
+                m_attemptNs = monotonicNs();
+            }
+            int rc = started ? reconnect_async() : connect_async(m_host.c_str(), m_port, m_keepalive);
+            started = true;
+            if (rc != MOSQ_ERR_SUCCESS) {
+                if (m_debug)
+                    std::cerr << __FUNCTION__ << ": Connect to " << m_host << " failed: " << mosqpp::strerror(rc) << std::endl;
+                scheduleReconnect();
+                continue;
+            }
+            open = true;
+        }
+
+        int rc = loop(1000, 1);
+        if (rc != MOSQ_ERR_SUCCESS) {
+            open = false;
+            scheduleReconnect();
+        }
+    }
+}
+
+/**
+ * \func int MQTTClient::publish(int *mid, const char *topic, int payloadlen, const void *payload, int qos, bool retain)
+ * \return MOSQ_ERR_SUCCESS, a libmosquitto error, or WINDOW_FULL
+ *
+ * Same as mosquittopp::publish(), but every message is timed until
+ * on_publish() reports it sent (QoS 0) or acknowledged (QoS 1 and 2).
+ * QoS 1 and 2 messages are refused with WINDOW_FULL while maxInflight() of
+ * them are still waiting for the broker, so a slow broker makes the caller
+ * hold on to its data rather than libmosquitto queueing it in memory.
+ */
+int MQTTClient::publish(int *mid, const char *topic, int payloadlen, const void *payload, int qos, bool retain)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+    int id = 0;
+
+    if (qos > 0 && m_inflightQos >= m_maxInflight) {
+        m_windowFull++;
+        return WINDOW_FULL;
+    }
+
+    uint64_t sent = monotonicNs();
+    int rc = mosqpp::mosquittopp::publish(&id, topic, payloadlen, payload, qos, retain);
+    if (rc == MOSQ_ERR_SUCCESS) {
+        m_inflight[id] = { sent, qos };
+        if (qos > 0)
+            m_inflightQos++;
+    }
+    if (mid)
+        *mid = id;
+    return rc;
+}
+
+/**
+ * \func void MQTTClient::setMaxInflight(unsigned int messages)
+ * \param messages QoS 1 and 2 messages allowed to wait for the broker at once
+ *
+ * libmosquitto is given the same limit, so it never has more on the wire.
+ */
+void MQTTClient::setMaxInflight(unsigned int messages)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+
+    m_maxInflight = messages ? messages : 1;
+    max_inflight_messages_set(m_maxInflight);
+}
+
+unsigned int MQTTClient::inflight()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+    return m_inflightQos;
+}
+
+uint64_t MQTTClient::windowFull()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+    return m_windowFull;
+}
+
+/**
+ * \func LatencyHistogram MQTTClient::latency(bool reset)
+ * \param reset Start a new histogram after taking this copy
+ *
+ * Publish to acknowledgement latency of every message since the last reset
+ */
+LatencyHistogram MQTTClient::latency(bool reset)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+    LatencyHistogram copy = m_latency;
+
+    if (reset)
+        m_latency.reset();
+    return copy;
+}
+
+/**
+ * \func bool MQTTClient::subscribe(const std::string &filter, MessageHandler handler, int qos)
+ * \param filter Topic filter, + and # wildcards allowed
+ * \param handler Called on the MQTT thread with every message matching filter
+ * \return false if filter isn't valid
+ *
+ * Subscriptions are kept and made again every time the client connects.
+ */
+bool MQTTClient::subscribe(const std::string &filter, MessageHandler handler, int qos)
+{
+    bool send;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(m_routerMutex);
+        if (!m_router.add(filter, handler))
+            return false;
+        send = m_subscriptions.count(filter) == 0 && m_connected;
+        m_subscriptions[filter] = qos;
+    }
+    if (send)
+        mosqpp::mosquittopp::subscribe(NULL, filter.c_str(), qos);
+    return true;
+}
+
+/**
+ * \func bool MQTTClient::unsubscribe(const std::string &filter)
+ * \return false if there was no subscription to filter
+ *
+ * Drops every handler subscribe() added for filter
+ */
+bool MQTTClient::unsubscribe(const std::string &filter)
+{
+    bool send;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(m_routerMutex);
+        if (!m_router.remove(filter))
+            return false;
+        m_subscriptions.erase(filter);
+        send = m_connected;
+    }
+    if (send)
+        mosqpp::mosquittopp::unsubscribe(NULL, filter.c_str());
+    return true;
+}
+
 /**
  * \func void MQTTClient::on_connect(int rc)
  * \param rc The callback code indicating success or failure and failure reason
@@ -78,7 +310,31 @@ void MQTTClient::on_connect(int rc)
     
     if (m_debug)
         std::cerr << __FUNCTION__ << "Connected with code " << rc << std::endl;
+
+    // Connected and replayed under the router lock. A subscribe() either lands
+    // in m_subscriptions before the replay, or sees the client connected and
+    // sends its own, nothing falls in between.
+    {
+        std::unique_lock<std::shared_mutex> lock(m_routerMutex);
+        m_connected = true;
+        for (const auto &subscription : m_subscriptions)
+            mosqpp::mosquittopp::subscribe(NULL, subscription.first.c_str(), subscription.second);
+    }
     
+    {
+        std::lock_guard<std::mutex> lock(m_runMutex);
+        m_failures = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        uint64_t now = monotonicNs();
+        m_stats.connects++;
+        m_stats.lastConnectNs = now - m_attemptNs;
+        if (m_stats.firstConnectNs == 0)
+            m_stats.firstConnectNs = now - m_createdNs;
+        m_stats.backoffNs = 0;
+    }
+
     if (m_genericCallback) {
         try {
             m_genericCallback(CallbackType::CONNECT, rc);
@@ -88,7 +344,6 @@ void MQTTClient::on_connect(int rc)
             return;
         }
     }
-    m_connected = true;
 }
 
 void MQTTClient::on_disconnect(int rc)
@@ -96,6 +351,22 @@ void MQTTClient::on_disconnect(int rc)
     if (m_debug)
         std::cerr << __FUNCTION__ << ": Disconnected with code " << rc << std::endl;
 
+    if (m_connected) {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats.disconnects++;
+    }
+
+    // QoS 0 messages still queued are dropped by libmosquitto, QoS 1 and 2 are sent again on reconnect
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+        for (auto it = m_inflight.begin(); it != m_inflight.end(); ) {
+            if (it->second.qos == 0)
+                it = m_inflight.erase(it);
+            else
+                ++it;
+        }
+    }
+
     if (m_genericCallback) {
         try {
             m_genericCallback(CallbackType::DISCONNECT, rc);
@@ -134,17 +405,41 @@ void MQTTClient::on_error()
     }
 }
 
+/**
+ * \func void MQTTClient::on_message(const struct mosquitto_message *msg)
+ *
+ * Hands the message to the handler of every matching subscription, or to the
+ * message callback if none matches. Topic and payload are passed as they sit
+ * in msg. The matching handlers are collected as shared references under the
+ * router lock and run after it is let go, so a handler may subscribe or
+ * unsubscribe; neither the message nor a handler is copied.
+ */
 void MQTTClient::on_message(const struct mosquitto_message *msg)
 {
-    std::string topic = msg->topic;
-    uint32_t payload[2048];
-    
-    if (m_messageCallback) {
-        memset(payload, 0, 2048);
-        memcpy(payload, msg->payload, msg->payloadlen);
-        
+    std::string_view topic(msg->topic);
+    const uint8_t *payload = static_cast<const uint8_t*>(msg->payload);
+    size_t size = msg->payloadlen > 0 ? msg->payloadlen : 0;
+    size_t handled = 0;
+
+    m_matched.clear();
+    {
+        std::shared_lock<std::shared_mutex> lock(m_routerMutex);
+        handled = m_router.handlers(topic, m_matched);
+    }
+
+    try {
+        for (const SharedHandler &handler : m_matched)
+            (*handler)(topic, payload, size);
+    }
+    catch (std::bad_function_call e) {
+        std::cerr << __FUNCTION__ << "Caught exception " << e.what() << std::endl;
+    }
+    // An unsubscribed handler, and what it captured, goes now rather than with the next message
+    m_matched.clear();
+
+    if (handled == 0 && m_messageCallback) {
         try {
-            m_messageCallback(msg->mid, topic, payload, msg->payloadlen);
+            m_messageCallback(topic, payload, size);
         }
         catch (std::bad_function_call e) {
             std::cerr << __FUNCTION__ << "Caught exception " << e.what() << std::endl;
@@ -155,6 +450,17 @@ void MQTTClient::on_message(const struct mosquitto_message *msg)
 
 void MQTTClient::on_publish(int mid)
 {
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_inflightMutex);
+        auto it = m_inflight.find(mid);
+        if (it != m_inflight.end()) {
+            m_latency.record(monotonicNs() - it->second.sent);
+            if (it->second.qos > 0)
+                m_inflightQos--;
+            m_inflight.erase(it);
+        }
+    }
+
     if (m_genericCallback) {
         try {
             m_genericCallback(CallbackType::PUBLISH, mid);
@@ -32,6 +32,31 @@
 #include <cstring>
 #include <mosquittopp.h>
 #include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "latencyhistogram.h"
+#include "topicrouter.h"
+
+/**
+ * Connection history, for telling a flaky network from a flaky broker
+ */
+struct ConnectionStats {
+    uint64_t attempts;          // connections started, first one included
+    uint64_t connects;          // attempts the broker accepted
+    uint64_t disconnects;       // established connections that were lost
+    uint64_t firstConnectNs;    // construction to the first CONNACK, 0 until then
+    uint64_t lastConnectNs;     // attempt to CONNACK of the latest connection
+    uint64_t backoffNs;         // wait before the next attempt, 0 while connected
+};
 
 class MQTTClient : public mosqpp::mosquittopp
 {
@@ -44,12 +69,28 @@ public:
         DISCONNECT,
     };
 
-    MQTTClient(std::string &id, std::string host, int port = 1883);
+    // publish() result when the QoS 1/2 in-flight window is full
+    static const int WINDOW_FULL = 256;
+
+    MQTTClient(std::string &id, std::string host, int port = 1883, int keepalive = 120);
     virtual ~MQTTClient();
 
+    void setReconnectDelay(std::chrono::milliseconds initial, std::chrono::milliseconds max);
+    ConnectionStats connectionStats();
+
+    int publish(int *mid, const char *topic, int payloadlen = 0, const void *payload = NULL, int qos = 0, bool retain = false);
+    void setMaxInflight(unsigned int messages);
+    unsigned int maxInflight() const { return m_maxInflight; }
+    unsigned int inflight();
+    uint64_t windowFull();
+    LatencyHistogram latency(bool reset = false);
+
+    bool subscribe(const std::string &filter, MessageHandler handler, int qos = 0);
+    bool unsubscribe(const std::string &filter);
+
     bool isConnected() { return m_connected; }
     void setGenericCallback(std::function<void(CallbackType, int)> cbk) { m_genericCallback = cbk; }
-    void setMessageCallback(std::function<void(int, std::string, uint32_t*, int)> cbk) { m_messageCallback = cbk; }
+    void setMessageCallback(MessageHandler cbk) { m_messageCallback = cbk; }
     void setErrorCallback(std::function<void(std::string, int)> cbk) { m_errorCallback = cbk; }
     
     void enableDebug(bool debug) { m_debug = debug; }
@@ -67,11 +108,50 @@ private:
     std::string m_name;
     std::string m_host;
     std::function<void(CallbackType, int)> m_genericCallback;
-    std::function<void(int, std::string, uint32_t*, int)> m_messageCallback;
+    MessageHandler m_messageCallback;
     std::function<void(std::string, int)> m_errorCallback;
     int m_port;
+    int m_keepalive;
     int m_debug;
-    int m_connected;
+    std::atomic<bool> m_connected;
+
+    void run();
+    void scheduleReconnect();
+
+    // The network thread, it owns the socket and every reconnect
+    std::thread m_thread;
+    std::mutex m_runMutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_running;
+    std::chrono::steady_clock::time_point m_nextAttempt;
+    std::chrono::milliseconds m_initialDelay;
+    std::chrono::milliseconds m_maxDelay;
+    unsigned int m_failures;
+    std::mt19937 m_random;
+
+    std::mutex m_statsMutex;
+    ConnectionStats m_stats;
+    uint64_t m_createdNs;
+    uint64_t m_attemptNs;
+
+    struct Inflight {
+        uint64_t sent;      // CLOCK_MONOTONIC ns when publish() handed it over
+        int qos;
+    };
+    // Recursive because libmosquitto may call on_publish() from inside publish()
+    std::recursive_mutex m_inflightMutex;
+    std::unordered_map<int, Inflight> m_inflight;
+    unsigned int m_inflightQos;
+    unsigned int m_maxInflight;
+    uint64_t m_windowFull;
+    LatencyHistogram m_latency;
+
+    // on_message() only takes a shared lock and never holds it while a handler runs.
+    // subscribe(), unsubscribe() and on_connect() take the exclusive one.
+    std::shared_mutex m_routerMutex;
+    TopicRouter m_router;
+    std::map<std::string, int> m_subscriptions;
+    std::vector<SharedHandler> m_matched;   // on_message only, keeps its capacity
 };
 
 #endif // MQTTClient_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+
+#include "oleddisplay.h"
+
+OledDisplay::OledDisplay(I2cScheduler &i2c, uint8_t address) :
+    m_i2c(i2c), m_address(address), m_valid(false), m_sent(0), m_skipped(0)
+{
+    memset(m_shown, 0, sizeof(m_shown));
+}
+
+/**
+ * \func int OledDisplay::init()
+ * \return 0, or a negative errno
+ *
+ * The SSD1306 power up sequence the Onion library sends, with horizontal
+ * addressing so every chunk can say where it goes. Leaves the panel
+ * blank.
+ */
+int OledDisplay::init()
+{
+    std::vector<I2cMessage> messages = { I2cMessage::send({
+        0x00,           // commands follow
+        0xae,           // display off
+        0xd5, 0x80,     // clock divide
+        0xa8, 0x3f,     // multiplex, 64 rows
+        0xd3, 0x00,     // no display offset
+        0x40,           // start line 0
+        0x8d, 0x14,     // charge pump on
+        0x20, 0x00,     // horizontal addressing
+        0xa1,           // segment remap
+        0xc8,           // scan from COM63
+        0xda, 0x12,     // COM pins
+        0x81, 0xcf,     // contrast
+        0xd9, 0xf1,     // precharge
+        0xdb, 0x40,     // VCOMH deselect
+        0xa4,           // show RAM
+        0xa6,           // not inverted
+        0xaf            // display on
+    }) };
+
+    int rc = m_i2c.transfer(m_address, messages, I2cScheduler::Display);
+    if (rc == 0) {
+        m_valid = false;
+        clear();
+    }
+    return rc;
+}
+
+/**
+ * \func void OledDisplay::draw(const uint8_t *frame)
+ * \param frame FrameSize bytes in the panel's layout: a page at a time, a
+ * byte per column, the least significant bit at the top
+ *
+ * Queues the chunks that differ from the last frame and returns. If any
+ * chunk fails to go out, the next frame is sent whole.
+ */
+void OledDisplay::draw(const uint8_t *frame)
+{
+    bool full = !m_valid.exchange(true);
+
+    for (int chunk = 0; chunk < Chunks; chunk++) {
+        int offset = chunk * ChunkColumns;
+        uint8_t page = offset / Width;
+        uint8_t column = offset % Width;
+
+        if (!full && memcmp(m_shown + offset, frame + offset, ChunkColumns) == 0) {
+            m_skipped++;
+            continue;
+        }
+        memcpy(m_shown + offset, frame + offset, ChunkColumns);
+
+        std::vector<uint8_t> data(ChunkColumns + 1);
+        data[0] = 0x40;     // display data follows
+        memcpy(data.data() + 1, frame + offset, ChunkColumns);
+
+        std::vector<I2cMessage> messages = {
+            I2cMessage::send({ 0x00, 0x21, column, static_cast<uint8_t>(column + ChunkColumns - 1), 0x22, page, page }),
+            I2cMessage::send(std::move(data))
+        };
+        m_i2c.submit(m_address, std::move(messages), I2cScheduler::Display, [this](int rc, const std::vector<I2cMessage>&) {
+            if (rc != 0)
+                m_valid = false;
+        }, chunk);
+        m_sent++;
+    }
+}
+
+/**
+ * \func void OledDisplay::clear()
+ *
+ * Blanks the panel
+ */
+void OledDisplay::clear()
+{
+    uint8_t blank[FrameSize];
+    memset(blank, 0, sizeof(blank));
+    draw(blank);
+}
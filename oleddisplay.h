@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OLEDDISPLAY_H
+#define OLEDDISPLAY_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "i2cbus.h"
+
+/**
+ * The Onion OLED expansion, an SSD1306 with a 128x64 panel, driven through
+ * the I2C scheduler at display priority. A frame goes out as small chunks,
+ * each its own transaction, so a relay command never waits behind more
+ * than one of them. Chunks that have not changed since the last frame are
+ * not sent, and a chunk still queued from an earlier frame is replaced
+ * rather than sent twice.
+ */
+class OledDisplay
+{
+public:
+    static constexpr int Width = 128;
+    static constexpr int Pages = 8;                         // rows of 8 pixels
+    static constexpr int FrameSize = Width * Pages;
+    static constexpr int ChunkColumns = 32;
+    static constexpr int Chunks = FrameSize / ChunkColumns;
+
+    explicit OledDisplay(I2cScheduler &i2c, uint8_t address = 0x3c);
+
+    int init();
+    void draw(const uint8_t *frame);
+    void clear();
+
+    uint64_t chunksSent() const { return m_sent; }
+    uint64_t chunksSkipped() const { return m_skipped; }
+
+private:
+    I2cScheduler &m_i2c;
+    uint8_t m_address;
+    uint8_t m_shown[FrameSize];     // the last frame queued, in panel layout
+    std::atomic<bool> m_valid;      // false until the panel is known to show m_shown
+    uint64_t m_sent;
+    uint64_t m_skipped;
+};
+
+#endif // OLEDDISPLAY_H
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "payloadcodec.h"
+
+static const char *s_formatNames[] = { "json", "cbor", "msgpack", "packed" };
+
+const char *payloadFormatName(PayloadFormat format)
+{
+    return s_formatNames[static_cast<int>(format)];
+}
+
+bool payloadFormatFromName(const std::string &name, PayloadFormat &format)
+{
+    for (int i = 0; i < 4; i++) {
+        if (name == s_formatNames[i]) {
+            format = static_cast<PayloadFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \func const std::vector<uint8_t> &PayloadEncoder::encode(const EnvironmentReading &reading)
+ * \param reading The sample to encode
+ * \return The encoded payload, valid until the next call
+ *
+ * JSON, CBOR and MessagePack all encode the document environmentDocument()
+ * builds. The document is kept between calls, so only its values change.
+ *
+ * PACKED is 16 bytes of header followed by the location and the system name,
+ * each as a length byte and up to 255 bytes of text:
+ *   0  uint8   version, PackedVersion
+ *   1  uint8   light, 0 or 1, 0xff when unknown
+ *   2  int16   celsius * 100
+ *   4  uint16  humidity * 100
+ *   6  uint16  confidence * 10000
+ *   8  uint32  uptime in seconds
+ *   12 uint32  reserved, 0
+ * All multi-byte fields are little endian.
+ */
+const std::vector<uint8_t> &PayloadEncoder::encode(const EnvironmentReading &reading)
+{
+    m_buffer.clear();
+
+    switch (m_format) {
+    case PayloadFormat::JSON: {
+        environmentDocument(m_doc, reading);
+        encodeJson(m_doc);
+        break;
+    }
+    case PayloadFormat::CBOR:
+        environmentDocument(m_doc, reading);
+        nlohmann::json::to_cbor(m_doc, m_buffer);
+        break;
+    case PayloadFormat::MSGPACK:
+        environmentDocument(m_doc, reading);
+        nlohmann::json::to_msgpack(m_doc, m_buffer);
+        break;
+    case PayloadFormat::PACKED:
+        encodePacked(reading);
+        break;
+    }
+    return m_buffer;
+}
+
+/**
+ * \func const std::vector<uint8_t> &PayloadEncoder::encode(const SoilReading &reading)
+ * \param reading The probes to encode
+ * \return The encoded payload, valid until the next call
+ *
+ * The soil document from soilDocument(), or in PACKED a 2 byte header, 5
+ * bytes per probe, then the location and system name as above:
+ *   0  uint8   version, PackedVersion
+ *   1  uint8   number of probes
+ * and for each probe
+ *   0  uint8   ADC channel
+ *   1  uint16  moisture percent * 100
+ *   3  int16   filtered ADC counts
+ */
+const std::vector<uint8_t> &PayloadEncoder::encode(const SoilReading &reading)
+{
+    m_buffer.clear();
+
+    switch (m_format) {
+    case PayloadFormat::JSON: {
+        soilDocument(m_soilDoc, reading);
+        encodeJson(m_soilDoc);
+        break;
+    }
+    case PayloadFormat::CBOR:
+        soilDocument(m_soilDoc, reading);
+        nlohmann::json::to_cbor(m_soilDoc, m_buffer);
+        break;
+    case PayloadFormat::MSGPACK:
+        soilDocument(m_soilDoc, reading);
+        nlohmann::json::to_msgpack(m_soilDoc, m_buffer);
+        break;
+    case PayloadFormat::PACKED:
+        encodePacked(reading);
+        break;
+    }
+    return m_buffer;
+}
+
+/**
+ * \func std::string PayloadEncoder::topic(const std::string &base) const
+ * \param base The topic JSON has always been published on
+ *
+ * JSON stays on base so existing subscribers keep working, the other
+ * formats are advertised with a suffix, e.g. planter/environment/cbor.
+ */
+std::string PayloadEncoder::topic(const std::string &base) const
+{
+    if (m_format == PayloadFormat::JSON)
+        return base;
+    return base + "/" + payloadFormatName(m_format);
+}
+
+/**
+ * \func void PayloadEncoder::encodeJson(const nlohmann::json &doc)
+ *
+ * What doc.dump() produces, written into m_buffer as it is serialized
+ * rather than built as a string and copied over
+ */
+void PayloadEncoder::encodeJson(const nlohmann::json &doc)
+{
+    // A failed write would leave the stream refusing every later one
+    m_json.clear();
+    m_json << doc;
+}
+
+static void putLe16(std::vector<uint8_t> &buffer, uint16_t value)
+{
+    buffer.push_back(value & 0xff);
+    buffer.push_back(value >> 8);
+}
+
+static void putLe32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+    putLe16(buffer, value & 0xffff);
+    putLe16(buffer, value >> 16);
+}
+
+static void putString(std::vector<uint8_t> &buffer, const std::string &text)
+{
+    size_t length = text.size() > 255 ? 255 : text.size();
+    buffer.push_back(static_cast<uint8_t>(length));
+    buffer.insert(buffer.end(), text.begin(), text.begin() + length);
+}
+
+static uint16_t getLe16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t getLe32(const uint8_t *data)
+{
+    return getLe16(data) | (static_cast<uint32_t>(getLe16(data + 2)) << 16);
+}
+
+void PayloadEncoder::encodePacked(const EnvironmentReading &reading)
+{
+    long celsius = lroundf(reading.celsius * 100);
+    long humidity = lroundf(reading.humidity * 100);
+    long confidence = lroundf(reading.confidence * 10000);
+
+    m_buffer.push_back(PackedVersion);
+    m_buffer.push_back(reading.light < 0 ? 0xff : (reading.light ? 1 : 0));
+    putLe16(m_buffer, static_cast<uint16_t>(static_cast<int16_t>(std::max(-32768L, std::min(32767L, celsius)))));
+    putLe16(m_buffer, static_cast<uint16_t>(std::max(0L, std::min(65535L, humidity))));
+    putLe16(m_buffer, static_cast<uint16_t>(std::max(0L, std::min(10000L, confidence))));
+    putLe32(m_buffer, static_cast<uint32_t>(reading.uptime));
+    putLe32(m_buffer, 0);
+    putString(m_buffer, reading.location);
+    putString(m_buffer, reading.name);
+}
+
+void PayloadEncoder::encodePacked(const SoilReading &reading)
+{
+    size_t count = std::min<size_t>(reading.probes.size(), 255);
+
+    m_buffer.push_back(PackedVersion);
+    m_buffer.push_back(static_cast<uint8_t>(count));
+    for (size_t i = 0; i < count; i++) {
+        const SoilProbeReading &probe = reading.probes[i];
+        long moisture = lroundf(probe.moisture * 100);
+        long raw = lroundf(probe.raw);
+
+        m_buffer.push_back(static_cast<uint8_t>(probe.channel));
+        putLe16(m_buffer, static_cast<uint16_t>(std::max(0L, std::min(10000L, moisture))));
+        putLe16(m_buffer, static_cast<uint16_t>(static_cast<int16_t>(std::max(-32768L, std::min(32767L, raw)))));
+    }
+    putString(m_buffer, reading.location);
+    putString(m_buffer, reading.name);
+}
+
+/**
+ * \func bool PayloadEncoder::decodePacked(const uint8_t *data, size_t size, EnvironmentReading &reading)
+ * \return false if the payload is truncated or of another version
+ *
+ * The consumer side of PACKED
+ */
+bool PayloadEncoder::decodePacked(const uint8_t *data, size_t size, EnvironmentReading &reading)
+{
+    if (size < PackedHeaderSize + 2 || data[0] != PackedVersion)
+        return false;
+
+    reading.light = (data[1] == 0xff) ? -1 : data[1];
+    reading.celsius = static_cast<int16_t>(getLe16(data + 2)) / 100.0f;
+    reading.humidity = getLe16(data + 4) / 100.0f;
+    reading.confidence = getLe16(data + 6) / 10000.0f;
+    reading.uptime = getLe32(data + 8);
+
+    size_t offset = PackedHeaderSize;
+    size_t length = data[offset++];
+    if (offset + length + 1 > size)
+        return false;
+    reading.location.assign(reinterpret_cast<const char*>(data + offset), length);
+    offset += length;
+    length = data[offset++];
+    if (offset + length > size)
+        return false;
+    reading.name.assign(reinterpret_cast<const char*>(data + offset), length);
+    return true;
+}
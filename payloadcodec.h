@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PAYLOADCODEC_H
+#define PAYLOADCODEC_H
+
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "environment.h"
+
+/**
+ * Wire formats for the environment payload. JSON is the original document;
+ * CBOR and MessagePack carry the same document in binary; PACKED is a fixed
+ * little-endian layout, see PayloadEncoder::encode().
+ */
+enum class PayloadFormat {
+    JSON = 0,
+    CBOR,
+    MSGPACK,
+    PACKED,
+};
+
+const char *payloadFormatName(PayloadFormat format);
+bool payloadFormatFromName(const std::string &name, PayloadFormat &format);
+
+/**
+ * Appends whatever is written to a stream to a byte buffer, so the JSON
+ * operator<< serializes straight into the payload
+ */
+class PayloadStreambuf : public std::streambuf
+{
+public:
+    explicit PayloadStreambuf(std::vector<uint8_t> &buffer) : m_buffer(buffer) {}
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            m_buffer.push_back(static_cast<uint8_t>(c));
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char *s, std::streamsize count) override
+    {
+        m_buffer.insert(m_buffer.end(), s, s + count);
+        return count;
+    }
+
+private:
+    std::vector<uint8_t> &m_buffer;
+};
+
+/**
+ * Encodes environment readings in one format into a buffer that is reused
+ * from one reading to the next, so a publish encodes exactly once and,
+ * once the buffer has grown, allocates nothing for the result.
+ */
+class PayloadEncoder
+{
+public:
+    static constexpr uint8_t PackedVersion = 1;
+    static constexpr size_t PackedHeaderSize = 16;
+
+    explicit PayloadEncoder(PayloadFormat format = PayloadFormat::JSON) :
+        m_format(format), m_jsonBuffer(m_buffer), m_json(&m_jsonBuffer) {}
+
+    void setFormat(PayloadFormat format) { m_format = format; }
+    PayloadFormat format() const { return m_format; }
+
+    const std::vector<uint8_t> &encode(const EnvironmentReading &reading);
+    const std::vector<uint8_t> &encode(const SoilReading &reading);
+    const std::vector<uint8_t> &buffer() const { return m_buffer; }
+
+    std::string topic(const std::string &base) const;
+
+    static bool decodePacked(const uint8_t *data, size_t size, EnvironmentReading &reading);
+
+private:
+    void encodeJson(const nlohmann::json &doc);
+    void encodePacked(const EnvironmentReading &reading);
+    void encodePacked(const SoilReading &reading);
+
+    PayloadFormat m_format;
+    std::vector<uint8_t> m_buffer;
+    PayloadStreambuf m_jsonBuffer;      // writes to m_buffer, so the encoder can't be copied
+    std::ostream m_json;
+    nlohmann::json m_doc;
+    nlohmann::json m_soilDoc;
+};
+
+#endif // PAYLOADCODEC_H
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <fstream>
+
+#include "dht_read.h"
+#include "planterconfig.h"
+
+/**
+ * \func int SensorConfig::dhtType() const
+ * \return DHT11 or DHT22, -1 for a driver that is not a DHT
+ */
+int SensorConfig::dhtType() const
+{
+    if (driver == "dht11")
+        return DHT11;
+    if (driver == "dht22")
+        return DHT22;
+    return -1;
+}
+
+PlanterConfig::PlanterConfig() : location("familyroom"), broker("172.24.1.13"), port(1883)
+{
+    SensorConfig environment = {};
+    environment.driver = "dht22";
+    environment.pin = 19;
+    environment.interval = 60;
+    environment.topic = "planter/environment";
+    environment.location = location;
+    sensors.push_back(environment);
+
+    RelayConfig lamp = { 7, 1, RelaySchedule() };
+    lamp.schedule.addWindow(7 * 60, 20 * 60);
+    relays.push_back(lamp);
+}
+
+/**
+ * \func bool PlanterConfig::load(const std::string &path, std::string &error)
+ * \param path JSON file to read
+ * \param error Says what is wrong when false is returned
+ *
+ * See parse() for the layout
+ */
+bool PlanterConfig::load(const std::string &path, std::string &error)
+{
+    std::ifstream ifs(path);
+    if (!ifs) {
+        error = "unable to open " + path;
+        return false;
+    }
+
+    nlohmann::json doc = nlohmann::json::parse(ifs, nullptr, false);
+    if (doc.is_discarded()) {
+        error = path + " is not valid JSON";
+        return false;
+    }
+    return parse(doc, error);
+}
+
+/**
+ * \func bool PlanterConfig::parse(const nlohmann::json &doc, std::string &error)
+ * \param doc The configuration document
+ * \param error Says what is wrong when false is returned
+ *
+ * Every key is optional, anything left out keeps its default. A sensors
+ * or relays array replaces the default sensors or relays entirely.
+ *
+ *   {
+ *     "location": "greenhouse",
+ *     "broker": { "host": "172.24.1.13", "port": 1883 },
+ *     "sensors": [
+ *       { "driver": "dht22", "pin": 19, "interval": 60, "topic": "planter/environment", "location": "tray1" },
+ *       { "driver": "soil", "address": 72, "channel": 0, "dry": 17000, "wet": 8000, "interval": 60 }
+ *     ],
+ *     "relays": [
+ *       { "address": 7, "channel": 1, "schedule": "07:00-20:00", "ramp": "2026-03-01/14/12:00/16:00" }
+ *     ]
+ *   }
+ */
+bool PlanterConfig::parse(const nlohmann::json &doc, std::string &error)
+{
+    try {
+        if (!doc.is_object()) {
+            error = "the configuration must be a JSON object";
+            return false;
+        }
+        location = doc.value("location", location);
+        if (doc.contains("broker")) {
+            broker = doc["broker"].value("host", broker);
+            port = doc["broker"].value("port", port);
+        }
+        if (doc.contains("sensors")) {
+            sensors.clear();
+            for (const nlohmann::json &entry : doc["sensors"]) {
+                if (!addSensor(entry, error))
+                    return false;
+            }
+        }
+        else {
+            for (SensorConfig &sensor : sensors)
+                sensor.location = location;
+        }
+        if (doc.contains("relays")) {
+            relays.clear();
+            for (const nlohmann::json &entry : doc["relays"]) {
+                if (!addRelay(entry, error))
+                    return false;
+            }
+        }
+    }
+    catch (nlohmann::json::exception &e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \func bool PlanterConfig::addSensor(const nlohmann::json &entry, std::string &error)
+ * \param entry One element of the sensors array
+ * \param error Says what is wrong when false is returned
+ */
+bool PlanterConfig::addSensor(const nlohmann::json &entry, std::string &error)
+{
+    SensorConfig sensor = {};
+
+    sensor.driver = entry.at("driver").get<std::string>();
+    sensor.interval = entry.value("interval", 60);
+    sensor.location = entry.value("location", location);
+
+    if (sensor.interval < 1) {
+        error = "sensor interval must be at least 1 second";
+        return false;
+    }
+
+    if (sensor.dhtType() > 0) {
+        sensor.pin = entry.at("pin").get<int>();
+        sensor.topic = entry.value("topic", "planter/environment");
+        if (sensor.pin < 0 || sensor.pin >= 96) {
+            error = "DHT pin must be a GPIO from 0 to 95";
+            return false;
+        }
+        for (const SensorConfig &other : sensors) {
+            if (other.dhtType() > 0 && other.pin == sensor.pin) {
+                error = "more than one DHT on GPIO " + std::to_string(sensor.pin);
+                return false;
+            }
+        }
+        // A DHT needs its interval between conversions, faster than that only returns the cache
+        if (static_cast<uint32_t>(sensor.interval) * 1000 < dht_get_timing(sensor.dhtType())->interval_ms) {
+            error = "a " + sensor.driver + " can not be read more than once every " +
+                    std::to_string(dht_get_timing(sensor.dhtType())->interval_ms / 1000) + "s";
+            return false;
+        }
+    }
+    else if (sensor.driver == "soil") {
+        sensor.address = entry.value("address", 0x48);
+        sensor.channel = entry.at("channel").get<int>();
+        sensor.calibration.dry = entry.at("dry").get<float>();
+        sensor.calibration.wet = entry.at("wet").get<float>();
+        sensor.topic = entry.value("topic", "planter/soil");
+        if (sensor.channel < 0 || sensor.channel >= Ads1115::Channels) {
+            error = "soil channel must be an ADC input from 0 to 3";
+            return false;
+        }
+        if (sensor.calibration.dry == sensor.calibration.wet) {
+            error = "soil dry and wet calibration must differ";
+            return false;
+        }
+    }
+    else {
+        error = "unknown sensor driver " + sensor.driver;
+        return false;
+    }
+
+    sensors.push_back(sensor);
+    return true;
+}
+
+/**
+ * \func bool PlanterConfig::addRelay(const nlohmann::json &entry, std::string &error)
+ * \param entry One element of the relays array
+ * \param error Says what is wrong when false is returned
+ */
+bool PlanterConfig::addRelay(const nlohmann::json &entry, std::string &error)
+{
+    RelayConfig relay = { entry.value("address", 7), entry.at("channel").get<int>(), RelaySchedule() };
+
+    if (relay.address < 0 || relay.address > 7 || relay.channel < 0 || relay.channel > 1) {
+        error = "relay address must be 0 to 7 and channel 0 or 1";
+        return false;
+    }
+    for (const RelayConfig &other : relays) {
+        if (other.address == relay.address && other.channel == relay.channel) {
+            error = "relay " + std::to_string(relay.address) + "/" + std::to_string(relay.channel) + " is listed twice";
+            return false;
+        }
+    }
+    if (!relay.schedule.parseWindows(entry.at("schedule").get<std::string>())) {
+        error = "relay schedule must be HH:MM-HH:MM[,HH:MM-HH:MM...]";
+        return false;
+    }
+    if (entry.contains("ramp") && !relay.schedule.parseRamp(entry["ramp"].get<std::string>())) {
+        error = "relay ramp must be YYYY-MM-DD/DAYS/HH:MM/HH:MM";
+        return false;
+    }
+
+    relays.push_back(relay);
+    return true;
+}
+
+/**
+ * \func std::vector<SensorGroup> PlanterConfig::groups() const
+ *
+ * Sorts the sensors into groups read in one window: DHTs of one type on
+ * one GPIO bank at one interval are captured together by dht_read_many(),
+ * up to DHT_MAX_SENSORS at a time, and the probes on one ADC at one
+ * interval are read back to back.
+ */
+std::vector<SensorGroup> PlanterConfig::groups() const
+{
+    std::vector<SensorGroup> result;
+
+    for (size_t i = 0; i < sensors.size(); i++) {
+        const SensorConfig &sensor = sensors[i];
+        int bus = sensor.dhtType() > 0 ? sensor.pin / 32 : sensor.address;
+        bool placed = false;
+
+        for (SensorGroup &group : result) {
+            if (group.driver == sensor.driver && group.bus == bus && group.interval == sensor.interval &&
+                (sensor.dhtType() < 0 || group.members.size() < DHT_MAX_SENSORS)) {
+                group.members.push_back(i);
+                placed = true;
+                break;
+            }
+        }
+        if (!placed)
+            result.push_back(SensorGroup{ sensor.driver, bus, sensor.interval, { i } });
+    }
+    return result;
+}
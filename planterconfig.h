@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PLANTERCONFIG_H
+#define PLANTERCONFIG_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "relaycontroller.h"
+#include "soilsensor.h"
+
+/**
+ * One sensor in the registry
+ */
+struct SensorConfig {
+    std::string driver;         // "dht11", "dht22" or "soil"
+    int pin;                    // DHT data GPIO
+    int address;                // soil: I2C address of the ADC
+    int channel;                // soil: ADC input
+    int interval;               // seconds between readings
+    std::string topic;
+    std::string location;
+    SoilCalibration calibration;
+
+    int dhtType() const;
+};
+
+/**
+ * One relay channel and when it is on
+ */
+struct RelayConfig {
+    int address;                // relay expansion address switches, 0 to 7
+    int channel;
+    RelaySchedule schedule;
+};
+
+/**
+ * Sensors that can be read in one acquisition window: the same driver on
+ * the same bus, a GPIO bank for DHTs or an ADC for soil probes, at the same
+ * interval.
+ */
+struct SensorGroup {
+    std::string driver;
+    int bus;
+    int interval;
+    std::vector<size_t> members;    // indexes into PlanterConfig::sensors
+};
+
+/**
+ * What is wired to this Omega and where its readings go. Without a config
+ * file this is the original installation: a DHT22 on GPIO 19, the lamp on
+ * relay 7 channel 1 from 07:00 to 20:00, location familyroom, broker
+ * 172.24.1.13:1883.
+ */
+struct PlanterConfig {
+    std::string location;
+    std::string broker;
+    int port;
+    std::vector<SensorConfig> sensors;
+    std::vector<RelayConfig> relays;
+
+    PlanterConfig();
+
+    bool load(const std::string &path, std::string &error);
+    bool parse(const nlohmann::json &doc, std::string &error);
+    bool addSensor(const nlohmann::json &entry, std::string &error);
+    bool addRelay(const nlohmann::json &entry, std::string &error);
+
+    std::vector<SensorGroup> groups() const;
+};
+
+#endif // PLANTERCONFIG_H
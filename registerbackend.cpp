@@ -0,0 +1,34 @@
+#include <registerbackend.h>
+
+#include <string.h>
+
+MemoryRegisterBackend::MemoryRegisterBackend(uint32_t blockSize)
+{
+	// block size is in bytes, registers are 32 bits wide
+	numRegisters	= (blockSize + 3) / 4;
+	registers		= new uint32_t[numRegisters];
+	memset(registers, 0, numRegisters * sizeof(uint32_t));
+}
+
+MemoryRegisterBackend::~MemoryRegisterBackend(void)
+{
+	delete [] registers;
+}
+
+uint32_t MemoryRegisterBackend::Read(uint32_t registerOffset)
+{
+	if (registerOffset >= numRegisters) {
+		return 0;
+	}
+
+	return registers[registerOffset];
+}
+
+void MemoryRegisterBackend::Write(uint32_t registerOffset, uint32_t value)
+{
+	if (registerOffset >= numRegisters) {
+		return;
+	}
+
+	registers[registerOffset]	= value;
+}
@@ -0,0 +1,34 @@
+#ifndef _REGISTER_BACKEND_H_
+#define _REGISTER_BACKEND_H_
+
+#include <stdint.h>
+
+// Interface for anything that can stand in for a memory mapped register block.
+// Offsets are in 32-bit words from the start of the block, the same units
+// Module::_ReadReg and Module::_WriteReg use.
+class RegisterBackend {
+public:
+	virtual ~RegisterBackend(void) {}
+
+	virtual uint32_t	Read 			(uint32_t registerOffset)=0;
+	virtual void 		Write 			(uint32_t registerOffset, uint32_t value)=0;
+};
+
+// Plain memory backed register file. Writes are stored and read back as-is,
+// derived classes add device specific side effects.
+class MemoryRegisterBackend : public RegisterBackend {
+public:
+	MemoryRegisterBackend(uint32_t blockSize);
+	virtual ~MemoryRegisterBackend(void);
+
+	virtual uint32_t	Read 			(uint32_t registerOffset);
+	virtual void 		Write 			(uint32_t registerOffset, uint32_t value);
+
+	uint32_t 			NumRegisters	(void) { return numRegisters; }
+
+protected:
+	uint32_t			*registers;
+	uint32_t 			numRegisters;
+};
+
+#endif 	// _REGISTER_BACKEND_H_
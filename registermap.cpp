@@ -0,0 +1,68 @@
+#include <registermap.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::mutex RegisterMap::lock;
+std::map<std::pair<std::string, uint32_t>, std::weak_ptr<RegisterMap> > RegisterMap::maps;
+
+RegisterMap::RegisterMap(volatile uint32_t *address, uint32_t blockSize)
+{
+	regAddress	= address;
+	size		= blockSize;
+}
+
+RegisterMap::~RegisterMap(void)
+{
+	munmap((void*)regAddress, size);
+}
+
+std::shared_ptr<RegisterMap> RegisterMap::Acquire(uint32_t blockBaseAddr, uint32_t blockSize, const char *device)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::pair<std::string, uint32_t> 	key(device, blockBaseAddr);
+	std::shared_ptr<RegisterMap> 		map = maps[key].lock();
+	int 								m_mfd;
+	void 								*address;
+
+	if (map && map->size >= blockSize) {
+		return map;
+	}
+
+	if ((m_mfd = open(device, O_RDWR)) < 0) {
+		return NULL;
+	}
+
+	address = mmap	(	NULL, 
+						blockSize, 
+						PROT_READ|PROT_WRITE, 
+						MAP_SHARED, 
+						m_mfd, 
+						blockBaseAddr
+					);
+	close(m_mfd);
+
+	if (address == MAP_FAILED) {
+		return NULL;
+	}
+
+	map.reset(new RegisterMap((volatile uint32_t*)address, blockSize));
+	maps[key] 	= map;
+
+	return map;
+}
+
+int RegisterMap::NumMappings(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int count = 0;
+
+	for (auto &entry : maps) {
+		if (!entry.second.expired()) {
+			count++;
+		}
+	}
+
+	return count;
+}
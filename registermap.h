@@ -0,0 +1,38 @@
+#ifndef _REGISTER_MAP_H_
+#define _REGISTER_MAP_H_
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// One mmap of a physical register block, shared by every Module that asks for
+// the same block. The mapping is made by the first Acquire and unmapped when
+// the last reference goes away, so holding one reference for the life of the
+// process (as main does) means no open/mmap at all when GPIO objects come and go.
+class RegisterMap {
+public:
+	~RegisterMap(void);
+
+	// NULL if the device could not be opened or mapped
+	static std::shared_ptr<RegisterMap> 	Acquire 	(uint32_t blockBaseAddr, uint32_t blockSize, const char *device = "/dev/mem");
+
+	volatile uint32_t* 	GetAddress 		(void) { return regAddress; }
+	uint32_t 			GetSize 		(void) { return size; }
+
+	// number of mappings currently alive, for leak checks
+	static int 			NumMappings 	(void);
+
+private:
+	RegisterMap(volatile uint32_t *address, uint32_t blockSize);
+
+	volatile uint32_t 	*regAddress;
+	uint32_t 			size;
+
+	static std::mutex 	lock;
+	static std::map<std::pair<std::string, uint32_t>, std::weak_ptr<RegisterMap> > 	maps;
+};
+
+#endif 	// _REGISTER_MAP_H_
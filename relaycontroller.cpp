@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdio.h>
+
+#include "relaycontroller.h"
+
+static const int MinutesPerDay = 24 * 60;
+
+/**
+ * Local midnight of the day when falls on, offset by days
+ */
+static time_t localMidnight(time_t when, int days)
+{
+    struct tm tm;
+
+    localtime_r(&when, &tm);
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_mday += days;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/**
+ * \func void RelaySchedule::addWindow(int onMinute, int offMinute)
+ * \param onMinute Minutes after local midnight to switch on
+ * \param offMinute Minutes after local midnight to switch off, before onMinute to run past midnight
+ */
+void RelaySchedule::addWindow(int onMinute, int offMinute)
+{
+    Window window = { onMinute, offMinute };
+    m_windows.push_back(window);
+}
+
+/**
+ * \func void RelaySchedule::setRamp(time_t start, int days, int fromMinutes, int toMinutes)
+ * \param start Local midnight of the first day of the ramp
+ * \param days How many days the ramp takes
+ * \param fromMinutes Length of the first window up to start
+ * \param toMinutes Length of the first window from start + days on
+ *
+ * The first window keeps its on time and its off time moves, in between the
+ * length is interpolated by the day.
+ */
+void RelaySchedule::setRamp(time_t start, int days, int fromMinutes, int toMinutes)
+{
+    m_rampStart = start;
+    m_rampDays = days;
+    m_rampFrom = fromMinutes;
+    m_rampTo = toMinutes;
+}
+
+/**
+ * \func bool RelaySchedule::parseWindows(const std::string &text)
+ * \param text Windows as HH:MM-HH:MM separated by commas, e.g. 07:00-20:00
+ * \return false, leaving the schedule as it was, if text doesn't parse
+ */
+bool RelaySchedule::parseWindows(const std::string &text)
+{
+    std::vector<Window> windows;
+    std::stringstream stream(text);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        int onHour, onMinute, offHour, offMinute;
+        char tail;
+        if (sscanf(item.c_str(), " %d:%d-%d:%d %c", &onHour, &onMinute, &offHour, &offMinute, &tail) != 4)
+            return false;
+        if (onHour < 0 || onHour > 23 || offHour < 0 || offHour > 24 || onMinute < 0 || onMinute > 59 ||
+            offMinute < 0 || offMinute > 59 || (offHour == 24 && offMinute != 0))
+            return false;
+        Window window = { onHour * 60 + onMinute, (offHour * 60 + offMinute) % MinutesPerDay };
+        if (window.on == window.off)
+            return false;
+        windows.push_back(window);
+    }
+    if (windows.empty())
+        return false;
+
+    m_windows = windows;
+    return true;
+}
+
+/**
+ * \func bool RelaySchedule::parseRamp(const std::string &text)
+ * \param text YYYY-MM-DD/DAYS/HH:MM/HH:MM, the start date, the number of days
+ * and the length of the first window before and after, e.g. 2026-11-01/30/12:00/16:00
+ * \return false, leaving the schedule as it was, if text doesn't parse
+ */
+bool RelaySchedule::parseRamp(const std::string &text)
+{
+    struct tm tm = {};
+    int days, fromHour, fromMinute, toHour, toMinute;
+    char tail;
+
+    if (sscanf(text.c_str(), "%d-%d-%d/%d/%d:%d/%d:%d %c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &days, &fromHour, &fromMinute, &toHour, &toMinute, &tail) != 8)
+        return false;
+    if (days < 1 || fromHour < 0 || fromHour > 24 || toHour < 0 || toHour > 24 ||
+        fromMinute < 0 || fromMinute > 59 || toMinute < 0 || toMinute > 59)
+        return false;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t start = mktime(&tm);
+    if (start == static_cast<time_t>(-1))
+        return false;
+
+    setRamp(start, days, fromHour * 60 + fromMinute, toHour * 60 + toMinute);
+    return true;
+}
+
+int RelaySchedule::windowLength(size_t index, time_t day) const
+{
+    const Window &window = m_windows[index];
+    int length = (window.off - window.on + MinutesPerDay) % MinutesPerDay;
+
+    if (index == 0 && m_rampDays > 0) {
+        // Whole days, rounded so a 23 or 25 hour day doesn't skew the step
+        double progress = lround((day - m_rampStart) / 86400.0) / static_cast<double>(m_rampDays);
+        progress = std::max(0.0, std::min(1.0, progress));
+        length = static_cast<int>(lround(m_rampFrom + (m_rampTo - m_rampFrom) * progress));
+    }
+    return std::max(0, std::min(MinutesPerDay, length));
+}
+
+/**
+ * The on intervals of the day before, the day of and the day after when
+ */
+void RelaySchedule::intervals(time_t when, std::vector<std::pair<time_t, time_t>> &result) const
+{
+    result.clear();
+    for (int day = -1; day <= 1; day++) {
+        time_t midnight = localMidnight(when, day);
+        for (size_t i = 0; i < m_windows.size(); i++) {
+            struct tm tm;
+            localtime_r(&midnight, &tm);
+            tm.tm_min = m_windows[i].on;
+            tm.tm_isdst = -1;
+            time_t on = mktime(&tm);
+            result.push_back(std::make_pair(on, on + windowLength(i, midnight) * 60));
+        }
+    }
+}
+
+/**
+ * \func bool RelaySchedule::stateAt(time_t when, time_t *next) const
+ * \param when The time to evaluate
+ * \param next If not NULL, set to when the state next changes, or a day
+ * later if it doesn't change before then
+ * \return true if the channel should be on at when
+ */
+bool RelaySchedule::stateAt(time_t when, time_t *next) const
+{
+    std::vector<std::pair<time_t, time_t>> on;
+    std::vector<time_t> boundaries;
+
+    intervals(when, on);
+    auto contains = [&on](time_t t) {
+        for (const auto &interval : on) {
+            if (interval.first <= t && t < interval.second)
+                return true;
+        }
+        return false;
+    };
+
+    bool state = contains(when);
+    if (next == NULL)
+        return state;
+
+    *next = when + 86400;
+    for (const auto &interval : on) {
+        if (interval.first > when)
+            boundaries.push_back(interval.first);
+        if (interval.second > when)
+            boundaries.push_back(interval.second);
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    for (time_t boundary : boundaries) {
+        if (boundary >= *next)
+            break;
+        if (contains(boundary) != state) {
+            *next = boundary;
+            break;
+        }
+    }
+    return state;
+}
+
+RelayController::RelayController() : m_writes(0), m_skipped(0), m_readbacks(0), m_mismatches(0), m_errors(0)
+{
+}
+
+/**
+ * \func bool RelayController::set(int address, int channel, bool on)
+ * \return false if the write failed, it is tried again on the next set()
+ *
+ * Writes the channel only if it was last told something else, or never
+ */
+bool RelayController::set(int address, int channel, bool on)
+{
+    Channel &relay = m_channels.emplace(key(address, channel), Channel{ -1, false, RelaySchedule() }).first->second;
+
+    if (relay.state == static_cast<int>(on)) {
+        m_skipped++;
+        return true;
+    }
+    if (!m_write || m_write(address, channel, on ? 1 : 0) != 0) {
+        m_errors++;
+        relay.state = -1;
+        return false;
+    }
+    relay.state = on;
+    m_writes++;
+    return true;
+}
+
+/**
+ * \func int RelayController::state(int address, int channel) const
+ * \return The state last written, 1 or 0, or -1 if it is unknown
+ */
+int RelayController::state(int address, int channel) const
+{
+    auto it = m_channels.find(key(address, channel));
+    return it == m_channels.end() ? -1 : it->second.state;
+}
+
+void RelayController::setSchedule(int address, int channel, const RelaySchedule &schedule)
+{
+    Channel &relay = m_channels.emplace(key(address, channel), Channel{ -1, false, RelaySchedule() }).first->second;
+
+    relay.schedule = schedule;
+    relay.scheduled = true;
+}
+
+/**
+ * \func time_t RelayController::apply(time_t now)
+ * \return When the next scheduled channel changes state, apply() should be
+ * called again then
+ *
+ * Brings every scheduled channel to the state its schedule has at now. A
+ * failed write asks to be called again in a minute.
+ */
+time_t RelayController::apply(time_t now)
+{
+    time_t next = now + 86400;
+
+    for (auto &entry : m_channels) {
+        Channel &relay = entry.second;
+        time_t change;
+
+        if (!relay.scheduled)
+            continue;
+        bool on = relay.schedule.stateAt(now, &change);
+        if (!set(entry.first >> 8, entry.first & 0xff, on))
+            change = now + 60;
+        next = std::min(next, change);
+    }
+    return next;
+}
+
+/**
+ * \func int RelayController::verify()
+ * \return How many channels had to be written again
+ *
+ * Reads back every channel with a known state and rewrites any that
+ * doesn't match what it was told
+ */
+int RelayController::verify()
+{
+    int corrected = 0;
+
+    if (!m_read)
+        return 0;
+
+    for (auto &entry : m_channels) {
+        Channel &relay = entry.second;
+        int address = entry.first >> 8;
+        int channel = entry.first & 0xff;
+        int actual;
+
+        if (relay.state < 0)
+            continue;
+        m_readbacks++;
+        if (m_read(address, channel, &actual) != 0) {
+            m_errors++;
+            continue;
+        }
+        if (actual != relay.state) {
+            int wanted = relay.state;
+            m_mismatches++;
+            relay.state = -1;
+            if (set(address, channel, wanted))
+                corrected++;
+        }
+    }
+    return corrected;
+}
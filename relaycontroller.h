@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RELAYCONTROLLER_H
+#define RELAYCONTROLLER_H
+
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * When a relay channel should be on, as windows of local time. A window
+ * whose off time is before its on time runs past midnight. A ramp stretches
+ * the first window a little every day, moving its off time so its length
+ * goes linearly from one value to another over a number of days, the way a
+ * photoperiod is lengthened to bring plants into flower.
+ */
+class RelaySchedule
+{
+public:
+    RelaySchedule() : m_rampStart(0), m_rampDays(0), m_rampFrom(0), m_rampTo(0) {}
+
+    void addWindow(int onMinute, int offMinute);
+    void setRamp(time_t start, int days, int fromMinutes, int toMinutes);
+    bool parseWindows(const std::string &text);
+    bool parseRamp(const std::string &text);
+
+    bool empty() const { return m_windows.empty(); }
+    bool stateAt(time_t when, time_t *next = NULL) const;
+
+private:
+    struct Window {
+        int on;     // minutes after local midnight
+        int off;
+    };
+
+    void intervals(time_t when, std::vector<std::pair<time_t, time_t>> &result) const;
+    int windowLength(size_t index, time_t day) const;
+
+    std::vector<Window> m_windows;
+    time_t m_rampStart;
+    int m_rampDays;
+    int m_rampFrom;
+    int m_rampTo;
+};
+
+/**
+ * Owns the relay expansion channels. It remembers what each channel was
+ * last told, so a set() to the state it already has costs no I2C
+ * transaction, and schedules are evaluated once per transition rather
+ * than polled. verify() reads the channels back now and then to catch a
+ * board that was reset or switched behind our back.
+ */
+class RelayController
+{
+public:
+    typedef std::function<int(int address, int channel, int state)> WriteFunction;
+    typedef std::function<int(int address, int channel, int *state)> ReadFunction;
+
+    RelayController();
+
+    void setWriteFunction(WriteFunction write) { m_write = write; }
+    void setReadFunction(ReadFunction read) { m_read = read; }
+
+    bool set(int address, int channel, bool on);
+    int state(int address, int channel) const;
+
+    void setSchedule(int address, int channel, const RelaySchedule &schedule);
+    time_t apply(time_t now);
+    int verify();
+
+    unsigned long writes() const { return m_writes; }
+    unsigned long skipped() const { return m_skipped; }
+    unsigned long readbacks() const { return m_readbacks; }
+    unsigned long mismatches() const { return m_mismatches; }
+    unsigned long errors() const { return m_errors; }
+
+private:
+    struct Channel {
+        int state;              // last state written, -1 until the first write
+        bool scheduled;
+        RelaySchedule schedule;
+    };
+
+    static int key(int address, int channel) { return (address << 8) | channel; }
+
+    WriteFunction m_write;
+    ReadFunction m_read;
+    std::map<int, Channel> m_channels;
+    unsigned long m_writes;
+    unsigned long m_skipped;
+    unsigned long m_readbacks;
+    unsigned long m_mismatches;
+    unsigned long m_errors;
+};
+
+#endif // RELAYCONTROLLER_H
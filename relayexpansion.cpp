@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cerrno>
+
+#include "relayexpansion.h"
+
+/**
+ * \func RelayExpansion::RelayExpansion(I2cScheduler &i2c, int address)
+ * \param i2c Scheduler that owns the bus
+ * \param address Setting of the address switches, 0 to 7, the same number relayDriverInit() takes
+ */
+RelayExpansion::RelayExpansion(I2cScheduler &i2c, int address) :
+    m_i2c(i2c), m_address(0x20 | (address & 0x7)), m_latch(-1)
+{
+}
+
+/**
+ * \func int RelayExpansion::init()
+ * \return 0, or a negative errno
+ *
+ * Makes every GPIO an output and switches both relays off, like
+ * relayDriverInit().
+ */
+int RelayExpansion::init()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int rc = m_i2c.writeRegister(m_address, IODIR, 0x00);
+    if (rc == 0)
+        rc = m_i2c.writeRegister(m_address, GPIO, 0x00);
+    m_latch = (rc == 0) ? 0 : -1;
+    return rc;
+}
+
+/**
+ * \func bool RelayExpansion::isInitialized()
+ * \return true if the relay GPIOs are outputs, like relayCheckInit()
+ */
+bool RelayExpansion::isInitialized()
+{
+    uint8_t direction;
+    if (m_i2c.readRegister(m_address, IODIR, &direction) != 0)
+        return false;
+    return (direction & 0x03) == 0;
+}
+
+/**
+ * \func int RelayExpansion::setChannel(int channel, int state)
+ * \param channel Relay 0 or 1
+ * \param state 1 for on
+ * \return 0, or a negative errno
+ *
+ * Writes the output latch from what was last written rather than reading
+ * it first, so a switch is one transaction. The write is keyed on the
+ * register: two switches queued behind something else go out as one.
+ */
+int RelayExpansion::setChannel(int channel, int state)
+{
+    if (channel < 0 || channel > 1)
+        return -EINVAL;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_latch < 0) {
+        uint8_t value;
+        int rc = m_i2c.readRegister(m_address, GPIO, &value);
+        if (rc != 0)
+            return rc;
+        m_latch = value;
+    }
+
+    uint8_t latch = state ? (m_latch | (1 << channel)) : (m_latch & ~(1 << channel));
+    m_latch = latch;
+    lock.unlock();
+
+    std::vector<I2cMessage> messages = { I2cMessage::send({ GPIO, latch }) };
+    int rc = m_i2c.transfer(m_address, messages, I2cScheduler::Control, GPIO);
+    if (rc != 0) {
+        // Whatever the chip has now, it is not known, read it next time
+        lock.lock();
+        m_latch = -1;
+    }
+    return rc;
+}
+
+/**
+ * \func int RelayExpansion::readChannel(int channel, int *state)
+ * \param channel Relay 0 or 1
+ * \param state Set to 1 when the relay is on
+ * \return 0, or a negative errno
+ *
+ * Always reads the chip, this is what RelayController::verify() relies on.
+ */
+int RelayExpansion::readChannel(int channel, int *state)
+{
+    if (channel < 0 || channel > 1 || state == nullptr)
+        return -EINVAL;
+
+    uint8_t value;
+    int rc = m_i2c.readRegister(m_address, GPIO, &value);
+    if (rc != 0)
+        return rc;
+
+    *state = (value >> channel) & 0x1;
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RELAYEXPANSION_H
+#define RELAYEXPANSION_H
+
+#include <cstdint>
+#include <mutex>
+
+#include "i2cbus.h"
+
+/**
+ * The Onion relay expansion, an MCP23008 whose first two GPIOs drive the
+ * relays, talked to through the I2C scheduler at control priority instead
+ * of through the Onion library's own bus access. Return values follow
+ * RelayController's read and write functions, 0 or a negative errno.
+ */
+class RelayExpansion
+{
+public:
+    RelayExpansion(I2cScheduler &i2c, int address);
+
+    int init();
+    bool isInitialized();
+    int setChannel(int channel, int state);
+    int readChannel(int channel, int *state);
+
+    uint8_t address() const { return m_address; }
+
+private:
+    static constexpr uint8_t IODIR = 0x00;
+    static constexpr uint8_t GPIO = 0x09;
+
+    I2cScheduler &m_i2c;
+    uint8_t m_address;
+    std::mutex m_mutex;
+    int m_latch;        // outputs last written, -1 until known
+};
+
+#endif // RELAYEXPANSION_H
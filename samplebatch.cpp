@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cmath>
+
+#include "samplebatch.h"
+
+static void putVarint(std::vector<uint8_t> &buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+static void putSigned(std::vector<uint8_t> &buffer, int64_t value)
+{
+    putVarint(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static void putString(std::vector<uint8_t> &buffer, const std::string &text)
+{
+    putVarint(buffer, text.size());
+    buffer.insert(buffer.end(), text.begin(), text.end());
+}
+
+static bool getVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (data == end)
+            return false;
+        uint8_t byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static bool getSigned(const uint8_t *&data, const uint8_t *end, int64_t &value)
+{
+    uint64_t raw;
+    if (!getVarint(data, end, raw))
+        return false;
+    value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+    return true;
+}
+
+static bool getString(const uint8_t *&data, const uint8_t *end, std::string &text)
+{
+    uint64_t length;
+    if (!getVarint(data, end, length) || length > static_cast<uint64_t>(end - data))
+        return false;
+    text.assign(reinterpret_cast<const char*>(data), length);
+    data += length;
+    return true;
+}
+
+/**
+ * \func SampleBatch::SampleBatch(size_t maxSamples, int maxSeconds)
+ * \param maxSamples Samples collected before the batch is ready
+ * \param maxSeconds Age of the first sample at which the batch is due anyway
+ */
+SampleBatch::SampleBatch(size_t maxSamples, int maxSeconds)
+{
+    setLimits(maxSamples, maxSeconds);
+}
+
+void SampleBatch::setLimits(size_t maxSamples, int maxSeconds)
+{
+    m_maxSamples = maxSamples ? maxSamples : 1;
+    m_maxSeconds = maxSeconds > 0 ? maxSeconds : 1;
+    m_samples.reserve(m_maxSamples);
+}
+
+/**
+ * \func bool SampleBatch::add(const EnvironmentReading &reading, time_t time)
+ * \param reading The sample, its location and name are taken from the first one
+ * \param time Wall clock time the sample was taken
+ * \return true once the batch holds maxSamples samples
+ */
+bool SampleBatch::add(const EnvironmentReading &reading, time_t time)
+{
+    if (m_samples.empty()) {
+        m_header.location = reading.location;
+        m_header.name = reading.name;
+        m_header.uptime = reading.uptime;
+    }
+
+    Quantized sample;
+    sample.time = time;
+    sample.celsius = lroundf(reading.celsius * 100);
+    sample.humidity = lroundf(reading.humidity * 100);
+    sample.confidence = lroundf(reading.confidence * 10000);
+    sample.light = reading.light;
+    m_samples.push_back(sample);
+
+    return m_samples.size() >= m_maxSamples;
+}
+
+/**
+ * \func bool SampleBatch::due(time_t now) const
+ * \return true if there is anything to send and it has waited long enough
+ */
+bool SampleBatch::due(time_t now) const
+{
+    if (m_samples.empty())
+        return false;
+    return m_samples.size() >= m_maxSamples || now - m_samples.front().time >= m_maxSeconds;
+}
+
+/**
+ * \func const std::vector<uint8_t> &SampleBatch::encode()
+ * \return The batch payload, valid until the next call. The samples are cleared.
+ *
+ * Layout, every integer a varint and every signed one zigzag encoded:
+ *   uint8   Version
+ *   varint  sample count
+ *   varint  uptime at the first sample
+ *   string  location, string name, each a varint length and the bytes
+ *   then per sample the difference from the previous sample, the first one
+ *   from a sample of all zeros:
+ *   signed  time in seconds
+ *   signed  celsius * 100
+ *   signed  humidity * 100
+ *   signed  confidence * 10000
+ *   signed  light, -1 when unknown
+ */
+const std::vector<uint8_t> &SampleBatch::encode()
+{
+    Quantized previous = {};
+
+    m_buffer.clear();
+    m_buffer.push_back(Version);
+    putVarint(m_buffer, m_samples.size());
+    putVarint(m_buffer, m_header.uptime < 0 ? 0 : m_header.uptime);
+    putString(m_buffer, m_header.location);
+    putString(m_buffer, m_header.name);
+
+    for (const Quantized &sample : m_samples) {
+        putSigned(m_buffer, sample.time - previous.time);
+        putSigned(m_buffer, sample.celsius - previous.celsius);
+        putSigned(m_buffer, sample.humidity - previous.humidity);
+        putSigned(m_buffer, sample.confidence - previous.confidence);
+        putSigned(m_buffer, sample.light - previous.light);
+        previous = sample;
+    }
+    clear();
+    return m_buffer;
+}
+
+void SampleBatch::clear()
+{
+    m_samples.clear();
+}
+
+/**
+ * \func bool SampleBatch::decode(const uint8_t *data, size_t size, BatchHeader &header, std::vector<BatchSample> &samples)
+ * \return false if the payload is truncated, malformed or of another version
+ *
+ * The consumer side of encode()
+ */
+bool SampleBatch::decode(const uint8_t *data, size_t size, BatchHeader &header, std::vector<BatchSample> &samples)
+{
+    const uint8_t *end = data + size;
+    uint64_t count, uptime;
+
+    samples.clear();
+    if (size < 1 || *data++ != Version)
+        return false;
+    if (!getVarint(data, end, count) || !getVarint(data, end, uptime) ||
+        !getString(data, end, header.location) || !getString(data, end, header.name))
+        return false;
+    header.uptime = uptime;
+
+    // Every sample takes at least five bytes, don't trust a count the data can't hold
+    if (count > static_cast<uint64_t>(end - data) / 5)
+        return false;
+
+    Quantized current = {};
+    samples.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t delta[5];
+        for (int field = 0; field < 5; field++) {
+            if (!getSigned(data, end, delta[field]))
+                return false;
+        }
+        current.time += delta[0];
+        current.celsius += delta[1];
+        current.humidity += delta[2];
+        current.confidence += delta[3];
+        current.light += delta[4];
+
+        BatchSample sample;
+        sample.time = current.time;
+        sample.celsius = current.celsius / 100.0f;
+        sample.humidity = current.humidity / 100.0f;
+        sample.confidence = current.confidence / 10000.0f;
+        sample.light = current.light;
+        samples.push_back(sample);
+    }
+    return data == end;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SAMPLEBATCH_H
+#define SAMPLEBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "environment.h"
+
+/**
+ * One sample of a batch, at the resolution the batch carries: whole seconds,
+ * celsius and humidity to 0.01, confidence to 0.0001
+ */
+struct BatchSample {
+    time_t time;
+    float celsius;
+    float humidity;
+    float confidence;
+    int light;
+};
+
+/**
+ * What every sample in a batch shares
+ */
+struct BatchHeader {
+    std::string location;
+    std::string name;
+    long uptime;            // uptime when the first sample was taken
+};
+
+/**
+ * Collects environment samples and publishes them as one message instead of
+ * one message each. The batch is sent once it holds maxSamples samples or
+ * its first sample is maxSeconds old, whichever comes first.
+ *
+ * The encoding is a header with what the samples share, followed by each
+ * sample as zigzag varint deltas from the one before. At one sample a minute
+ * that is about six bytes per sample instead of a 190 byte JSON document.
+ * decode() is the consumer side, tools/batch_decode prints a batch as JSON.
+ */
+class SampleBatch
+{
+public:
+    static constexpr uint8_t Version = 1;
+
+    SampleBatch(size_t maxSamples = 30, int maxSeconds = 1800);
+
+    void setLimits(size_t maxSamples, int maxSeconds);
+    size_t maxSamples() const { return m_maxSamples; }
+    int maxSeconds() const { return m_maxSeconds; }
+
+    bool add(const EnvironmentReading &reading, time_t time);
+    bool due(time_t now) const;
+    bool empty() const { return m_samples.empty(); }
+    size_t size() const { return m_samples.size(); }
+
+    const std::vector<uint8_t> &encode();
+    void clear();
+
+    static bool decode(const uint8_t *data, size_t size, BatchHeader &header, std::vector<BatchSample> &samples);
+
+private:
+    struct Quantized {
+        int64_t time;
+        int64_t celsius;
+        int64_t humidity;
+        int64_t confidence;
+        int64_t light;
+    };
+
+    BatchHeader m_header;
+    std::vector<Quantized> m_samples;
+    std::vector<uint8_t> m_buffer;
+    size_t m_maxSamples;
+    int m_maxSeconds;
+};
+
+#endif // SAMPLEBATCH_H
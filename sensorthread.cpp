@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <pthread.h>
+
+#include "sensorthread.h"
+
+SensorThread::SensorThread() : m_running(false), m_dropped(0), m_cpu(-1)
+{
+}
+
+SensorThread::SensorThread(DhtSensor &sensor, std::chrono::milliseconds interval) :
+    m_running(false), m_dropped(0), m_cpu(-1)
+{
+    addGroup({ &sensor }, interval);
+}
+
+SensorThread::~SensorThread()
+{
+    stop();
+}
+
+/**
+ * \func void SensorThread::addGroup(const std::vector<DhtSensor*> &sensors, std::chrono::milliseconds interval, DhtSensor::GroupReadFunction read)
+ * \param sensors Sensors read together, at most DHT_MAX_SENSORS, not owned
+ * \param interval Time between readings
+ * \param read Captures the group's pins in one window; without it, or for
+ * a group of one, each sensor is read with its own read function
+ */
+void SensorThread::addGroup(const std::vector<DhtSensor*> &sensors, std::chrono::milliseconds interval,
+                            DhtSensor::GroupReadFunction read)
+{
+    Group group;
+    group.sensors = sensors;
+    group.interval = interval;
+    group.read = read;
+    m_groups.push_back(group);
+}
+
+/**
+ * \func void SensorThread::addTask(std::function<void()> task, std::chrono::milliseconds interval)
+ * \param task Runs on the sensor thread, a read that would stall the caller's thread
+ * \param interval Time between runs
+ */
+void SensorThread::addTask(std::function<void()> task, std::chrono::milliseconds interval)
+{
+    Task entry;
+    entry.run = task;
+    entry.interval = interval;
+    m_tasks.push_back(entry);
+}
+
+/**
+ * \func bool SensorThread::start()
+ * \return false if the thread is already running
+ *
+ * Starts sampling. The first read happens right away, the rest every
+ * interval after it, measured from when each period started so reads that
+ * take a while do not make the schedule drift.
+ */
+bool SensorThread::start()
+{
+    if (m_running.exchange(true))
+        return false;
+
+    m_thread = std::thread(&SensorThread::run, this);
+    return true;
+}
+
+/**
+ * \func void SensorThread::stop()
+ *
+ * Wakes the thread if it is waiting for the next period and joins it. A read
+ * in progress is allowed to finish.
+ */
+void SensorThread::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running.exchange(false))
+            return;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SensorThread::run()
+{
+    if (m_cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpu, &cpus);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0)
+            std::cerr << __PRETTY_FUNCTION__ << ": Unable to pin sensor thread to CPU " << m_cpu << ": " << strerror(rc) << std::endl;
+    }
+
+    for (Group &group : m_groups)
+        group.nextPeriod = DhtSensor::Clock::now();
+    for (Task &task : m_tasks)
+        task.nextPeriod = DhtSensor::Clock::now();
+
+    while (m_running.load()) {
+        DhtSensor::Clock::time_point wake = DhtSensor::Clock::now() + std::chrono::hours(1);
+
+        for (Group &group : m_groups) {
+            DhtSensor::Clock::time_point now = DhtSensor::Clock::now();
+
+            if (now >= group.nextPeriod) {
+                for (DhtSensor *sensor : group.sensors)
+                    sensor->request();
+                // A period that overran starts the next one now instead of bursting to catch up
+                group.nextPeriod += group.interval;
+                if (group.nextPeriod < now)
+                    group.nextPeriod = now;
+            }
+
+            acquire(group, now);
+
+            wake = std::min(wake, group.nextPeriod);
+            for (DhtSensor *sensor : group.sensors) {
+                if (sensor->pending())
+                    wake = std::min(wake, sensor->nextConversion());
+            }
+        }
+
+        for (Task &task : m_tasks) {
+            DhtSensor::Clock::time_point now = DhtSensor::Clock::now();
+
+            if (now >= task.nextPeriod) {
+                task.run();
+                if (m_notify)
+                    m_notify();
+                task.nextPeriod += task.interval;
+                if (task.nextPeriod < now)
+                    task.nextPeriod = now;
+            }
+            wake = std::min(wake, task.nextPeriod);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait_until(lock, wake, [this] { return !m_running.load(); });
+    }
+}
+
+/**
+ * \func void SensorThread::acquire(Group &group, DhtSensor::Clock::time_point now)
+ *
+ * Reads the sensors of the group that want a reading and will answer now,
+ * together in one capture when the group has a read function.
+ */
+void SensorThread::acquire(Group &group, DhtSensor::Clock::time_point now)
+{
+    DhtSensor *due[DHT_MAX_SENSORS];
+    int count = 0;
+
+    for (DhtSensor *sensor : group.sensors) {
+        if (count < DHT_MAX_SENSORS && sensor->pending() && now >= sensor->nextConversion())
+            due[count++] = sensor;
+    }
+    if (count == 0)
+        return;
+
+    if (!group.read || group.sensors.size() == 1) {
+        for (int i = 0; i < count; i++) {
+            dht_reading reading;
+            DhtSensor::Clock::duration age;
+            int result = due[i]->read(&reading, &age);
+            report(due[i], result, reading, age);
+        }
+        return;
+    }
+
+    dht_reading readings[DHT_MAX_SENSORS];
+    DhtSensor::Clock::duration ages[DHT_MAX_SENSORS];
+    int results[DHT_MAX_SENSORS];
+    DhtSensor::readGroup(due, count, group.read, readings, ages, results);
+    for (int i = 0; i < count; i++)
+        report(due[i], results[i], readings[i], ages[i]);
+}
+
+void SensorThread::report(DhtSensor *sensor, int result, const dht_reading &reading, DhtSensor::Clock::duration age)
+{
+    // Report the outcome once: on success, or when the retries are used up
+    if (result != DHT_SUCCESS && sensor->pending())
+        return;
+
+    SensorSample sample;
+    sample.pin = sensor->pin();
+    sample.result = result;
+    sample.reading = reading;
+    sample.age = std::chrono::duration_cast<std::chrono::nanoseconds>(age).count();
+    sample.timestamp = monotonic_ns();
+    sample.time = time(nullptr);
+    if (!m_queue.push(sample))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    else if (m_notify)
+        m_notify();
+}
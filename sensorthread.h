@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SENSORTHREAD_H
+#define SENSORTHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dhtsensor.h"
+#include "spscring.h"
+
+/**
+ * One acquisition by the sensor thread, successful or not
+ */
+struct SensorSample {
+    uint64_t timestamp;     // CLOCK_MONOTONIC ns when the read finished
+    time_t time;            // wall clock at the same moment
+    int pin;
+    int result;             // DHT_* status of the read
+    uint64_t age;           // ns since reading was taken, 0 when the read succeeded
+    dht_reading reading;    // the fresh reading, or the last good one after a failure
+};
+
+/**
+ * Runs sensor reads on their own thread so the real-time capture and its
+ * retries never hold up relay control or MQTT. Every interval the sensor is
+ * asked for a reading; failed reads are retried when the sensor allows,
+ * not back to back. The outcome is handed to the consumer through a
+ * lock-free ring; if the consumer falls behind, new samples are dropped and
+ * counted rather than blocking the reader.
+ *
+ * Sensors are read in groups. The sensors of a group share an interval and
+ * are captured together in one window by the group's read function, so a
+ * rack of sensors on one GPIO bank costs one capture a period, not one per
+ * sensor. Each sensor still produces its own sample.
+ *
+ * Other slow reads, like the soil probes' ADC bursts, run as tasks on the
+ * same thread between the captures. A task hands its results over itself;
+ * the notify callback runs after it so the consumer looks for them.
+ */
+class SensorThread
+{
+public:
+    typedef SpscRing<SensorSample, 64> SampleQueue;
+
+    SensorThread();
+    SensorThread(DhtSensor &sensor, std::chrono::milliseconds interval);
+    ~SensorThread();
+
+    // Set up before start()
+    void addGroup(const std::vector<DhtSensor*> &sensors, std::chrono::milliseconds interval,
+                  DhtSensor::GroupReadFunction read = nullptr);
+    void addTask(std::function<void()> task, std::chrono::milliseconds interval);
+    void setCpu(int cpu) { m_cpu = cpu; }
+    // Called on the sensor thread after each sample is queued
+    void setNotify(std::function<void()> notify) { m_notify = notify; }
+    bool start();
+    void stop();
+
+    bool nextSample(SensorSample &sample) { return m_queue.pop(sample); }
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    bool isRunning() const { return m_running.load(); }
+
+private:
+    struct Group {
+        std::vector<DhtSensor*> sensors;
+        std::chrono::milliseconds interval;
+        DhtSensor::GroupReadFunction read;
+        DhtSensor::Clock::time_point nextPeriod;
+    };
+
+    struct Task {
+        std::function<void()> run;
+        std::chrono::milliseconds interval;
+        DhtSensor::Clock::time_point nextPeriod;
+    };
+
+    void run();
+    void acquire(Group &group, DhtSensor::Clock::time_point now);
+    void report(DhtSensor *sensor, int result, const dht_reading &reading, DhtSensor::Clock::duration age);
+
+    SampleQueue m_queue;
+    std::vector<Group> m_groups;
+    std::vector<Task> m_tasks;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_dropped;
+    std::function<void()> m_notify;
+    int m_cpu;
+};
+
+#endif // SENSORTHREAD_H
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "simi2cbus.h"
+
+SimI2cRegisters::SimI2cRegisters() : m_pointer(0)
+{
+    memset(m_registers, 0, sizeof(m_registers));
+    memset(m_writes, 0, sizeof(m_writes));
+}
+
+bool SimI2cRegisters::write(const uint8_t *data, size_t length)
+{
+    if (length == 0)
+        return true;
+
+    m_pointer = data[0];
+    for (size_t i = 1; i < length; i++) {
+        m_registers[m_pointer] = data[i];
+        m_writes[m_pointer]++;
+        m_pointer++;
+    }
+    return true;
+}
+
+bool SimI2cRegisters::read(uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        data[i] = m_registers[m_pointer++];
+    return true;
+}
+
+SimI2cBus::SimI2cBus(unsigned int bitRate) :
+    m_bitRate(bitRate), m_failures(0), m_error(-EIO), m_transactions(0), m_bytes(0)
+{
+}
+
+void SimI2cBus::attach(uint8_t address, SimI2cDevice *device)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_devices[address] = device;
+}
+
+void SimI2cBus::detach(uint8_t address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_devices.erase(address);
+}
+
+/**
+ * \func void SimI2cBus::failNext(int count, int error)
+ * \param count How many transfers to fail
+ * \param error Negative errno they fail with
+ */
+void SimI2cBus::failNext(int count, int error)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failures = count;
+    m_error = error;
+}
+
+/**
+ * \func int SimI2cBus::transfer(uint8_t address, std::vector<I2cMessage> &messages)
+ * \return 0, -ENXIO if nothing answers at address, or the injected error
+ *
+ * Each message costs a start, the address byte and its data at 9 bits a
+ * byte, which is what the wire would take.
+ */
+int SimI2cBus::transfer(uint8_t address, std::vector<I2cMessage> &messages)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t bits = 0;
+    int rc = 0;
+
+    m_transactions++;
+    auto it = m_devices.find(address);
+    if (m_failures > 0) {
+        m_failures--;
+        rc = m_error;
+    }
+    else if (it == m_devices.end()) {
+        rc = -ENXIO;
+    }
+
+    for (I2cMessage &message : messages) {
+        // A NAK on the address byte ends the message there
+        bits += 10;
+        if (rc != 0)
+            break;
+        bool ack = message.read ? it->second->read(message.data.data(), message.data.size())
+                                : it->second->write(message.data.data(), message.data.size());
+        if (!ack) {
+            rc = -EREMOTEIO;
+            break;
+        }
+        bits += 9 * message.data.size();
+        m_bytes += message.data.size();
+    }
+
+    if (m_bitRate)
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds(bits * 1000000000ull / m_bitRate));
+    return rc;
+}
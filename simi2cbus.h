@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMI2CBUS_H
+#define SIMI2CBUS_H
+
+#include <cerrno>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "i2cbus.h"
+
+/**
+ * A device on the simulated bus. Returning false NAKs the message.
+ */
+class SimI2cDevice
+{
+public:
+    virtual ~SimI2cDevice() {}
+
+    virtual bool write(const uint8_t *data, size_t length) = 0;
+    virtual bool read(uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * The usual register file: the first byte written sets the register
+ * pointer, the rest are stored from there on and reads return from there
+ * on, the pointer incrementing as it goes. Fits the MCP23008 on the relay
+ * expansion, and keeps whatever an SSD1306 is sent where it can be looked
+ * at.
+ */
+class SimI2cRegisters : public SimI2cDevice
+{
+public:
+    SimI2cRegisters();
+
+    bool write(const uint8_t *data, size_t length) override;
+    bool read(uint8_t *data, size_t length) override;
+
+    uint8_t reg(uint8_t reg) const { return m_registers[reg]; }
+    void setReg(uint8_t reg, uint8_t value) { m_registers[reg] = value; }
+    uint64_t writes(uint8_t reg) const { return m_writes[reg]; }
+
+private:
+    uint8_t m_registers[256];
+    uint64_t m_writes[256];
+    uint8_t m_pointer;
+};
+
+/**
+ * An in-process bus for running the I2C code without hardware. Every
+ * transfer takes as long as its bytes would on a real bus at the given bit
+ * rate, 0 for no delay, and failures can be injected.
+ */
+class SimI2cBus : public I2cTransport
+{
+public:
+    explicit SimI2cBus(unsigned int bitRate = 400000);
+
+    // device is not owned, it must outlive the bus or be detached
+    void attach(uint8_t address, SimI2cDevice *device);
+    void detach(uint8_t address);
+    void failNext(int count, int error = -EIO);
+
+    int transfer(uint8_t address, std::vector<I2cMessage> &messages) override;
+
+    uint64_t transactions() const { return m_transactions; }
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    std::mutex m_mutex;
+    std::map<uint8_t, SimI2cDevice*> m_devices;
+    unsigned int m_bitRate;
+    int m_failures;
+    int m_error;
+    uint64_t m_transactions;
+    uint64_t m_bytes;
+};
+
+#endif // SIMI2CBUS_H
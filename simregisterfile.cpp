@@ -0,0 +1,145 @@
+#include <simregisterfile.h>
+
+#include <string.h>
+#include <time.h>
+
+uint64_t sim_monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+SimRegisterFile::SimRegisterFile(void) : MemoryRegisterBackend(REG_BLOCK_SIZE)
+{
+	memset(devices, 0, sizeof(devices));
+	clock 		= sim_monotonic_ns;
+	numReads	= 0;
+	numWrites	= 0;
+}
+
+SimRegisterFile::~SimRegisterFile(void)
+{
+	// devices are not owned
+}
+
+int SimRegisterFile::AttachDevice(int pinNum, SimPinDevice *device)
+{
+	if (pinNum < 0 || pinNum >= SIM_NUM_GPIO) {
+		return EXIT_FAILURE;
+	}
+
+	devices[pinNum]	= device;
+	return EXIT_SUCCESS;
+}
+
+void SimRegisterFile::DetachDevice(int pinNum)
+{
+	if (pinNum >= 0 && pinNum < SIM_NUM_GPIO) {
+		devices[pinNum]	= NULL;
+	}
+}
+
+void SimRegisterFile::SetClock(uint64_t (*input)(void))
+{
+	clock	= (input != NULL ? input : sim_monotonic_ns);
+}
+
+uint32_t SimRegisterFile::Read(uint32_t registerOffset)
+{
+	numReads++;
+
+	if (registerOffset >= REGISTER_DATA0_OFFSET && registerOffset <= REGISTER_DATA2_OFFSET) {
+		return _SampleData(registerOffset - REGISTER_DATA0_OFFSET, clock());
+	}
+
+	return MemoryRegisterBackend::Read(registerOffset);
+}
+
+void SimRegisterFile::Write(uint32_t registerOffset, uint32_t value)
+{
+	int 		bank;
+	uint32_t 	latch;
+	uint32_t 	ctrl;
+
+	numWrites++;
+
+	if (registerOffset >= REGISTER_CTRL0_OFFSET && registerOffset <= REGISTER_CTRL2_OFFSET) {
+		bank 	= registerOffset - REGISTER_CTRL0_OFFSET;
+		latch 	= registers[REGISTER_DATA0_OFFSET + bank];
+		_UpdateLatch(bank, latch, value, clock());
+	}
+	else if (registerOffset >= REGISTER_DATA0_OFFSET && registerOffset <= REGISTER_DATA2_OFFSET) {
+		bank 	= registerOffset - REGISTER_DATA0_OFFSET;
+		ctrl 	= registers[REGISTER_CTRL0_OFFSET + bank];
+		_UpdateLatch(bank, value, ctrl, clock());
+	}
+	else if (registerOffset >= REGISTER_DSET0_OFFSET && registerOffset <= REGISTER_DSET2_OFFSET) {
+		bank 	= registerOffset - REGISTER_DSET0_OFFSET;
+		latch 	= registers[REGISTER_DATA0_OFFSET + bank] | value;
+		ctrl 	= registers[REGISTER_CTRL0_OFFSET + bank];
+		_UpdateLatch(bank, latch, ctrl, clock());
+	}
+	else if (registerOffset >= REGISTER_DCLR0_OFFSET && registerOffset <= REGISTER_DCLR2_OFFSET) {
+		bank 	= registerOffset - REGISTER_DCLR0_OFFSET;
+		latch 	= registers[REGISTER_DATA0_OFFSET + bank] & ~value;
+		ctrl 	= registers[REGISTER_CTRL0_OFFSET + bank];
+		_UpdateLatch(bank, latch, ctrl, clock());
+	}
+	else {
+		MemoryRegisterBackend::Write(registerOffset, value);
+	}
+}
+
+// outputs read back their latch, inputs read whatever the device drives
+uint32_t SimRegisterFile::_SampleData(int bank, uint64_t nowNs)
+{
+	uint32_t 	ctrl 	= registers[REGISTER_CTRL0_OFFSET + bank];
+	uint32_t 	value 	= registers[REGISTER_DATA0_OFFSET + bank];
+	int 		gpio;
+
+	for (gpio = 0; gpio < 32; gpio++) {
+		SimPinDevice *device = devices[bank * 32 + gpio];
+
+		if (device == NULL || (ctrl & (1u << gpio))) {
+			continue;
+		}
+
+		_SetBit(value, gpio, device->Level(nowNs));
+	}
+
+	return value;
+}
+
+// store the new latch/direction and tell devices whose drive state changed
+void SimRegisterFile::_UpdateLatch(int bank, uint32_t latch, uint32_t ctrl, uint64_t nowNs)
+{
+	uint32_t 	oldLatch 	= registers[REGISTER_DATA0_OFFSET + bank];
+	uint32_t 	oldCtrl 	= registers[REGISTER_CTRL0_OFFSET + bank];
+	int 		gpio;
+
+	registers[REGISTER_DATA0_OFFSET + bank]	= latch;
+	registers[REGISTER_CTRL0_OFFSET + bank]	= ctrl;
+
+	for (gpio = 0; gpio < 32; gpio++) {
+		SimPinDevice 	*device 	= devices[bank * 32 + gpio];
+		uint32_t 		mask 		= (1u << gpio);
+		int 			oldDrive 	= (oldCtrl & mask) ? ((oldLatch & mask) != 0) : SIM_HOST_RELEASED;
+		int 			newDrive 	= (ctrl & mask) ? ((latch & mask) != 0) : SIM_HOST_RELEASED;
+
+		if (device != NULL && oldDrive != newDrive) {
+			device->HostDrive(newDrive, nowNs);
+		}
+	}
+}
+
+void SimRegisterFile::_SetBit(uint32_t &regVal, int bitNum, int value)
+{
+	if (value) {
+		regVal |= (1u << bitNum);
+	}
+	else {
+		regVal &= ~(1u << bitNum);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef _SIM_REGISTER_FILE_H_
+#define _SIM_REGISTER_FILE_H_
+
+#include <fastgpioomega2.h>
+#include <registerbackend.h>
+
+#define SIM_NUM_GPIO 				96
+
+// level reported to a device when the host is not driving its pin
+#define SIM_HOST_RELEASED 			-1
+
+// Something wired to a simulated GPIO pin.
+class SimPinDevice {
+public:
+	virtual ~SimPinDevice(void) {}
+
+	// host started driving the pin to level (0 or 1), or SIM_HOST_RELEASED
+	virtual void 	HostDrive 		(int level, uint64_t nowNs)=0;
+	// level the device puts on the line while the host is not driving it
+	virtual int 	Level 			(uint64_t nowNs)=0;
+};
+
+// Memory backed stand-in for the Omega2 GPIO register block. Writes to the
+// DSET/DCLR registers update the output latch like the real SoC does, and reads
+// of GPIO_DATA_x report the latch for outputs and the attached device's level
+// for inputs, sampled at the time of the read.
+class SimRegisterFile : public MemoryRegisterBackend {
+public:
+	SimRegisterFile(void);
+	~SimRegisterFile(void);
+
+	uint32_t	Read 			(uint32_t registerOffset);
+	void 		Write 			(uint32_t registerOffset, uint32_t value);
+
+	// device is not owned, it must outlive the register file or be detached
+	int 		AttachDevice 	(int pinNum, SimPinDevice *device);
+	void 		DetachDevice 	(int pinNum);
+
+	// time source in nanoseconds, CLOCK_MONOTONIC by default
+	void 		SetClock 		(uint64_t (*clock)(void));
+	uint64_t 	Now 			(void) { return clock(); }
+
+	// register access counters, handy when profiling the capture loop
+	uint64_t 	NumReads 		(void) { return numReads; }
+	uint64_t 	NumWrites 		(void) { return numWrites; }
+
+private:
+	uint32_t 	_SampleData 	(int bank, uint64_t nowNs);
+	void 		_UpdateLatch 	(int bank, uint32_t latch, uint32_t ctrl, uint64_t nowNs);
+	void 		_SetBit 		(uint32_t &regVal, int bitNum, int value);
+
+	SimPinDevice 	*devices[SIM_NUM_GPIO];
+	uint64_t 		(*clock)(void);
+	uint64_t 		numReads;
+	uint64_t 		numWrites;
+};
+
+uint64_t sim_monotonic_ns(void);
+
+#endif 	// _SIM_REGISTER_FILE_H_
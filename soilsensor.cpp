@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+
+#include "soilsensor.h"
+
+/**
+ * \func void SoilFilter::median5(const float *in, float *out, size_t count)
+ * \param in count samples
+ * \param out count - 4 medians, out[i] is the median of in[i] to in[i + 4]
+ *
+ * The min/max network for a median of 5, applied to the whole block at
+ * once: every step is one min or max of two shifted arrays.
+ */
+void SoilFilter::median5(const float *in, float *out, size_t count)
+{
+    for (size_t i = 0; i + 4 < count; i++) {
+        float a = in[i], b = in[i + 1], c = in[i + 2], d = in[i + 3], e = in[i + 4];
+        float f = std::max(std::min(a, b), std::min(c, d));
+        float g = std::min(std::max(a, b), std::max(c, d));
+        out[i] = std::max(std::min(e, f), std::min(std::max(e, f), g));
+    }
+}
+
+/**
+ * \func float SoilFilter::update(const int16_t *samples, size_t count)
+ * \param samples One burst of raw conversions
+ * \param count At least 5, at most MaxBurst; anything past that is ignored
+ * \return The filtered value
+ *
+ * The first burst sets the average, later ones move it by alpha.
+ */
+float SoilFilter::update(const int16_t *samples, size_t count)
+{
+    float block[MaxBurst];
+    float medians[MaxBurst];
+
+    count = std::min(count, MaxBurst);
+    if (count < 5)
+        return m_value;
+
+    for (size_t i = 0; i < count; i++)
+        block[i] = samples[i];
+
+    median5(block, medians, count);
+
+    float sum = 0;
+    for (size_t i = 0; i < count - 4; i++)
+        sum += medians[i];
+    float mean = sum / (count - 4);
+
+    if (!m_primed) {
+        m_value = mean;
+        m_primed = true;
+    }
+    else {
+        m_value += m_alpha * (mean - m_value);
+    }
+    return m_value;
+}
+
+/**
+ * \func SoilSensor::SoilSensor(Ads1115 &adc, int channel, const SoilCalibration &calibration, size_t burst)
+ * \param adc Converter the probe is wired to
+ * \param channel ADC input, 0 to 3
+ * \param calibration Dry and wet readings for this probe
+ * \param burst Conversions per read, 5 to SoilFilter::MaxBurst
+ */
+SoilSensor::SoilSensor(Ads1115 &adc, int channel, const SoilCalibration &calibration, size_t burst) :
+    m_adc(adc), m_channel(channel), m_calibration(calibration),
+    m_burst(std::max<size_t>(5, std::min(burst, SoilFilter::MaxBurst)))
+{
+}
+
+/**
+ * \func int SoilSensor::read()
+ * \return 0, or a negative errno; a failed burst leaves the value alone
+ */
+int SoilSensor::read()
+{
+    int16_t samples[SoilFilter::MaxBurst];
+
+    int rc = m_adc.burst(m_channel, samples, m_burst);
+    if (rc == 0)
+        m_filter.update(samples, m_burst);
+    return rc;
+}
+
+/**
+ * \func float SoilSensor::moisture() const
+ * \return Percent between the dry and wet calibration points, clamped to 0-100
+ */
+float SoilSensor::moisture() const
+{
+    float span = m_calibration.dry - m_calibration.wet;
+    if (span == 0)
+        return 0;
+
+    float percent = (m_calibration.dry - m_filter.value()) / span * 100;
+    return std::max(0.0f, std::min(100.0f, percent));
+}
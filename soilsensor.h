@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SOILSENSOR_H
+#define SOILSENSOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ads1115.h"
+
+/**
+ * Turns a burst of raw conversions into one steady value. A sliding median
+ * of 5 over the burst throws out spikes, the medians are averaged, and an
+ * exponential moving average across bursts smooths what is left. Each
+ * stage runs over a contiguous block of floats with no branches in the
+ * loop, so the compiler vectorizes them.
+ */
+class SoilFilter
+{
+public:
+    static constexpr size_t MaxBurst = 64;
+
+    explicit SoilFilter(float alpha = 0.3f) : m_alpha(alpha), m_value(0), m_primed(false) {}
+
+    float update(const int16_t *samples, size_t count);
+    void reset() { m_primed = false; }
+
+    float value() const { return m_value; }
+    bool primed() const { return m_primed; }
+
+    static void median5(const float *in, float *out, size_t count);
+
+private:
+    float m_alpha;
+    float m_value;
+    bool m_primed;
+};
+
+/**
+ * Where a probe reads in dry air and in water, in filtered counts.
+ * Capacitive probes read lower the wetter they are, resistive ones higher;
+ * either works.
+ */
+struct SoilCalibration {
+    float dry;
+    float wet;
+};
+
+/**
+ * A soil moisture probe on one ADC input
+ */
+class SoilSensor
+{
+public:
+    SoilSensor(Ads1115 &adc, int channel, const SoilCalibration &calibration, size_t burst = 32);
+
+    int read();
+
+    int channel() const { return m_channel; }
+    float raw() const { return m_filter.value(); }
+    float moisture() const;
+    bool valid() const { return m_filter.primed(); }
+
+    void setCalibration(const SoilCalibration &calibration) { m_calibration = calibration; }
+    const SoilCalibration &calibration() const { return m_calibration; }
+
+private:
+    Ads1115 &m_adc;
+    int m_channel;
+    SoilCalibration m_calibration;
+    size_t m_burst;
+    SoilFilter m_filter;
+};
+
+#endif // SOILSENSOR_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Fixed size ring for handing values from exactly one producer thread to
+ * exactly one consumer thread without locks. push() and pop() never block;
+ * push() fails when the ring is full and pop() when it is empty. Each side
+ * only writes its own index and keeps a cached copy of the other one, so the
+ * two threads touch a shared cache line only when the cache runs out.
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+public:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    SpscRing() : m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0) {}
+
+    /**
+     * \func bool push(const T &value)
+     * \param value Copied into the ring
+     * \return false if the ring is full, the value is not stored
+     *
+     * Producer side only.
+     */
+    bool push(const T &value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head - m_cachedTail == N) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail == N)
+                return false;
+        }
+        m_slots[head & (N - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \func bool pop(T &value)
+     * \param value Receives the oldest entry
+     * \return false if the ring is empty
+     *
+     * Consumer side only.
+     */
+    bool pop(T &value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead)
+                return false;
+        }
+        value = m_slots[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Entries waiting, exact only when called from one of the two threads
+     * while the other is idle
+     */
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // Producer's line: its index and its view of the consumer
+    alignas(64) std::atomic<size_t> m_head;
+    size_t m_cachedTail;
+    // Consumer's line
+    alignas(64) std::atomic<size_t> m_tail;
+    size_t m_cachedHead;
+    alignas(64) T m_slots[N];
+};
+
+#endif // SPSCRING_H
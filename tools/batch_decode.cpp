@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "samplebatch.h"
+
+/**
+ * Prints every sample of a batch as one line of JSON, shaped like the
+ * planter/environment document, so batches can be fed to whatever already
+ * consumes that topic.
+ */
+static bool printBatch(const std::string &source, const std::vector<uint8_t> &payload)
+{
+    BatchHeader header;
+    std::vector<BatchSample> samples;
+
+    if (!SampleBatch::decode(payload.data(), payload.size(), header, samples)) {
+        std::cerr << source << ": Not a version " << static_cast<int>(SampleBatch::Version) << " batch" << std::endl;
+        return false;
+    }
+
+    for (const BatchSample &sample : samples) {
+        nlohmann::json doc;
+
+        doc["location"] = header.location;
+        doc["system"]["name"] = header.name;
+        doc["time"] = sample.time;
+        doc["light"] = sample.light;
+        doc["environment"]["humidity"] = sample.humidity;
+        doc["environment"]["celsius"] = sample.celsius;
+        doc["environment"]["farenheit"] = sample.celsius * 1.8 + 32;
+        doc["environment"]["confidence"] = sample.confidence;
+        std::cout << doc.dump() << std::endl;
+    }
+    return true;
+}
+
+/**
+ * Decodes batches published on planter/environment/batch. Each file holds
+ * one message payload, with no files the payload is read from stdin:
+ *
+ *     mosquitto_sub -t planter/environment/batch -C 1 -N | batch_decode
+ *
+ * Without -N mosquitto_sub ends the payload with a newline. The last byte of
+ * a batch can be 0x0a too, so the newline is only dropped when the payload
+ * doesn't decode with it.
+ */
+int main(int argc, char *argv[])
+{
+    int failures = 0;
+
+    if (argc < 2) {
+        std::vector<uint8_t> payload((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+        BatchHeader header;
+        std::vector<BatchSample> samples;
+
+        if (!payload.empty() && payload.back() == '\n' &&
+            !SampleBatch::decode(payload.data(), payload.size(), header, samples))
+            payload.pop_back();
+        return printBatch("stdin", payload) ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::ifstream ifs(argv[i], std::ios::binary);
+
+        if (!ifs) {
+            std::cerr << argv[i] << ": Unable to open" << std::endl;
+            failures++;
+            continue;
+        }
+        std::vector<uint8_t> payload((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (!printBatch(argv[i], payload))
+            failures++;
+    }
+    return failures ? 1 : 0;
+}
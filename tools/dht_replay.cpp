@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "dht_read.h"
+
+static const char *resultName(int result)
+{
+    switch (result) {
+    case DHT_SUCCESS:
+        return "ok";
+    case DHT_ERROR_TIMEOUT:
+        return "timeout";
+    case DHT_ERROR_CHECKSUM:
+        return "checksum";
+    case DHT_ERROR_ARGUMENT:
+        return "argument";
+    case DHT_ERROR_GPIO:
+        return "gpio";
+    }
+    return "unknown";
+}
+
+/**
+ * Replays DHT traces saved with dht_set_trace_dir() through the decoder and
+ * prints what every sensor in each trace decodes to, along with its pulse
+ * widths in microseconds when -v is given.
+ */
+int main(int argc, char *argv[])
+{
+    static dht_trace trace;
+    bool verbose = false;
+    int failures = 0;
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " [-v] trace..." << std::endl;
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string path = argv[i];
+
+        if (path == "-v") {
+            verbose = true;
+            continue;
+        }
+
+        if (dht_trace_load(&trace, path.c_str()) != DHT_SUCCESS) {
+            std::cerr << path << ": Unable to load trace" << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::cout << path << ": DHT" << trace.type << ", " << trace.head << " edges over "
+                  << trace.end_ns / 1000 << "us, worst sampling gap " << trace.max_gap_ns / 1000 << "us" << std::endl;
+        for (int bit = 0; bit < 32; bit++) {
+            if (!(trace.mask & (1u << bit)))
+                continue;
+
+            dht_reading reading;
+            int result = dht_decode_trace(&trace, bit, &reading);
+            char line[128];
+
+            snprintf(line, sizeof(line), "  pin %d: %s", trace.pins[bit], resultName(result));
+            std::cout << line;
+            if (result == DHT_SUCCESS)
+                std::cout << ", humidity " << reading.humidity << "%, temperature " << reading.temperature
+                          << "C, confidence " << reading.confidence << ", " << reading.ambiguous_bits
+                          << " ambiguous, " << reading.repaired_bits << " repaired";
+            else
+                failures++;
+            std::cout << std::endl;
+
+            uint32_t pulseNs[DHT_PULSES*2];
+            if (verbose && dht_trace_pulses(&trace, bit, pulseNs) == DHT_SUCCESS) {
+                std::cout << "   ";
+                for (int p = 0; p < DHT_PULSES*2; p++)
+                    std::cout << " " << pulseNs[p] / 1000;
+                std::cout << std::endl;
+            }
+        }
+    }
+
+    return failures ? 2 : 0;
+}
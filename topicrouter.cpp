@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "topicrouter.h"
+
+/**
+ * Splits off the topic level starting at start. next is where the following
+ * level starts, past the end of topic when this was the last one.
+ */
+static std::string_view topicLevel(std::string_view topic, size_t start, size_t &next)
+{
+    size_t slash = topic.find('/', start);
+
+    if (slash == std::string_view::npos) {
+        next = topic.size() + 1;
+        return topic.substr(start);
+    }
+    next = slash + 1;
+    return topic.substr(start, slash - start);
+}
+
+TopicRouter::TopicRouter() : m_root(new Node()), m_filters(0)
+{
+}
+
+TopicRouter::~TopicRouter()
+{
+}
+
+/**
+ * \func bool TopicRouter::validFilter(std::string_view filter)
+ *
+ * A filter is valid if it isn't empty, + only ever stands for a whole level
+ * and # only for the whole last level.
+ */
+bool TopicRouter::validFilter(std::string_view filter)
+{
+    size_t start = 0;
+    size_t next;
+
+    if (filter.empty())
+        return false;
+
+    while (start <= filter.size()) {
+        std::string_view level = topicLevel(filter, start, next);
+        if (level.find_first_of("+#") != std::string_view::npos) {
+            if (level.size() != 1)
+                return false;
+            if (level == "#" && next <= filter.size())
+                return false;
+        }
+        start = next;
+    }
+    return true;
+}
+
+/**
+ * \func bool TopicRouter::add(const std::string &filter, MessageHandler handler)
+ * \return false if filter isn't a valid topic filter
+ *
+ * A filter can have more than one handler, each is called in the order added.
+ */
+bool TopicRouter::add(const std::string &filter, MessageHandler handler)
+{
+    Node *node = m_root.get();
+    std::string_view view(filter);
+    SharedHandler shared;
+    size_t start = 0;
+    size_t next;
+
+    if (!validFilter(view) || !handler)
+        return false;
+
+    shared = std::make_shared<const MessageHandler>(std::move(handler));
+
+    while (start <= view.size()) {
+        std::string_view level = topicLevel(view, start, next);
+        if (level == "#") {
+            node->rest.push_back(shared);
+            m_filters++;
+            return true;
+        }
+        if (level == "+") {
+            if (!node->single)
+                node->single.reset(new Node());
+            node = node->single.get();
+        }
+        else {
+            auto it = node->children.find(level);
+            if (it == node->children.end())
+                it = node->children.emplace(std::string(level), std::unique_ptr<Node>(new Node())).first;
+            node = it->second.get();
+        }
+        start = next;
+    }
+    node->handlers.push_back(shared);
+    m_filters++;
+    return true;
+}
+
+/**
+ * \func bool TopicRouter::remove(const std::string &filter)
+ * \return false if nothing was registered for filter
+ *
+ * Removes every handler added for filter. The nodes stay, in case the filter
+ * is added again.
+ */
+bool TopicRouter::remove(const std::string &filter)
+{
+    Node *node = m_root.get();
+    std::string_view view(filter);
+    std::vector<SharedHandler> *handlers = NULL;
+    size_t start = 0;
+    size_t next;
+
+    if (!validFilter(view))
+        return false;
+
+    while (start <= view.size()) {
+        std::string_view level = topicLevel(view, start, next);
+        if (level == "#") {
+            handlers = &node->rest;
+            break;
+        }
+        if (level == "+") {
+            node = node->single.get();
+        }
+        else {
+            auto it = node->children.find(level);
+            node = (it == node->children.end()) ? NULL : it->second.get();
+        }
+        if (node == NULL)
+            return false;
+        start = next;
+    }
+    if (handlers == NULL)
+        handlers = &node->handlers;
+    if (handlers->empty())
+        return false;
+
+    m_filters -= handlers->size();
+    handlers->clear();
+    return true;
+}
+
+void TopicRouter::clear()
+{
+    m_root.reset(new Node());
+    m_filters = 0;
+}
+
+/**
+ * \func size_t TopicRouter::dispatch(std::string_view topic, const uint8_t *payload, size_t size) const
+ * \return The number of handlers the message was given to
+ *
+ * Calls the handler of every filter that matches topic. As in the MQTT
+ * spec, a # also matches its parent level, and topics starting with $ are
+ * only matched by filters that spell out their first level.
+ */
+size_t TopicRouter::dispatch(std::string_view topic, const uint8_t *payload, size_t size) const
+{
+    auto call = [&](const SharedHandler &handler) { (*handler)(topic, payload, size); };
+
+    return match(m_root.get(), topic, 0, true, call);
+}
+
+/**
+ * \func size_t TopicRouter::handlers(std::string_view topic, std::vector<SharedHandler> &result) const
+ * \return The number of handlers appended to result
+ *
+ * Matches like dispatch(), but hands out references to the handlers instead
+ * of calling them. Lets the caller drop its lock on the router before running
+ * them; once result has grown, collecting allocates nothing.
+ */
+size_t TopicRouter::handlers(std::string_view topic, std::vector<SharedHandler> &result) const
+{
+    auto collect = [&](const SharedHandler &handler) { result.push_back(handler); };
+
+    return match(m_root.get(), topic, 0, true, collect);
+}
+
+template<typename Visit>
+size_t TopicRouter::match(const Node *node, std::string_view topic, size_t start, bool first, Visit &visit) const
+{
+    bool system = first && !topic.empty() && topic[0] == '$';
+    size_t count = 0;
+    size_t next;
+
+    if (!system) {
+        for (const SharedHandler &handler : node->rest)
+            visit(handler);
+        count += node->rest.size();
+    }
+
+    if (start > topic.size()) {
+        for (const SharedHandler &handler : node->handlers)
+            visit(handler);
+        return count + node->handlers.size();
+    }
+
+    std::string_view level = topicLevel(topic, start, next);
+    auto it = node->children.find(level);
+    if (it != node->children.end())
+        count += match(it->second.get(), topic, next, false, visit);
+    if (node->single && !system)
+        count += match(node->single.get(), topic, next, false, visit);
+    return count;
+}
+
+/**
+ * \func std::vector<std::string> TopicRouter::filters() const
+ *
+ * Every filter with at least one handler, for subscribing to them
+ */
+std::vector<std::string> TopicRouter::filters() const
+{
+    std::vector<std::string> filters;
+
+    collect(m_root.get(), std::string(), true, filters);
+    return filters;
+}
+
+void TopicRouter::collect(const Node *node, const std::string &path, bool root, std::vector<std::string> &filters) const
+{
+    if (!root && !node->handlers.empty())
+        filters.push_back(path);
+    if (!node->rest.empty())
+        filters.push_back(root ? std::string("#") : path + "/#");
+
+    for (const auto &child : node->children)
+        collect(child.second.get(), root ? child.first : path + "/" + child.first, false, filters);
+    if (node->single)
+        collect(node->single.get(), root ? std::string("+") : path + "/+", false, filters);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2019 Peter Buelow <goballstate at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TOPICROUTER_H
+#define TOPICROUTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Receives a message. topic and payload point into the message as
+ * libmosquitto delivered it and are only valid during the call.
+ */
+typedef std::function<void(std::string_view topic, const uint8_t *payload, size_t size)> MessageHandler;
+
+/**
+ * How the router holds a handler, so handing one out costs a reference
+ * count rather than a copy of the function and whatever it captured
+ */
+typedef std::shared_ptr<const MessageHandler> SharedHandler;
+
+/**
+ * Maps MQTT topic filters, with + and # wildcards, to handlers. The filters
+ * are kept as a trie of topic levels. Dispatching a message walks one node
+ * per level of its topic, plus the wildcard branches along the way, and
+ * finds each level among its siblings by binary search. The cost barely
+ * moves with the number of filters, and dispatch allocates nothing.
+ */
+class TopicRouter
+{
+public:
+    TopicRouter();
+    ~TopicRouter();
+
+    static bool validFilter(std::string_view filter);
+
+    bool add(const std::string &filter, MessageHandler handler);
+    bool remove(const std::string &filter);
+    void clear();
+
+    size_t dispatch(std::string_view topic, const uint8_t *payload, size_t size) const;
+    size_t handlers(std::string_view topic, std::vector<SharedHandler> &result) const;
+    std::vector<std::string> filters() const;
+    size_t size() const { return m_filters; }
+
+private:
+    struct Node {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+        std::unique_ptr<Node> single;           // the + branch
+        std::vector<SharedHandler> handlers;    // filters ending at this level
+        std::vector<SharedHandler> rest;        // filters ending in # here
+    };
+
+    template<typename Visit>
+    size_t match(const Node *node, std::string_view topic, size_t start, bool first, Visit &visit) const;
+    void collect(const Node *node, const std::string &path, bool root, std::vector<std::string> &filters) const;
+
+    std::unique_ptr<Node> m_root;
+    size_t m_filters;
+};
+
+#endif // TOPICROUTER_H